@@ -5,17 +5,38 @@ extern "C"
 }
 #include <GLFW/glfw3.h>
 
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <optional>
 #include <print>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "src/engine/decoder.h"
 #include "src/engine/demuxer.h"
+#include "src/engine/keyframe_index.h"
 #include "src/engine/queue.h"
+#include "src/logic/clock.h"
+#include "src/logic/controller.h"
 #include "src/logic/executor.h"
+#include "src/logic/profile.h"
+#include "src/logic/session.h"
+#include "src/logic/thumbnail.h"
+#include "src/renderer/audio.h"
+#include "src/renderer/present.h"
 #include "src/renderer/video.h"
+#include "src/renderer/wall.h"
 #include "src/utils/ffmpeg_deleter.h"
+#include "src/utils/metrics.h"
+#include "src/utils/pool.h"
+#include "src/utils/trace.h"
 
 using ptr_packet_t = std::unique_ptr<AVPacket, av_packet_deleter>;
 using ptr_frame_t  = std::unique_ptr<AVFrame, av_frame_deleter>;
@@ -33,37 +54,13 @@ std::string read_file(const char* path)
     return ss.str();
 }
 
-int main(int argc, char* argv[])
+// GL 3.3 core window with a current context and vsync; glfw is terminated again on failure
+GLFWwindow* open_window(int width, int height, const char* title)
 {
-    const char* media_path = "../../../../example.mp4";
-    if (argc > 1)
-    {
-        media_path = argv[1];
-    }
-
-    std::print("{}\n", media_path);
-
-    QueueAtomic<ptr_packet_t> video_packet_queue;
-    QueueAtomic<ptr_packet_t> audio_packet_queue;
-    QueueAtomic<ptr_frame_t>  video_frame_queue;
-
-    Demuxer demux(video_packet_queue, audio_packet_queue, media_path);
-
-    const AVCodecParameters* video_codecpar = demux.video_codecpar();
-    if (video_codecpar == nullptr)
-    {
-        std::print(stderr, "main: demux video codecpar is null\n");
-        return -1;
-    }
-    const auto [video_w, video_h]    = demux.video_size();
-    const AVRational video_time_base = demux.video_time_base();
-
-    Decoder decode(video_packet_queue, video_frame_queue, video_codecpar);
-
     if (glfwInit() == GLFW_FALSE)
     {
         std::print(stderr, "glfwInit failed\n");
-        return -2;
+        return nullptr;
     }
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -73,13 +70,12 @@ int main(int argc, char* argv[])
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
 #endif
 
-    GLFWwindow* window
-        = glfwCreateWindow(video_w > 0 ? video_w : 640, video_h > 0 ? video_h : 360, "litePlayer", nullptr, nullptr);
+    GLFWwindow* window = glfwCreateWindow(width, height, title, nullptr, nullptr);
     if (window == nullptr)
     {
         std::print(stderr, "glfwCreateWindow failed\n");
         glfwTerminate();
-        return -3;
+        return nullptr;
     }
 
     glfwMakeContextCurrent(window);
@@ -88,91 +84,561 @@ int main(int argc, char* argv[])
         std::print(stderr, "gladLoadGLLoader failed\n");
         glfwDestroyWindow(window);
         glfwTerminate();
-        return -4;
+        return nullptr;
     }
     glfwSwapInterval(1);
+    return window;
+}
+
+// advertised by the primary monitor; the presenters measure the real one from their swaps
+double monitor_refresh_interval()
+{
+    const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    return mode != nullptr && mode->refreshRate > 0 ? 1.0 / mode->refreshRate : 1.0 / 60.0;
+}
+
+// --headless: decode every stream as fast as the pool allows, nothing is shown.
+// With --seconds N the files loop for N seconds, otherwise each is decoded once.
+int run_headless(const std::vector<const char*>& paths, double seconds)
+{
+    PlaybackSession session(std::max(std::thread::hardware_concurrency(), 2u));
+    for (const char* path : paths)
+    {
+        session.add(path, StreamConfig {.loop = seconds > 0.0});
+    }
+    if (session.size() == 0)
+    {
+        std::print(stderr, "[Headless] no playable input\n");
+        return -1;
+    }
+
+    using clock_t    = std::chrono::steady_clock;
+    const auto start = clock_t::now();
+    session.start(true);
+
+    auto     last        = start;
+    uint64_t last_frames = 0;
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        const auto     now    = clock_t::now();
+        const uint64_t frames = session.frames_decoded();
+        std::print("[Headless] {} streams {:.1f} fps\n",
+                   session.size(),
+                   static_cast<double>(frames - last_frames) / std::chrono::duration<double>(now - last).count());
+        last        = now;
+        last_frames = frames;
+
+        if (seconds > 0.0 ? std::chrono::duration<double>(now - start).count() >= seconds : session.all_finished())
+        {
+            break;
+        }
+    }
+    const int codec_threads = DecodeThreadBudget::shared().share(); // before the decoders leave
+    session.stop();
+
+    const double   elapsed = std::chrono::duration<double>(clock_t::now() - start).count();
+    const uint64_t frames  = session.frames_decoded();
+    std::print("[Headless] {} frames from {} streams ({} codec threads each) in {:.2f}s, {:.1f} fps aggregate\n",
+               frames,
+               session.size(),
+               codec_threads,
+               elapsed,
+               static_cast<double>(frames) / elapsed);
+    return 0;
+}
+
+// --thumbnails DIR: one contact sheet of evenly spaced keyframes per file, written as DIR/<name>.png.
+int run_thumbnails(const std::vector<const char*>& paths, const std::string& out_dir, const ThumbnailConfig& config)
+{
+    std::error_code error;
+    std::filesystem::create_directories(out_dir, error);
+    if (error)
+    {
+        std::print(stderr, "[Thumbnail] cannot create {}: {}\n", out_dir, error.message());
+        return -1;
+    }
+
+    const auto           start = std::chrono::steady_clock::now();
+    ThumbnailBatch       batch(config);
+    const ThumbnailStats stats   = batch.run(paths, out_dir);
+    const double         elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::print("[Thumbnail] {} of {} files, {} tiles in {:.2f}s, {:.1f} files/s\n",
+               stats.written,
+               stats.files,
+               stats.tiles,
+               elapsed,
+               static_cast<double>(stats.written) / elapsed);
+    return stats.failed == 0 ? 0 : -1;
+}
+
+// Several inputs: one window, one tile per stream, every stream looping.
+int run_wall(const std::vector<const char*>& paths)
+{
+    PlaybackSession session(PipelineExecutor::threads_for(DecodeThreadBudget::shared(), paths.size()));
+    for (const char* path : paths)
+    {
+        session.add(path);
+    }
+    if (session.size() == 0)
+    {
+        std::print(stderr, "[Wall] no playable input\n");
+        return -1;
+    }
+
+    GLFWwindow* window = open_window(1280, 720, "litePlayer wall");
+    if (window == nullptr)
+    {
+        return -2;
+    }
 
     std::string vertsrc = read_file("../../../../shader/vertex.shader");
     std::string fragsrc = read_file("../../../../shader/fragment.shader");
-    Renderer    renderer(video_w, video_h, vertsrc.c_str(), fragsrc.c_str());
-    if (!renderer.ok())
+    VideoWall   wall(session.streams(), vertsrc.c_str(), fragsrc.c_str());
+    if (!wall.ok())
     {
-        std::print(stderr, "renderer init failed\n");
+        std::print(stderr, "[Wall] renderer init failed\n");
+        wall.shutdown();
         glfwDestroyWindow(window);
         glfwTerminate();
         return -5;
     }
 
-    int fbw = 0;
-    int fbh = 0;
-    glfwGetFramebufferSize(window, &fbw, &fbh);
-    glViewport(0, 0, fbw, fbh);
+    // paced by the swap alone: frames are picked for the refresh they will be visible at
+    VsyncEstimator vsync(monitor_refresh_interval());
+    session.start();
+    while (glfwWindowShouldClose(window) == GLFW_FALSE)
+    {
+        glfwPollEvents();
+        wall.update(vsync.next(), vsync.interval());
 
-    demux.run();
-    decode.run();
+        int fbw = 0;
+        int fbh = 0;
+        glfwGetFramebufferSize(window, &fbw, &fbh);
+        wall.draw(fbw, fbh);
+        {
+            LITEP_TRACE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+        vsync.swapped();
+    }
+    session.stop();
 
-    bool    quit          = false;
-    bool    clock_started = false;
-    int64_t first_pts     = AV_NOPTS_VALUE;
-    auto    wall_start    = std::chrono::steady_clock::now();
+    const TileStats stats = wall.stats();
+    std::print("[Wall] {} streams, shown {} dropped {}, {:.2f} ms refresh, {} missed vsyncs\n",
+               session.size(),
+               stats.shown,
+               stats.dropped,
+               vsync.interval() * 1e3,
+               vsync.missed());
 
-    while (!quit)
-    {
-        std::print("1");
+    wall.shutdown();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
 
-        glfwPollEvents();
-        if (glfwWindowShouldClose(window) == GLFW_TRUE)
+#if defined(LITEP_TRACE)
+// LITEP_TRACE_FILE overrides the default
+std::string trace_path()
+{
+    const char* env = std::getenv("LITEP_TRACE_FILE");
+    return env != nullptr && *env != '\0' ? env : "litePlayer.trace.json";
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    // litePlayer [--low-latency] [--io buffered|mmap|readahead] [--headless [--seconds N]]
+    //            [--decode-threads N] [--audio-lang L | --no-audio]
+    //            [--thumbnails DIR [--thumbnail-count N]] [file... | -]
+    std::vector<const char*> paths;
+    std::string              thumbnail_dir;
+    ThumbnailConfig          thumbnails {};
+    bool                     headless = false;
+    double                   seconds  = 0.0;
+    LatencyProfile           latency  = LatencyProfile::Standard;
+    IoMode                   io       = IoMode::Buffered;
+    StreamSelection          streams {};
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--headless")
         {
-            quit = true;
-            break;
+            headless = true;
+        }
+        else if (arg == "--seconds" && i + 1 < argc)
+        {
+            seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--low-latency")
+        {
+            latency = LatencyProfile::Low; // live inputs, e.g. udp://, pipe:
+        }
+        else if (arg == "--io" && i + 1 < argc)
+        {
+            const std::string_view mode = argv[++i];
+            io = mode == "mmap" ? IoMode::Mmap : mode == "readahead" ? IoMode::ReadAhead : IoMode::Buffered;
+        }
+        else if (arg == "--audio-lang" && i + 1 < argc)
+        {
+            streams.audio_language = argv[++i]; // ISO 639-2, e.g. eng
+        }
+        else if (arg == "--no-audio")
+        {
+            streams.video_only = true;
+        }
+        else if (arg == "--decode-threads" && i + 1 < argc)
+        {
+            // codec threads shared by every stream of a wall / headless session
+            DecodeThreadBudget::shared().set_total(std::atoi(argv[++i]));
+        }
+        else if (arg == "--thumbnails" && i + 1 < argc)
+        {
+            thumbnail_dir = argv[++i];
         }
+        else if (arg == "--thumbnail-count" && i + 1 < argc)
+        {
+            thumbnails.count = std::max(std::atoi(argv[++i]), 1);
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty())
+    {
+        paths.push_back("../../../../example.mp4");
+    }
+    const char* media_path = paths.front();
+
+    std::print("{}\n", media_path);
+
+#if defined(LITEP_TRACE)
+    TraceRecorder::shared().start();
+    LITEP_TRACE_THREAD("render");
+#endif
+
+    if (!thumbnail_dir.empty() || headless || paths.size() > 1)
+    {
+        const int ret = !thumbnail_dir.empty() ? run_thumbnails(paths, thumbnail_dir, thumbnails)
+                        : headless             ? run_headless(paths, seconds)
+                                               : run_wall(paths);
+#if defined(LITEP_TRACE)
+        TraceRecorder::shared().stop();
+        TraceRecorder::shared().write(trace_path());
+#endif
+        return ret;
+    }
+
+    PipelineProfile profile = pipeline_profile(latency);
+    profile.demux.io        = io;
+    profile.demux.streams   = streams;
+
+    QueueAtomic<ptr_packet_t> video_packet_queue(profile.video_packet_slots, profile.video_packet_budget);
+    QueueAtomic<ptr_packet_t> audio_packet_queue(profile.audio_packet_slots, profile.audio_packet_budget);
+    QueueAtomic<ptr_frame_t>  video_frame_queue(profile.video_frame_slots, profile.video_frame_budget);
+    QueueAtomic<ptr_frame_t>  audio_frame_queue(profile.audio_frame_slots, profile.audio_frame_budget);
+
+    PipelineMetrics metrics; // outlives every stage that reports into it
+
+    // demux and decode stages share a few pool threads instead of one thread each
+    PipelineExecutor executor;
+
+    // keyframe index for seeking, scanned in the background (or read from its sidecar);
+    // not for live inputs or stdin ("-"), where a second reader would take data from a pipe
+    KeyframeIndexer keyframe_indexer(media_path);
+    if (latency == LatencyProfile::Standard && std::string_view(media_path) != "-")
+    {
+        keyframe_indexer.run();
+    }
+
+    Demuxer demux(video_packet_queue, audio_packet_queue, media_path, profile.demux);
+    demux.use_index(&keyframe_indexer);
+    demux.close_at_eof(); // the player exits at the end rather than waiting for a seek
+
+    const AVCodecParameters* video_codecpar = demux.video_codecpar();
+    if (video_codecpar == nullptr)
+    {
+        std::print(stderr, "main: demux video codecpar is null\n");
+        return -1;
+    }
+    const auto [video_w, video_h]    = demux.video_size();
+    const AVRational video_time_base = demux.video_time_base();
 
-        auto frame_opt = video_frame_queue.pop();
-        if (frame_opt == std::nullopt)
+    Decoder decode(video_packet_queue, video_frame_queue, video_codecpar, profile.video_decoder);
+    decode.follow(demux.serial());
+
+    // LITEP_METRICS=<file>: per-stage telemetry every second, Prometheus text for *.prom,
+    // JSON lines otherwise
+    std::unique_ptr<MetricsReporter> metrics_reporter;
+    if (const char* metrics_path = std::getenv("LITEP_METRICS"); metrics_path != nullptr && *metrics_path != '\0')
+    {
+        demux.report_to(metrics);
+        decode.report_to(metrics);
+        metrics.watch("video_packets", video_packet_queue);
+        metrics.watch("audio_packets", audio_packet_queue);
+        metrics.watch("video_frames", video_frame_queue);
+        metrics.watch("audio_frames", audio_frame_queue);
+        metrics_reporter = std::make_unique<MetricsReporter>(
+            metrics, metrics_path, MetricsReporter::format_for(metrics_path));
+    }
+    PlaybackController controller(demux);
+
+    // Decoders open their codecs in run(), so they run before the demuxer: a track that cannot be
+    // decoded is not demuxed at all.
+    decode.run(executor);
+    if (!decode.ready())
+    {
+        std::print(stderr, "main: could not open the video decoder\n");
+        return -3;
+    }
+
+    // Audio packets must always be drained, otherwise a full audio queue stalls the demuxer.
+    // Without a device backend the null sink consumes them at real-time rate.
+    const AVCodecParameters*     audio_codecpar = demux.audio_codecpar();
+    std::unique_ptr<Decoder>     audio_decode;
+    std::unique_ptr<AudioOutput> audio_output;
+    NullAudioSink                audio_sink;
+    SyncClock                    sync_clock(ClockMaster::Audio);
+    if (audio_codecpar != nullptr)
+    {
+        audio_decode = std::make_unique<Decoder>(audio_packet_queue, audio_frame_queue, audio_codecpar);
+        audio_decode->follow(demux.serial());
+        audio_decode->run(executor);
+    }
+    if (audio_decode != nullptr && audio_decode->ready())
+    {
+        audio_output = std::make_unique<AudioOutput>(
+            audio_frame_queue, audio_sink, AudioFormat {}, &sync_clock.audio);
+        audio_output->follow(demux.serial());
+        controller.attach_audio(*audio_decode);
+    }
+    else
+    {
+        if (audio_decode != nullptr)
         {
-            if (!video_frame_queue.running_status())
-            {
-                break;
-            }
-            continue;
+            std::print(stderr, "main: could not open the audio decoder, playing without sound\n");
+            audio_decode->stop();
+            audio_decode.reset();
         }
+        demux.disable_audio(); // no consumer: its packets would fill the queue and stall the demuxer
+        sync_clock.select(ClockMaster::External);
+    }
+    VideoPacer pacer(sync_clock, profile.pacing);
+
+    GLFWwindow* window = open_window(video_w > 0 ? video_w : 640, video_h > 0 ? video_h : 360, "litePlayer");
+    if (window == nullptr)
+    {
+        return -2;
+    }
+
+    // left/right: 5 s keyframe seek, with shift: frame-accurate; A: next audio track
+    glfwSetWindowUserPointer(window, &controller);
+    glfwSetKeyCallback(window,
+                       [](GLFWwindow* w, int key, int, int action, int mods)
+                       {
+                           if (action != GLFW_PRESS && action != GLFW_REPEAT)
+                           {
+                               return;
+                           }
+                           auto* ctl = static_cast<PlaybackController*>(glfwGetWindowUserPointer(w));
+                           const SeekMode mode
+                               = (mods & GLFW_MOD_SHIFT) != 0 ? SeekMode::Accurate : SeekMode::Keyframe;
+                           if (key == GLFW_KEY_LEFT)
+                           {
+                               ctl->seek_relative(-5.0, mode);
+                           }
+                           else if (key == GLFW_KEY_RIGHT)
+                           {
+                               ctl->seek_relative(5.0, mode);
+                           }
+                           else if (key == GLFW_KEY_A && action == GLFW_PRESS)
+                           {
+                               ctl->cycle_audio();
+                           }
+#if defined(LITEP_TRACE)
+                           else if (key == GLFW_KEY_T && action == GLFW_PRESS)
+                           {
+                               TraceRecorder::shared().write(trace_path()); // snapshot, keeps recording
+                           }
+#endif
+                       });
+
+    std::string vertsrc = read_file("../../../../shader/vertex.shader");
+    std::string fragsrc = read_file("../../../../shader/fragment.shader");
+    Renderer    renderer(video_w, video_h, vertsrc.c_str(), fragsrc.c_str());
+    if (!renderer.ok())
+    {
+        std::print(stderr, "renderer init failed\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -5;
+    }
+
+    // planes are copied into mapped pixel buffers off the render thread; one slot more than
+    // the presenter holds, so the copy worker always has one to fill
+    PboUploader uploader(video_frame_queue, video_w, video_h, video_codecpar->format, 4);
+    if (!uploader.ok())
+    {
+        std::print(stderr, "pixel buffer uploader init failed\n");
+        renderer.shutdown();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -6;
+    }
 
-        auto&         frame = *frame_opt;
-        const int64_t pts
-            = (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : frame->pts;
+    uploader.follow(demux.serial());
 
-        // Use stream time_base + frame pts to pace rendering on wall clock.
-        if (pts != AV_NOPTS_VALUE && video_time_base.num > 0 && video_time_base.den > 0)
+    FramePresenter presenter(
+        uploader, pacer, sync_clock, profile.pacing, video_time_base, monitor_refresh_interval());
+    presenter.follow(demux.serial());
+
+    // framebuffer size is only queried on the event thread
+    std::atomic<int> fb_width_o {0};
+    std::atomic<int> fb_height_o {0};
+    auto             query_framebuffer = [&]
+    {
+        int fbw = 0;
+        int fbh = 0;
+        glfwGetFramebufferSize(window, &fbw, &fbh);
+        fb_width_o.store(fbw, std::memory_order_relaxed);
+        fb_height_o.store(fbh, std::memory_order_relaxed);
+    };
+    query_framebuffer();
+
+    if (metrics_reporter != nullptr)
+    {
+        metrics_reporter->run();
+    }
+    uploader.run();
+    if (audio_output != nullptr)
+    {
+        audio_output->run();
+    }
+    demux.run(executor);
+
+    // Render thread: owns the GL context from here on and presents once per refresh; the swap
+    // is the only wait besides collecting frames. This thread keeps handling window events.
+    std::atomic_bool render_done_o {false};
+    glfwMakeContextCurrent(nullptr);
+    std::jthread render_thread(
+        [&](const std::stop_token& st)
         {
-            if (!clock_started)
-            {
-                first_pts     = pts;
-                wall_start    = std::chrono::steady_clock::now();
-                clock_started = true;
-            }
-            const double sec = static_cast<double>(pts - first_pts) * av_q2d(video_time_base);
-            if (sec > 0.0)
+            LITEP_TRACE_THREAD("present");
+            glfwMakeContextCurrent(window);
+
+            while (!st.stop_requested())
             {
-                const auto target = wall_start
-                                  + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
-                                        std::chrono::duration<double>(sec));
-                const auto now    = std::chrono::steady_clock::now();
-                if (target > now)
+                uploader.reclaim();
+                const double vsync = presenter.next_vsync();
+                presenter.collect(vsync, presenter.upload_by(vsync));
+                decode.skip_nonref(pacer.skip_nonref());
+                if (presenter.drained())
+                {
+                    break;
+                }
+
+                StageTimer present_timer(metrics_reporter != nullptr ? &metrics.present : nullptr);
+                const int  fbw = fb_width_o.load(std::memory_order_relaxed);
+                const int  fbh = fb_height_o.load(std::memory_order_relaxed);
+                glViewport(0, 0, fbw, fbh);
+                const std::optional<PresentedFrame> frame = presenter.render(renderer, vsync);
+                {
+                    LITEP_TRACE_SCOPE("glfwSwapBuffers");
+                    glfwSwapBuffers(window);
+                }
+                presenter.swapped(clock_now_seconds());
+                if (frame == std::nullopt)
                 {
-                    std::this_thread::sleep_until(target);
+                    continue;
+                }
+                present_timer.done();
+                if (metrics_reporter != nullptr && frame->stamp != 0)
+                {
+                    metrics.demux_to_present.record(pipeline_now_us() - frame->stamp);
+                }
+                if (!std::isnan(frame->pts))
+                {
+                    pacer.presented(frame->pts);
+                    controller.on_frame(frame->serial, frame->pts);
                 }
             }
-        }
 
-        glfwGetFramebufferSize(window, &fbw, &fbh);
-        glViewport(0, 0, fbw, fbh);
-        renderer.renderFrame(frame.get());
-        glfwSwapBuffers(window);
+            // GL objects go with the context that created them
+            presenter.clear();
+            uploader.shutdown();
+            renderer.shutdown();
+            glfwMakeContextCurrent(nullptr);
+            render_done_o.store(true, std::memory_order_release);
+            glfwPostEmptyEvent();
+        });
+
+    while (!render_done_o.load(std::memory_order_acquire))
+    {
+        glfwWaitEventsTimeout(0.1);
+        if (glfwWindowShouldClose(window) == GLFW_TRUE)
+        {
+            break;
+        }
+        query_framebuffer();
     }
 
+    // the copy worker may be waiting on the frame queue; stopping the pipeline closes it
     demux.stop();
     decode.stop();
-    renderer.shutdown();
+    if (audio_output != nullptr)
+    {
+        audio_decode->stop();
+        audio_output->stop();
+    }
+    render_thread.request_stop();
+    render_thread.join();
+    if (metrics_reporter != nullptr)
+    {
+        metrics_reporter->stop(); // writes the last partial interval
+    }
+
+#if defined(LITEP_TRACE)
+    TraceRecorder::shared().stop();
+    TraceRecorder::shared().write(trace_path());
+#endif
+
+    const PacerStats& pacer_stats = pacer.stats();
+    std::print("[Sync] presented {} dropped {} max late {:.3f}s\n",
+               pacer_stats.presented,
+               pacer_stats.dropped,
+               pacer_stats.max_late);
+
+    const PresentStats present_stats = presenter.stats();
+    std::print("[Present] {} swaps at {:.2f} ms ({:.2f} fps content), {} new frames, {} repeated, {} superseded\n",
+               present_stats.swaps,
+               presenter.vsync_interval() * 1e3,
+               1.0 / pacer.frame_duration(),
+               present_stats.shown,
+               present_stats.repeated,
+               present_stats.superseded);
+    std::print("[Present] {} missed vsyncs, {} frames late for their refresh, {} off cadence\n",
+               present_stats.missed_vsyncs,
+               present_stats.late,
+               present_stats.off_cadence);
+
+    const SeekStats seek_stats = controller.stats();
+    std::print("[Seek] {} seeks, first frame after {:.1f} ms mean, {:.1f} ms max\n",
+               seek_stats.completed,
+               seek_stats.mean_ms(),
+               seek_stats.max_ms);
+
+    const PoolStats packet_stats = PacketPool::shared().stats();
+    const PoolStats frame_stats  = FramePool::shared().stats();
+    std::print("[Pool] packet hits {} misses {} high-water {}\n",
+               packet_stats.hits,
+               packet_stats.misses,
+               packet_stats.high_water);
+    std::print("[Pool] frame hits {} misses {} high-water {}\n",
+               frame_stats.hits,
+               frame_stats.misses,
+               frame_stats.high_water);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -1,17 +1,30 @@
 #version 330 core
+// The renderer inserts one of these after the version line, per pixel format:
+//   SEMI_PLANAR  chroma interleaved in one RG texture (NV12, P010)
+//   SWAP_UV      interleaved chroma stored V first (NV21)
 
 in vec2 TexCoord;
 out vec4 FragColor;
 
 uniform sampler2D texY;
-uniform sampler2D texU;
+uniform sampler2D texU; // interleaved UV when SEMI_PLANAR
 uniform sampler2D texV;
+uniform float     sampleScale; // R16 samples of 10/12-bit formats back to [0, 1]
 
 void main()
 {
-    float y = texture(texY, TexCoord).r;
-    float u = texture(texU, TexCoord).r - 0.5;
-    float v = texture(texV, TexCoord).r - 0.5;
+    float y = texture(texY, TexCoord).r * sampleScale;
+#ifdef SEMI_PLANAR
+    vec2 uv = texture(texU, TexCoord).rg * sampleScale;
+    #ifdef SWAP_UV
+    uv = uv.yx;
+    #endif
+    float u = uv.x - 0.5;
+    float v = uv.y - 0.5;
+#else
+    float u = texture(texU, TexCoord).r * sampleScale - 0.5;
+    float v = texture(texV, TexCoord).r * sampleScale - 0.5;
+#endif
 
     // BT.601 full range
     float r = y + 1.402 * v;
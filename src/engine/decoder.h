@@ -5,12 +5,39 @@ extern "C"
 #include "libavcodec/avcodec.h"
 }
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <print>
-#include <thread>
+#include <stop_token>
 
 #include "../utils/ffmpeg_deleter.h"
+#include "../utils/metrics.h"
+#include "../utils/pool.h"
+#include "../utils/trace.h"
 #include "./queue.h"
+#include "./queue_cost.h"
+#include "./serial.h"
+#include "./stage.h"
+#include "./thread_budget.h"
+
+enum class DecodeThreading
+{
+    Frame, // a frame per thread: most throughput, but adds threads - 1 frames of delay
+    Slice, // threads share one frame: no added delay, only as parallel as the stream's slices
+    Auto,  // either, the codec picks (frame threading where it has it)
+};
+
+struct DecoderConfig
+{
+    DecodeThreading     threading      = DecodeThreading::Frame;
+    int                 threads        = 0;       // fixed count; 0: the budget's share, FFmpeg's auto without one
+    DecodeThreadBudget* budget         = nullptr; // only used when threads == 0
+    bool                low_delay      = false;   // AV_CODEC_FLAG_LOW_DELAY: no frame reordering delay
+    bool                keyframes_only = false;   // skip_frame = AVDISCARD_NONKEY, e.g. for thumbnails
+};
 
 class Decoder
 {
@@ -19,16 +46,55 @@ private:
     using ptr_packet_t    = std::unique_ptr<AVPacket, av_packet_deleter>;
     using ptr_frame_t     = std::unique_ptr<AVFrame, av_frame_deleter>;
     using ptr_codec_ctx_t = std::unique_ptr<AVCodecContext, av_codec_context_deleter>;
+    using ptr_codecpar_t  = std::unique_ptr<AVCodecParameters, av_codec_parameters_deleter>;
+    using ptr_sws_t       = std::unique_ptr<SwsContext, sws_context_deleter>;
+
+    static constexpr int k_max_shift = 3; // at most 1/8 of the source size, like lowres
 
     ptr_codec_ctx_t            m_ptr_codec_ctx {nullptr};
     QueueAtomic<ptr_packet_t>& m_packet_queue;
     QueueAtomic<ptr_frame_t>&  m_frame_queue;
-    std::jthread               m_thread;
-    bool                       m_ready = false;
+    FramePool&                 m_frame_pool;
+    DecoderConfig              m_config;
+    ptr_codecpar_t             m_codecpar {nullptr}; // kept to reopen the codec with another thread count
+    int                        m_threads = 0;        // thread_count the codec was opened with
+    AVRational                 m_time_base {0, 1}; // of the last packet, stamped on frames
+    std::atomic_bool           m_skip_nonref_o {false};
+    bool                       m_skipping       = false; // decode stage's view of m_skip_nonref_o
+    const SerialCounter*       m_serial         = nullptr;
+    int64_t                    m_current_serial = 0;
+    int64_t                    m_discard_before = AV_NOPTS_VALUE; // accurate seek target, in m_time_base
+    PipelineMetrics*           m_metrics        = nullptr;
+    bool                       m_ready          = false;
+    bool                       m_joined         = false; // counted in m_config.budget until stop()
+    std::mutex                 m_change_mutex;
+    ptr_codecpar_t             m_change_codecpar {nullptr}; // change_codec(), applied at a track-switch flush
+    std::atomic<int64_t>       m_target_o {0};              // target_size(): width << 32 | height, 0: full
+    int64_t                    m_target     = 0;            // decode stage's view of m_target_o
+    int                        m_shift      = 0;            // frames end up 1 / 2^m_shift of the source size
+    int                        m_lowres     = 0;            // of m_shift, done by the codec (after a reopen)
+    AVDiscard                  m_skip_loop  = AVDISCARD_DEFAULT;
+    bool                       m_scale_fail = false;        // swscale refused this format, stop trying
+    ptr_sws_t                  m_sws {nullptr};
+
+    // stage state, only touched by step()
+    std::unique_ptr<StageRunner> m_runner;
+    StageOutbox<ptr_frame_t>     m_outbox;
+    ptr_frame_t                  m_frame;              // reused until it is handed downstream
+    bool                         m_has_output = false; // the codec may hold frames; receive before sending
+    bool                         m_eof_marker = false; // end of stream: pass an eof frame on once drained
+    bool                         m_input_done = false; // upstream closed: drain, then finish
+    bool                         m_reopening  = false; // draining to reopen at m_held (a keyframe)
+    bool                         m_switched   = false; // a track-switch flush passed, see on_control()
+    ptr_packet_t                 m_held;               // sent after the reopen
 
 public:
-    explicit Decoder(QueueAtomic<ptr_packet_t>& pq, QueueAtomic<ptr_frame_t>& fq, const AVCodecParameters* codecpar)
-        : m_packet_queue(pq), m_frame_queue(fq)
+    explicit Decoder(QueueAtomic<ptr_packet_t>& pq,
+                     QueueAtomic<ptr_frame_t>&  fq,
+                     const AVCodecParameters*   codecpar,
+                     const DecoderConfig&       config = {},
+                     FramePool&                 pool   = FramePool::shared())
+        : m_packet_queue(pq), m_frame_queue(fq), m_frame_pool(pool), m_config(config)
     {
         if (codecpar == nullptr)
         {
@@ -36,38 +102,24 @@ public:
             return;
         }
 
-        const AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
-        if (codec == nullptr)
-        {
-            std::print(stderr, "Decode could not find decoder\n");
-            return;
-        }
-
-        m_ptr_codec_ctx.reset(avcodec_alloc_context3(codec));
-        if (m_ptr_codec_ctx == nullptr)
+        m_codecpar.reset(avcodec_parameters_alloc());
+        if (m_codecpar == nullptr || avcodec_parameters_copy(m_codecpar.get(), codecpar) < 0)
         {
-            std::print(stderr, "Decode could not allocate codec context\n");
+            std::print(stderr, "Decode could not copy codec parameters\n");
             return;
         }
 
-        int ret = avcodec_parameters_to_context(m_ptr_codec_ctx.get(), codecpar);
-        if (ret < 0)
+        if (avcodec_find_decoder(m_codecpar->codec_id) == nullptr)
         {
-            std::print(stderr, "Decode failed to copy codec parameters to context\n");
+            std::print(stderr, "Decode could not find decoder\n");
             return;
         }
-
-        m_ptr_codec_ctx->thread_count = 0;               // auto threads
-        m_ptr_codec_ctx->thread_type  = FF_THREAD_FRAME; // frame parallel
-
-        ret = avcodec_open2(m_ptr_codec_ctx.get(), codec, nullptr);
-        if (ret < 0)
+        m_ready = true;
+        if (budgeted())
         {
-            std::print(stderr, "Decode could not open codec\n");
-            return;
+            m_config.budget->join(); // counted from now on, so decoders built together split it evenly
+            m_joined = true;
         }
-
-        m_ready = true;
     }
 
     Decoder(const Decoder&)              = delete;
@@ -81,112 +133,545 @@ public:
         stop();
     }
 
-    void run()
+    // a decoder exists for the stream; the codec itself is opened by run()
+    [[nodiscard]] bool ready() const
+    {
+        return m_ready;
+    }
+
+    // On its own thread by default, or on a shared PipelineExecutor (executor.h).
+    // The codec is opened here rather than in the constructor: a session builds all of its
+    // streams before starting any, so with a budget every decoder's first open already gets
+    // the final share instead of the whole budget.
+    void run(StageHost& host = ThreadHost::shared())
     {
-        if (!m_ready || m_ptr_codec_ctx == nullptr)
+        if (!m_ready)
         {
             std::print(stderr, "Decode not ready, run() skipped\n");
             return;
         }
-        if (m_thread.joinable())
+        if (m_runner != nullptr)
         {
-            std::print(stderr, "Demux already running, run() skipped\n");
+            std::print(stderr, "Decode already running, run() skipped\n");
             return;
         }
-        m_thread = std::jthread(
+        if (m_ptr_codec_ctx == nullptr && !open_codec(budgeted() ? m_config.budget->share() : m_config.threads))
+        {
+            m_ready = false;
+            return;
+        }
+
+        m_runner = host.create(
             [this](const std::stop_token& st)
             {
-                task(st);
-            });
+                return step(st);
+            },
+            m_ptr_codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO ? "audio decode" : "video decode");
+        m_packet_queue.set_consumer_waker(m_runner.get());
+        m_frame_queue.set_producer_waker(m_runner.get());
+        m_runner->start();
     }
 
     void stop()
     {
-        if (m_thread.joinable())
+        if (m_runner != nullptr)
         {
-            m_thread.request_stop();
+            m_runner->stop();
             m_packet_queue.close();
             m_frame_queue.close();
-            m_thread.join();
+            // waits out a wake() still made by the other side (e.g. the uploader's copy worker)
+            m_packet_queue.set_consumer_waker(nullptr);
+            m_frame_queue.set_producer_waker(nullptr);
+            m_runner.reset();
+        }
+        if (m_joined)
+        {
+            m_config.budget->leave();
+            m_joined = false;
         }
     }
 
-private:
-    void task(const std::stop_token& st)
+    // One bounded unit of work: hand on held frames, receive one frame, or send one packet.
+    // Never blocks; Idle while the frame queue is full or the packet queue is empty.
+    StepResult step(const std::stop_token& st)
     {
-        while (st.stop_requested() == false)
+        if (st.stop_requested())
         {
-            auto pkt_opt = m_packet_queue.pop();
+            return finish();
+        }
+
+        switch (m_outbox.flush())
+        {
+        case OutboxState::Closed:
+            return finish(); // downstream closed
+        case OutboxState::Full:
+            return StepResult::Idle;
+        case OutboxState::Empty:
+            break;
+        }
+
+        // drain what the codec holds before feeding it, so send never sees EAGAIN
+        if (m_has_output)
+        {
+            return receive_one();
+        }
+        if (m_input_done)
+        {
+            return finish(); // drained after upstream closed
+        }
+
+        std::optional<ptr_packet_t> pkt_opt;
+        if (m_held != nullptr)
+        {
+            pkt_opt = std::move(m_held); // the keyframe the codec was reopened for
+            m_held.reset();
+        }
+        else
+        {
+            pkt_opt = m_packet_queue.try_pop();
+        }
+        if (pkt_opt == std::nullopt)
+        {
+            if (m_packet_queue.running_status())
+            {
+                return StepResult::Idle;
+            }
+            pkt_opt = m_packet_queue.try_pop(); // a push may have landed before close()
             if (pkt_opt == std::nullopt)
             {
-                break; // upstream closed
+                // upstream closed: flush delayed frames
+                m_input_done = true;
+                avcodec_send_packet(m_ptr_codec_ctx.get(), nullptr);
+                m_has_output = true;
+                return StepResult::Progress;
             }
+        }
 
-            auto& pkt = *pkt_opt;
+        auto& pkt = *pkt_opt;
+        if (is_control(pkt.get()))
+        {
+            on_control(pkt.get());
+            return StepResult::Progress;
+        }
+        if (stale(serial_of(pkt.get())))
+        {
+            return StepResult::Progress; // queued before a seek
+        }
 
-            const int ret_send = avcodec_send_packet(m_ptr_codec_ctx.get(), pkt.get());
-            if (ret_send < 0)
-            {
-                // bad packet or decoder state; skip this packet
-                continue;
-            }
+        if (pkt->time_base.num > 0)
+        {
+            m_time_base = pkt->time_base;
+        }
+        apply_target();
+        if (reopen_due(pkt.get()))
+        {
+            // drain everything before the keyframe, then reopen and send it (receive_one)
+            m_held = std::move(pkt);
+            avcodec_send_packet(m_ptr_codec_ctx.get(), nullptr);
+            m_has_output = true;
+            m_reopening  = true;
+            return StepResult::Progress;
+        }
+        apply_skip();
+
+        StageTimer timer(m_metrics != nullptr ? &m_metrics->decode : nullptr);
+        int        ret_send = 0;
+        {
+            LITEP_TRACE_SCOPE("avcodec_send_packet");
+            ret_send = avcodec_send_packet(m_ptr_codec_ctx.get(), pkt.get());
+        }
+        timer.done(0);
+
+        // a bad packet or decoder state only loses this packet
+        m_has_output = ret_send >= 0;
+        return StepResult::Progress;
+    }
+
+    // Drop packets of older seek generations as soon as a seek is requested.
+    // Call before run(); without it every packet is decoded.
+    void follow(const SerialCounter& serial)
+    {
+        m_serial         = &serial;
+        m_current_serial = serial.current();
+    }
+
+    // Late-frame policy hook: while set, non-reference frames are not decoded at all.
+    // Takes effect from the next packet; the codec context is only touched by the decode stage.
+    void skip_nonref(bool skip)
+    {
+        m_skip_nonref_o.store(skip, std::memory_order_relaxed);
+    }
+
+    // Any thread: the size the frames are shown at, e.g. a wall tile (0, 0: full size).
+    // Once that is half the source or less, decoding gets cheaper by the same power of two:
+    // the loop filter is skipped (on non-reference frames only at 1/2), the codec decodes at
+    // reduced resolution where it supports lowres (from the next keyframe), and otherwise the
+    // frames are downscaled before they are queued, so upload bandwidth follows the tile size.
+    void target_size(int width, int height)
+    {
+        const int64_t packed = width > 0 && height > 0 ? static_cast<int64_t>(width) << 32 | height : 0;
+        m_target_o.store(packed, std::memory_order_relaxed);
+    }
+
+    // Optional: counts decoded frames, decode time and demux-to-decode latency into the
+    // decode stage. Call before run(), on the video decoder only.
+    void report_to(PipelineMetrics& metrics)
+    {
+        m_metrics = &metrics;
+    }
+
+    [[nodiscard]] int threads() const
+    {
+        return m_threads;
+    }
+
+    // Any thread: decode another stream from the flush the demuxer marks as the start of a
+    // switched track (Demuxer::select_audio, call this first). The parameters are copied here.
+    bool change_codec(const AVCodecParameters* codecpar)
+    {
+        ptr_codecpar_t copy(avcodec_parameters_alloc());
+        if (codecpar == nullptr || copy == nullptr || avcodec_parameters_copy(copy.get(), codecpar) < 0)
+        {
+            std::print(stderr, "Decode could not copy codec parameters\n");
+            return false;
+        }
+        std::lock_guard lock(m_change_mutex);
+        m_change_codecpar = std::move(copy);
+        return true;
+    }
+
+private:
+    [[nodiscard]] bool budgeted() const
+    {
+        return m_config.threads <= 0 && m_config.budget != nullptr;
+    }
+
+    // Opens m_codecpar with `threads` codec threads (0: FFmpeg's auto).
+    bool open_codec(int threads)
+    {
+        const AVCodec* codec = avcodec_find_decoder(m_codecpar->codec_id);
+        if (codec == nullptr)
+        {
+            std::print(stderr, "Decode could not find decoder\n");
+            return false;
+        }
+
+        ptr_codec_ctx_t ctx(avcodec_alloc_context3(codec));
+        if (ctx == nullptr)
+        {
+            std::print(stderr, "Decode could not allocate codec context\n");
+            return false;
+        }
+
+        int ret = avcodec_parameters_to_context(ctx.get(), m_codecpar.get());
+        if (ret < 0)
+        {
+            std::print(stderr, "Decode failed to copy codec parameters to context\n");
+            return false;
+        }
+
+        ctx->thread_count = std::max(threads, 0);
+        switch (m_config.threading)
+        {
+        case DecodeThreading::Frame:
+            ctx->thread_type = FF_THREAD_FRAME;
+            break;
+        case DecodeThreading::Slice:
+            ctx->thread_type = FF_THREAD_SLICE;
+            break;
+        case DecodeThreading::Auto:
+            ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            break;
+        }
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+        // frames inherit the packet's opaque, i.e. its demux timestamp (serial.h)
+        ctx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+#endif
+        if (m_config.low_delay)
+        {
+            ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+        ctx->lowres           = std::min<int>(m_lowres, codec->max_lowres);
+        ctx->skip_loop_filter = m_skip_loop;
+        ctx->skip_frame       = skip_frame(false);
+
+        ret = avcodec_open2(ctx.get(), codec, nullptr);
+        if (ret < 0)
+        {
+            std::print(stderr, "Decode could not open codec\n");
+            return false;
+        }
+
+        m_ptr_codec_ctx = std::move(ctx);
+        m_threads       = threads;
+        m_skipping      = false; // skip_frame is back to default on the new context
+        return true;
+    }
+
+    // The thread count and lowres are fixed once a codec is open, so following the budget or
+    // the target size means reopening it. Only done right before a keyframe, where no
+    // reference frames are lost. Keyframe-only decoders keep their threads: every packet they
+    // decode is a keyframe, and a batch that starts and finishes jobs would reopen at each one.
+    [[nodiscard]] bool reopen_due(const AVPacket* pkt) const
+    {
+        if ((pkt->flags & AV_PKT_FLAG_KEY) == 0)
+        {
+            return false;
+        }
+        const bool rebalance = budgeted() && !m_config.keyframes_only && m_config.budget->share() != m_threads;
+        return rebalance || std::min<int>(m_lowres, m_ptr_codec_ctx->codec->max_lowres) != m_ptr_codec_ctx->lowres;
+    }
+
+    void reopen()
+    {
+        const int threads = budgeted() ? m_config.budget->share() : m_threads;
+        if (!open_codec(threads))
+        {
+            // keep decoding with the drained old context
+            avcodec_flush_buffers(m_ptr_codec_ctx.get());
+            m_threads = threads; // do not retry at every keyframe
+            m_lowres  = m_ptr_codec_ctx->lowres;
+        }
+    }
+
+    // Stage only, on a flush: the codec is empty, so nothing is lost by replacing it.
+    void apply_codec_change()
+    {
+        ptr_codecpar_t codecpar;
+        {
+            std::lock_guard lock(m_change_mutex);
+            codecpar = std::move(m_change_codecpar);
+        }
+        if (codecpar == nullptr)
+        {
+            return;
+        }
+        std::swap(m_codecpar, codecpar);
+        if (!open_codec(m_threads))
+        {
+            std::swap(m_codecpar, codecpar); // keep decoding the old stream
+        }
+    }
+
+    [[nodiscard]] AVDiscard skip_frame(bool skip_nonref) const
+    {
+        const AVDiscard base = m_config.keyframes_only ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+        return skip_nonref ? std::max(base, AVDISCARD_NONREF) : base;
+    }
+
+    void apply_skip()
+    {
+        const bool skip = m_skip_nonref_o.load(std::memory_order_relaxed);
+        if (skip != m_skipping)
+        {
+            m_ptr_codec_ctx->skip_frame = skip_frame(skip);
+            m_skipping                  = skip;
+        }
+    }
+
+    // Stage only: follows target_size(). The loop filter setting applies from the next packet,
+    // lowres from the next keyframe (reopen_due), the downscale from the next frame.
+    void apply_target()
+    {
+        const int64_t target = m_target_o.load(std::memory_order_relaxed);
+        if (target == m_target)
+        {
+            return;
+        }
+        m_target = target;
+
+        const int target_w = static_cast<int>(target >> 32);
+        const int target_h = static_cast<int>(target & 0xffffffff);
+        int       shift    = 0;
+        while (target != 0 && shift < k_max_shift && (m_codecpar->width >> (shift + 1)) >= target_w
+               && (m_codecpar->height >> (shift + 1)) >= target_h)
+        {
+            ++shift;
+        }
+        m_shift     = shift;
+        m_lowres    = shift;
+        m_skip_loop = shift >= 2 ? AVDISCARD_ALL : shift == 1 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        m_ptr_codec_ctx->skip_loop_filter = m_skip_loop;
+    }
+
+    // Stage only: what lowres does not cover of m_shift, done on the decoded frame.
+    // Area averaging, one power of two per step, so the result does not alias.
+    void downscale()
+    {
+        const int shift = m_shift - m_ptr_codec_ctx->lowres;
+        if (shift <= 0 || m_scale_fail)
+        {
+            return;
+        }
 
-            while (st.stop_requested() == false)
+        const int   width  = std::max(m_frame->width >> shift, 1);
+        const int   height = std::max(m_frame->height >> shift, 1);
+        const auto  format = static_cast<AVPixelFormat>(m_frame->format);
+        ptr_frame_t small  = m_frame_pool.acquire();
+        if (small == nullptr)
+        {
+            return;
+        }
+        small->format = format;
+        small->width  = width;
+        small->height = height;
+        m_sws.reset(sws_getCachedContext(m_sws.release(),
+                                         m_frame->width,
+                                         m_frame->height,
+                                         format,
+                                         width,
+                                         height,
+                                         format,
+                                         SWS_AREA,
+                                         nullptr,
+                                         nullptr,
+                                         nullptr));
+        if (m_sws == nullptr || av_frame_get_buffer(small.get(), 0) < 0)
+        {
+            std::print(stderr, "Decode cannot downscale pixel format {}, frames stay full size\n", m_frame->format);
+            m_scale_fail = true;
+            return;
+        }
+
+        LITEP_TRACE_SCOPE("sws_scale");
+        sws_scale(m_sws.get(), m_frame->data, m_frame->linesize, 0, m_frame->height, small->data, small->linesize);
+        av_frame_copy_props(small.get(), m_frame.get()); // pts, time base, serial tag
+        m_frame = std::move(small);
+    }
+
+    [[nodiscard]] bool stale(int64_t serial) const
+    {
+        return m_serial != nullptr && serial != m_serial->current();
+    }
+
+    StepResult finish()
+    {
+        m_frame_queue.close();
+        return StepResult::Done;
+    }
+
+    // Receives one frame into the outbox.
+    StepResult receive_one()
+    {
+        if (m_frame == nullptr)
+        {
+            m_frame = m_frame_pool.acquire();
+            if (m_frame == nullptr)
             {
-                ptr_frame_t frame(av_frame_alloc());
-                if (frame == nullptr)
-                {
-                    m_frame_queue.close();
-                    return;
-                }
-
-                const int ret_recv = avcodec_receive_frame(m_ptr_codec_ctx.get(), frame.get());
-
-                if (ret_recv == AVERROR(EAGAIN) || ret_recv == AVERROR_EOF)
-                {
-                    break; // decoder drained
-                }
-                if (ret_recv < 0)
-                {
-                    std::print(stderr, "Decode error for current packet\n");
-                    break;
-                }
-
-                if (m_frame_queue.push(std::move(frame)) == false)
-                {
-                    m_frame_queue.close(); // downstream closed
-                    return;
-                }
+                return finish();
             }
         }
 
-        // flush delayed frames
-        avcodec_send_packet(m_ptr_codec_ctx.get(), nullptr);
-        while (st.stop_requested() == false)
+        StageTimer timer(m_metrics != nullptr ? &m_metrics->decode : nullptr);
+        int        ret_recv = 0;
         {
-            ptr_frame_t frame(av_frame_alloc());
-            if (frame == nullptr)
+            LITEP_TRACE_SCOPE("avcodec_receive_frame");
+            ret_recv = avcodec_receive_frame(m_ptr_codec_ctx.get(), m_frame.get());
+        }
+        timer.done(ret_recv >= 0 ? 1 : 0);
+
+        if (ret_recv == AVERROR(EAGAIN))
+        {
+            m_has_output = false; // needs the next packet
+            return StepResult::Progress;
+        }
+        if (ret_recv == AVERROR_EOF)
+        {
+            // drained: get ready for a seek
+            m_has_output = false;
+            if (m_reopening)
             {
-                break;
+                m_reopening = false;
+                reopen();
+                return StepResult::Progress;
             }
-
-            const int ret_recv = avcodec_receive_frame(m_ptr_codec_ctx.get(), frame.get());
-            if (ret_recv == AVERROR(EAGAIN) || ret_recv == AVERROR_EOF)
+            avcodec_flush_buffers(m_ptr_codec_ctx.get());
+            if (m_eof_marker)
             {
-                break;
+                m_eof_marker = false;
+                queue_control(m_current_serial, true, AV_NOPTS_VALUE);
             }
-            if (ret_recv < 0)
+            return StepResult::Progress;
+        }
+        if (ret_recv < 0)
+        {
+            std::print(stderr, "Decode error for current packet\n");
+            m_has_output = false;
+            return StepResult::Progress;
+        }
+
+        // stamp_of is 0 when this FFmpeg cannot carry opaque through the codec
+        const int64_t stamp = stamp_of(m_frame.get());
+        m_frame->time_base  = m_time_base;
+        set_serial(m_frame.get(), m_current_serial, stamp);
+        if (m_metrics != nullptr && stamp != 0)
+        {
+            m_metrics->demux_to_decode.record(pipeline_now_us() - stamp);
+        }
+
+        // accurate seek: decoded only to reach the target, not shown
+        // (the frame is kept and reused by the next receive)
+        if (m_discard_before != AV_NOPTS_VALUE)
+        {
+            const int64_t pts = m_frame->best_effort_timestamp != AV_NOPTS_VALUE ? m_frame->best_effort_timestamp
+                                                                                 : m_frame->pts;
+            if (pts != AV_NOPTS_VALUE && pts + std::max<int64_t>(m_frame->duration, 1) <= m_discard_before)
             {
-                std::print(stderr, "Decode error for current packet\n");
-                break;
+                av_frame_unref(m_frame.get());
+                return StepResult::Progress;
             }
+            m_discard_before = AV_NOPTS_VALUE;
+        }
+
+        downscale();
+        m_outbox.put(m_frame_queue, std::move(m_frame));
+        return StepResult::Progress;
+    }
+
+    void queue_control(int64_t serial, bool eof, int64_t pts)
+    {
+        ptr_frame_t marker = m_frame_pool.acquire();
+        if (marker == nullptr)
+        {
+            return;
+        }
+        make_control(marker.get(), serial, eof, pts);
+        marker->time_base = m_time_base;
+        m_outbox.put(m_frame_queue, std::move(marker));
+    }
 
-            if (m_frame_queue.push(std::move(frame)) == false)
+    void on_control(const AVPacket* pkt)
+    {
+        if (pkt->time_base.num > 0)
+        {
+            m_time_base = pkt->time_base;
+        }
+
+        if (is_flush(pkt))
+        {
+            avcodec_flush_buffers(m_ptr_codec_ctx.get());
+            // a switch flush already seeked away from is followed by a later flush of the new track
+            m_switched = m_switched || is_track_switch(pkt);
+            if (m_switched && !stale(serial_of(pkt)))
             {
-                break;
+                apply_codec_change();
+                m_switched = false;
             }
+            m_current_serial = serial_of(pkt);
+            m_discard_before = pkt->pts;
+            m_eof_marker     = false;
+            queue_control(m_current_serial, false, pkt->pts);
+            return;
         }
 
-        m_frame_queue.close();
+        if (stale(serial_of(pkt)))
+        {
+            return; // end of a generation that has been seeked away from
+        }
+
+        // end of stream: drain delayed frames, the eof frame follows them
+        avcodec_send_packet(m_ptr_codec_ctx.get(), nullptr);
+        m_has_output = true;
+        m_eof_marker = true;
     }
-};
\ No newline at end of file
+};
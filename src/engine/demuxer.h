@@ -5,14 +5,86 @@ extern "C"
 #include "libavcodec/packet.h"
 #include "libavformat/avformat.h"
 }
-#include <exec/static_thread_pool.hpp>
-#include <stdexec/execution.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <print>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "../utils/ffmpeg_deleter.h"
+#include "../utils/metrics.h"
+#include "../utils/pool.h"
+#include "../utils/trace.h"
+#include "./file_source.h"
+#include "./input_source.h"
+#include "./keyframe_index.h"
 #include "./queue.h"
+#include "./queue_cost.h"
+#include "./serial.h"
+#include "./stage.h"
+
+enum class SeekMode
+{
+    Keyframe, // nearest keyframe at or before the target; first frame shows fastest
+    Accurate, // same seek, then decoders discard frames that end before the target
+};
+
+struct SeekRequest
+{
+    int64_t  target_us = 0; // from the start of the media
+    SeekMode mode      = SeekMode::Keyframe;
+};
+
+inline constexpr int k_stream_best = -1; // libavformat's pick (or the first of the requested language)
+inline constexpr int k_stream_none = -2; // not demuxed at all
+
+// Which tracks are demuxed. Every other stream is set to AVDISCARD_ALL, so the container
+// skips its packets instead of handing them to us to be dropped (broadcast captures carry
+// many audio tracks plus data streams).
+struct StreamSelection
+{
+    int         video             = k_stream_best; // stream index or k_stream_best
+    int         audio             = k_stream_best; // stream index, k_stream_best or k_stream_none
+    int         subtitle          = k_stream_none; // only routed once output_subtitles() is called
+    const char* audio_language    = nullptr;       // ISO 639-2 tag of the stream ("eng", "deu")
+    const char* subtitle_language = nullptr;
+    bool        video_only        = false;         // same as audio = k_stream_none
+};
+
+struct TrackInfo
+{
+    int                      index = -1; // AVStream index, what select_*() take
+    AVMediaType              type  = AVMEDIA_TYPE_UNKNOWN;
+    const AVCodecParameters* codecpar   = nullptr;
+    std::string              language   = {}; // empty when the container does not say
+    bool                     is_default = false;
+};
+
+// How the input is opened. The defaults suit files; live inputs want to start sooner.
+struct DemuxerConfig
+{
+    bool    nobuffer           = false; // AVFMT_FLAG_NOBUFFER: packets read while probing are not kept
+    int64_t probesize          = 0;     // bytes read to detect the format; 0: libavformat's default (5 MB)
+    int64_t analyzeduration_us = 0;     // media time read for stream info; 0: default (5 s)
+
+    // container short name ("mpegts", "matroska") for inputs that cannot be probed well,
+    // such as pipes; nullptr: probe
+    const char* format = nullptr;
+
+    // file paths only: mmap or read-ahead through our own AVIOContext (file_source.h)
+    IoMode          io = IoMode::Buffered;
+    ReadAheadConfig read_ahead {};
+
+    StreamSelection streams {};
+};
 
 class Demuxer
 {
@@ -20,69 +92,370 @@ private:
     using ptr_packet_t     = std::unique_ptr<AVPacket, av_packet_deleter>;
     using ptr_format_ctx_t = std::unique_ptr<AVFormatContext, av_codec_format_ctx_deleter>;
 
-    ptr_format_ctx_t           m_p_format_ctx {nullptr};
-    QueueAtomic<ptr_packet_t>& m_video_queue;
-    QueueAtomic<ptr_packet_t>& m_audio_queue;
-    int                        m_video_stream_index = -1;
-    int                        m_audio_stream_index = -1;
+    struct PendingSeek
+    {
+        SeekRequest request;
+        int64_t     serial = 0;
+    };
+
+    std::unique_ptr<InputSource> m_source; // custom I/O; declared first, so it outlives the contexts
+    ptr_avio_t                   m_avio;
+    ptr_format_ctx_t             m_p_format_ctx {nullptr};
+    QueueAtomic<ptr_packet_t>&   m_video_queue;
+    QueueAtomic<ptr_packet_t>&   m_audio_queue;
+    QueueAtomic<ptr_packet_t>*   m_subtitle_queue = nullptr;
+    PacketPool&                  m_packet_pool;
+    std::vector<TrackInfo>       m_tracks; // as found when opening
+    int                          m_video_stream_index    = -1;
+    int                          m_audio_stream_index    = -1; // changed by the stage on a switch
+    int                          m_subtitle_stream_index = -1;
+    bool                         m_audio_selected        = false; // audio is consumed, switching allowed
+    bool                         m_blocking_reads        = false; // a read can wait on the source, see run()
+    bool                         m_close_at_eof          = false;
+    const KeyframeIndexer*       m_indexer               = nullptr;
+    StageMetrics*                m_metrics               = nullptr;
+    std::atomic_bool             m_interrupt_o {false}; // set by stop(): blocking libavformat I/O gives up
+
+    // stage state, only touched by step()
+    std::unique_ptr<StageRunner> m_runner;
+    WakerSlot                    m_waker; // m_runner while it runs, for seek()
+    StageOutbox<ptr_packet_t>    m_outbox;
+    int64_t                      m_current_serial = 0;
+    bool                         m_eof            = false;
+
+    // seek requests: latest wins, packed as target_us << 1 | mode
+    static constexpr int64_t k_no_seek = std::numeric_limits<int64_t>::min();
+    SerialCounter            m_serial;
+    std::mutex               m_seek_mutex; // a target is published and taken together with its serial
+    std::atomic<int64_t>     m_seek_o {k_no_seek};
+
+    // track switches, applied by the stage before its next read
+    static constexpr int k_no_switch = -3;
+    std::atomic<int>     m_audio_switch_o {k_no_switch};
+    std::atomic<int>     m_subtitle_switch_o {k_no_switch};
 
 public:
-    explicit Demuxer(QueueAtomic<ptr_packet_t>& vq, QueueAtomic<ptr_packet_t>& aq, const char* path)
-        : m_video_queue(vq), m_audio_queue(aq)
+    explicit Demuxer(QueueAtomic<ptr_packet_t>& vq,
+                     QueueAtomic<ptr_packet_t>& aq,
+                     const char*                path,
+                     const DemuxerConfig&       config = {},
+                     PacketPool&                pool   = PacketPool::shared())
+        : m_video_queue(vq), m_audio_queue(aq), m_packet_pool(pool)
     {
-        m_p_format_ctx = open_input(path);
-        if (m_p_format_ctx == nullptr)
+        open(path, config);
+    }
+
+    // Reads from `source` (memory, pushed chunks, a callback, a pipe; see input_source.h)
+    // instead of a path.
+    explicit Demuxer(QueueAtomic<ptr_packet_t>&   vq,
+                     QueueAtomic<ptr_packet_t>&   aq,
+                     std::unique_ptr<InputSource> source,
+                     const DemuxerConfig&         config = {},
+                     PacketPool&                  pool   = PacketPool::shared())
+        : m_source(std::move(source)), m_video_queue(vq), m_audio_queue(aq), m_packet_pool(pool)
+    {
+        if (m_source == nullptr)
         {
-            std::print(stderr, "[Demux] could not open input\n");
+            std::print(stderr, "[Demux] null input source\n");
             return;
         }
+        open("", config);
+    }
 
-        if (avformat_find_stream_info(m_p_format_ctx.get(), nullptr) < 0)
+    Demuxer(const Demuxer&)             = delete;
+    Demuxer operator=(const Demuxer&)   = delete;
+    Demuxer(Demuxer&&)                  = delete;
+    Demuxer operator=(Demuxer&&)        = delete;
+    auto    operator<=>(const Demuxer&) = delete;
+
+    ~Demuxer()
+    {
+        stop();
+    }
+
+    // On its own thread by default, or on a shared PipelineExecutor (executor.h).
+    // Network, pipe and pushed-chunk inputs always get their own thread: av_read_frame waits
+    // there for as long as the source stalls, which on the pool would hold a thread the other
+    // streams' stages need.
+    void run(StageHost& host = ThreadHost::shared())
+    {
+        if (m_p_format_ctx == nullptr || m_video_stream_index < 0)
         {
-            std::print(stderr, "[Demux] could not find stream info\n");
+            std::print(stderr, "[Demux] not ready, run() skipped\n");
             return;
         }
+        if (m_runner != nullptr)
+        {
+            std::print(stderr, "[Demux] already running, run() skipped\n");
+            return;
+        }
+        m_current_serial = m_serial.current();
+        m_eof            = false;
+        m_interrupt_o.store(false, std::memory_order_relaxed);
 
-        m_video_stream_index = av_find_best_stream(m_p_format_ctx.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-        m_audio_stream_index = av_find_best_stream(m_p_format_ctx.get(), AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        StageHost& stage_host = m_blocking_reads ? ThreadHost::shared() : host;
+        m_runner              = stage_host.create(
+            [this](const std::stop_token& st)
+            {
+                return step(st);
+            },
+            "demux");
+        m_video_queue.set_producer_waker(m_runner.get());
+        m_audio_queue.set_producer_waker(m_runner.get());
+        if (m_subtitle_queue != nullptr)
+        {
+            m_subtitle_queue->set_producer_waker(m_runner.get());
+        }
+        m_waker.set(m_runner.get());
+        m_runner->start();
+    }
 
-        if (m_video_stream_index < 0)
+    void stop()
+    {
+        if (m_runner != nullptr)
         {
-            std::print(stderr, "[Demux] could not find video stream\n");
-            return;
+            m_interrupt_o.store(true, std::memory_order_relaxed); // a network read returns AVERROR_EXIT
+            if (m_source != nullptr)
+            {
+                m_source->interrupt(); // the stage may be waiting inside av_read_frame
+            }
+            m_runner->stop();
+            m_video_queue.close();
+            m_audio_queue.close();
+            m_video_queue.set_producer_waker(nullptr);
+            m_audio_queue.set_producer_waker(nullptr);
+            if (m_subtitle_queue != nullptr)
+            {
+                m_subtitle_queue->close();
+                m_subtitle_queue->set_producer_waker(nullptr);
+            }
+            m_waker.set(nullptr);
+            m_runner.reset();
         }
     }
 
-    Demuxer(const Demuxer&)             = delete;
-    Demuxer operator=(const Demuxer&)   = delete;
-    Demuxer(Demuxer&&)                  = delete;
-    Demuxer operator=(Demuxer&&)        = delete;
-    auto    operator<=>(const Demuxer&) = delete;
+    // One bounded unit of work: a seek, handing on held packets, or reading one packet.
+    // Never blocks; Idle while the queues are full or after the end of the stream.
+    StepResult step(const std::stop_token& st)
+    {
+        if (st.stop_requested())
+        {
+            return finish();
+        }
+
+        if (const auto pending = take_seek())
+        {
+            // a switch is stored before the seek it comes with, so it is never applied without one
+            const bool audio_switched = apply_switches();
+            // packets still held back are all of the old generation
+            m_outbox.clear();
+            m_current_serial = pending->serial;
+            m_eof            = false;
+            seek_to(pending->request, m_current_serial, audio_switched);
+        }
+
+        switch (m_outbox.flush())
+        {
+        case OutboxState::Closed:
+            return finish(); // downstream closed
+        case OutboxState::Full:
+            return StepResult::Idle;
+        case OutboxState::Empty:
+            break;
+        }
 
-    ~Demuxer() = default;
+        // keep the pipeline up after the last packet, so the stream can still be seeked
+        if (m_eof)
+        {
+            return m_close_at_eof ? finish() : StepResult::Idle;
+        }
 
-    auto schedule_run(stdexec::scheduler auto sched)
+        ptr_packet_t ptr_pkt = m_packet_pool.acquire();
+        if (ptr_pkt == nullptr)
+        {
+            return finish();
+        }
+
+        StageTimer timer(m_metrics);
+        int        ret = 0;
+        {
+            LITEP_TRACE_SCOPE("av_read_frame");
+            ret = av_read_frame(m_p_format_ctx.get(), ptr_pkt.get());
+        }
+        if (ret < 0)
+        {
+            m_eof = true;
+            queue_control(m_current_serial, true, AV_NOPTS_VALUE);
+            return StepResult::Progress;
+        }
+
+        // queue budgets measure duration in the packet's own time base
+        ptr_pkt->time_base = m_p_format_ctx->streams[ptr_pkt->stream_index]->time_base;
+        set_serial(ptr_pkt.get(), m_current_serial, pipeline_now_us());
+        timer.done();
+
+        if (m_serial.current() != m_current_serial)
+        {
+            return StepResult::Progress; // a seek is pending; this packet is already stale
+        }
+
+        if (ptr_pkt->stream_index == m_video_stream_index)
+        {
+            m_outbox.put(m_video_queue, std::move(ptr_pkt));
+        }
+        else if (ptr_pkt->stream_index == m_audio_stream_index)
+        {
+            m_outbox.put(m_audio_queue, std::move(ptr_pkt));
+        }
+        else if (ptr_pkt->stream_index == m_subtitle_stream_index)
+        {
+            m_outbox.put(*m_subtitle_queue, std::move(ptr_pkt));
+        }
+        // other streams are discarded by the container; the few it still returns are dropped here
+        return m_outbox.flush() == OutboxState::Closed ? finish() : StepResult::Progress;
+    }
+
+    // Any thread. Packets/frames of the current generation become stale immediately;
+    // the demux stage performs the seek before its next read.
+    void seek(SeekRequest request)
     {
-        return stdexec::schedule(sched)
-             | stdexec::let_value(
-                   [this]()
-                   {
-                       return stdexec::get_stop_token();
-                   })
-             | stdexec::then(
-                   [this](auto stop_token)
-                   {
-                       this->task(stop_token);
-                   });
+        const int64_t target = std::max<int64_t>(request.target_us, 0);
+        {
+            // otherwise a seek overlapping this one could hand our target over with its serial
+            std::lock_guard lock(m_seek_mutex);
+            m_serial.bump();
+            m_seek_o.store(target << 1 | (request.mode == SeekMode::Accurate ? 1 : 0), std::memory_order_release);
+        }
+        wake();
+    }
+
+    // Optional: at the end of the input the queues are closed behind the eof packets, so the
+    // consumers finish instead of waiting for a seek (a player that exits at the end).
+    // Call before run().
+    void close_at_eof()
+    {
+        m_close_at_eof = true;
+    }
+
+    // Video only: audio packets are discarded inside libavformat instead of being queued
+    // for a consumer that does not exist. Call before run(); DemuxerConfig::streams does
+    // the same when opening.
+    void disable_audio()
+    {
+        set_discard(m_audio_stream_index, true);
+        m_audio_stream_index = -1;
+        m_audio_selected     = false;
+    }
+
+    // Packets of the selected subtitle track (StreamSelection::subtitle) go to `queue`.
+    // Call before run(); without it the track stays discarded.
+    void output_subtitles(QueueAtomic<ptr_packet_t>& queue)
+    {
+        m_subtitle_queue = &queue;
+        if (m_subtitle_stream_index >= 0)
+        {
+            set_discard(m_subtitle_stream_index, false);
+        }
+    }
+
+    // Any thread: another audio track. Queued packets are dropped and reading restarts at
+    // resume_us (an accurate seek, normally to the presented position) so the new track
+    // starts in sync; the audio decoder must be told the new codec first (Decoder::change_codec).
+    // false when `index` is not an audio track or audio was not selected at all.
+    bool select_audio(int index, int64_t resume_us)
+    {
+        if (track_type(index) != AVMEDIA_TYPE_AUDIO || !m_audio_selected)
+        {
+            return false;
+        }
+        m_audio_switch_o.store(index, std::memory_order_release);
+        seek(SeekRequest {.target_us = resume_us, .mode = SeekMode::Accurate});
+        return true;
+    }
+
+    // Any thread: another subtitle track, or k_stream_none. Same resync as select_audio().
+    bool select_subtitle(int index, int64_t resume_us)
+    {
+        if (m_subtitle_queue == nullptr || (index != k_stream_none && track_type(index) != AVMEDIA_TYPE_SUBTITLE))
+        {
+            return false;
+        }
+        m_subtitle_switch_o.store(index, std::memory_order_release);
+        seek(SeekRequest {.target_us = resume_us, .mode = SeekMode::Accurate});
+        return true;
+    }
+
+    // selected when opening; select_audio() changes it later on the stage
+    [[nodiscard]] int audio_stream_index() const
+    {
+        return m_audio_stream_index;
+    }
+
+    // every stream of the input; fixed once opened
+    [[nodiscard]] const std::vector<TrackInfo>& tracks() const
+    {
+        return m_tracks;
+    }
+
+    // Optional: once the index is ready, a seek is a lookup plus a direct jump to the keyframe
+    // instead of libavformat's own search (a linear scan for TS / fragmented MP4 without an index).
+    void use_index(const KeyframeIndexer* indexer)
+    {
+        m_indexer = indexer;
+    }
+
+    // Optional: counts packets read and the time spent in av_read_frame. Call before run().
+    void report_to(PipelineMetrics& metrics)
+    {
+        m_metrics = &metrics.demux;
+    }
+
+    [[nodiscard]] const SerialCounter& serial() const
+    {
+        return m_serial;
+    }
+
+    // timestamp of the first frame in microseconds; seek targets are relative to it
+    [[nodiscard]] int64_t start_us() const
+    {
+        if (!m_p_format_ctx || m_p_format_ctx->start_time == AV_NOPTS_VALUE)
+        {
+            return 0;
+        }
+        return m_p_format_ctx->start_time;
+    }
+
+    // microseconds, 0 when unknown
+    [[nodiscard]] int64_t duration_us() const
+    {
+        if (!m_p_format_ctx || m_p_format_ctx->duration == AV_NOPTS_VALUE)
+        {
+            return 0;
+        }
+        return m_p_format_ctx->duration;
     }
 
     // info
 
     [[nodiscard]] const AVCodecParameters* video_codecpar() const
     {
+        if (!m_p_format_ctx || m_video_stream_index < 0)
+        {
+            return nullptr;
+        }
         return m_p_format_ctx->streams[m_video_stream_index]->codecpar;
     }
 
+    // nullptr when the input has no audio track
+    [[nodiscard]] const AVCodecParameters* audio_codecpar() const
+    {
+        if (!m_p_format_ctx || m_audio_stream_index < 0)
+        {
+            return nullptr;
+        }
+        return m_p_format_ctx->streams[m_audio_stream_index]->codecpar;
+    }
+
     [[nodiscard]] std::pair<int, int> video_size() const
     {
         const AVCodecParameters* cp = video_codecpar();
@@ -102,59 +475,363 @@ public:
         return m_p_format_ctx->streams[m_video_stream_index]->time_base;
     }
 
+    [[nodiscard]] AVRational audio_time_base() const
+    {
+        if (!m_p_format_ctx || m_audio_stream_index < 0)
+        {
+            return AVRational {0, 1};
+        }
+        return m_p_format_ctx->streams[m_audio_stream_index]->time_base;
+    }
+
 private:
-    [[nodiscard]] static ptr_format_ctx_t open_input(const char* pt)
+    void open(const char* path, const DemuxerConfig& config)
     {
-        AVFormatContext* raw = avformat_alloc_context();
-        const int        ret = avformat_open_input(&raw, pt, nullptr, nullptr);
-        if (ret < 0)
+        m_p_format_ctx = open_input(path, config);
+        if (m_p_format_ctx == nullptr)
         {
-            return {nullptr};
+            std::print(stderr, "[Demux] could not open input\n");
+            return;
         }
+        m_blocking_reads = reads_can_block(path);
 
-        return ptr_format_ctx_t {raw};
+        if (avformat_find_stream_info(m_p_format_ctx.get(), nullptr) < 0)
+        {
+            std::print(stderr, "[Demux] could not find stream info\n");
+            return;
+        }
+
+        for (unsigned i = 0; i < m_p_format_ctx->nb_streams; ++i)
+        {
+            const AVStream*          stream   = m_p_format_ctx->streams[i];
+            const AVDictionaryEntry* language = av_dict_get(stream->metadata, "language", nullptr, 0);
+            m_tracks.push_back(TrackInfo {.index      = static_cast<int>(i),
+                                          .type       = stream->codecpar->codec_type,
+                                          .codecpar   = stream->codecpar,
+                                          .language   = language != nullptr ? language->value : "",
+                                          .is_default = (stream->disposition & AV_DISPOSITION_DEFAULT) != 0});
+        }
+
+        const StreamSelection& select = config.streams;
+        const int              audio  = select.video_only ? k_stream_none : select.audio;
+        m_video_stream_index          = pick_stream(AVMEDIA_TYPE_VIDEO, select.video, nullptr, -1);
+        m_audio_stream_index
+            = pick_stream(AVMEDIA_TYPE_AUDIO, audio, select.audio_language, m_video_stream_index);
+        m_subtitle_stream_index
+            = pick_stream(AVMEDIA_TYPE_SUBTITLE, select.subtitle, select.subtitle_language, m_video_stream_index);
+        m_audio_selected = m_audio_stream_index >= 0;
+
+        // everything else is skipped by the container from the first read on
+        for (const TrackInfo& track : m_tracks)
+        {
+            set_discard(track.index, track.index != m_video_stream_index && track.index != m_audio_stream_index);
+        }
+
+        if (m_video_stream_index < 0)
+        {
+            std::print(stderr, "[Demux] could not find video stream\n");
+            return;
+        }
     }
 
-    void task(auto stop_token)
+    // network / pipe protocols, and custom sources that cannot seek (pushed chunks, a pipe)
+    [[nodiscard]] bool reads_can_block(const char* path) const
     {
-        while (!stop_token.stop_requested())
+        if (m_source != nullptr)
         {
-            ptr_packet_t ptr_pkt(av_packet_alloc());
+            return !m_source->seekable();
+        }
+        const char* protocol = avio_find_protocol_name(path);
+        return protocol != nullptr && std::string_view(protocol) != "file";
+    }
 
-            if (ptr_pkt == nullptr)
+    // An explicit index must be a track of `type`; otherwise the default track of the language,
+    // any track of it, then libavformat's best (related to the video's program). -1: none.
+    [[nodiscard]] int pick_stream(AVMediaType type, int requested, const char* language, int related) const
+    {
+        if (requested == k_stream_none)
+        {
+            return -1;
+        }
+        if (requested >= 0)
+        {
+            if (track_type(requested) == type)
+            {
+                return requested;
+            }
+            std::print(
+                stderr, "[Demux] stream {} is not a {} track, picking one\n", requested, media_type_name(type));
+        }
+        if (language != nullptr)
+        {
+            int match = -1;
+            for (const TrackInfo& track : m_tracks)
+            {
+                if (track.type != type || track.language != language)
+                {
+                    continue;
+                }
+                if (track.is_default)
+                {
+                    return track.index;
+                }
+                match = match < 0 ? track.index : match;
+            }
+            if (match >= 0)
             {
-                break;
+                return match;
             }
+            std::print(stderr, "[Demux] no {} track in {}, picking one\n", media_type_name(type), language);
+        }
+        const int best = av_find_best_stream(m_p_format_ctx.get(), type, -1, related, nullptr, 0);
+        return best >= 0 ? best : -1;
+    }
 
-            const int ret = av_read_frame(m_p_format_ctx.get(), ptr_pkt.get());
-            if (ret < 0)
+    [[nodiscard]] AVMediaType track_type(int index) const
+    {
+        if (index < 0 || index >= static_cast<int>(m_tracks.size()))
+        {
+            return AVMEDIA_TYPE_UNKNOWN;
+        }
+        return m_tracks[index].type;
+    }
+
+    static const char* media_type_name(AVMediaType type)
+    {
+        switch (type)
+        {
+        case AVMEDIA_TYPE_VIDEO:
+            return "video";
+        case AVMEDIA_TYPE_AUDIO:
+            return "audio";
+        case AVMEDIA_TYPE_SUBTITLE:
+            return "subtitle";
+        default:
+            return "other";
+        }
+    }
+
+    void set_discard(int index, bool discard)
+    {
+        if (m_p_format_ctx != nullptr && index >= 0 && index < static_cast<int>(m_p_format_ctx->nb_streams))
+        {
+            m_p_format_ctx->streams[index]->discard = discard ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+        }
+    }
+
+    // Stage only: a pending select_audio()/select_subtitle(); the seek that follows it
+    // flushes the queues and restarts every selected track at the same position.
+    // Returns whether the audio track changed.
+    bool apply_switches()
+    {
+        bool      audio_switched = false;
+        const int audio          = m_audio_switch_o.exchange(k_no_switch, std::memory_order_acq_rel);
+        if (audio >= 0 && audio != m_audio_stream_index)
+        {
+            set_discard(m_audio_stream_index, true);
+            set_discard(audio, false);
+            m_audio_stream_index = audio;
+            audio_switched       = true;
+        }
+
+        const int subtitle = m_subtitle_switch_o.exchange(k_no_switch, std::memory_order_acq_rel);
+        if (subtitle != k_no_switch && subtitle != m_subtitle_stream_index)
+        {
+            set_discard(m_subtitle_stream_index, true);
+            set_discard(subtitle, false);
+            m_subtitle_stream_index = subtitle == k_stream_none ? -1 : subtitle;
+        }
+        return audio_switched;
+    }
+
+    [[nodiscard]] ptr_format_ctx_t open_input(const char* pt, const DemuxerConfig& config)
+    {
+        if (m_source == nullptr && config.io != IoMode::Buffered)
+        {
+            m_source = open_file_source(pt, config.io, config.read_ahead);
+            if (m_source == nullptr)
             {
-                break;
+                std::print(stderr,
+                           "[Demux] {} I/O unavailable, reading through libavformat\n",
+                           io_mode_name(config.io));
             }
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        if (m_source == nullptr && std::string_view(pt) == "-")
+        {
+            m_source = std::make_unique<PipeSource>(STDIN_FILENO);
+        }
+#endif
 
-            // TODO:    consider switch
-            bool pushed = true;
-            if (ptr_pkt->stream_index == m_video_stream_index)
+        AVFormatContext* raw = avformat_alloc_context();
+        if (raw == nullptr)
+        {
+            return {nullptr};
+        }
+        if (m_source != nullptr)
+        {
+            m_avio = make_avio(*m_source);
+            if (m_avio == nullptr)
             {
-                pushed = m_video_queue.push(std::move(ptr_pkt));
+                avformat_free_context(raw);
+                return {nullptr};
             }
-            else if (ptr_pkt->stream_index == m_audio_stream_index)
+            raw->pb = m_avio.get();
+            raw->flags |= AVFMT_FLAG_CUSTOM_IO; // closing the input leaves m_avio to us
+        }
+        // checked by libavformat's own I/O (network protocols, files) while it waits
+        raw->interrupt_callback = AVIOInterruptCB {.callback = &Demuxer::interrupted, .opaque = this};
+        // probing limits also bound avformat_find_stream_info, which reads until they are met
+        if (config.nobuffer)
+        {
+            raw->flags |= AVFMT_FLAG_NOBUFFER;
+        }
+        if (config.probesize > 0)
+        {
+            raw->probesize = config.probesize;
+        }
+        if (config.analyzeduration_us > 0)
+        {
+            raw->max_analyze_duration = config.analyzeduration_us;
+        }
+        const AVInputFormat* format = nullptr;
+        if (config.format != nullptr)
+        {
+            format = av_find_input_format(config.format);
+            if (format == nullptr)
             {
-                pushed = m_audio_queue.push(std::move(ptr_pkt));
+                std::print(stderr, "[Demux] unknown format {}, probing instead\n", config.format);
             }
-            else
+        }
+        const int ret = avformat_open_input(&raw, pt, format, nullptr);
+        if (ret < 0)
+        {
+            return {nullptr};
+        }
+
+        return ptr_format_ctx_t {raw};
+    }
+
+    static int interrupted(void* opaque)
+    {
+        return static_cast<const Demuxer*>(opaque)->m_interrupt_o.load(std::memory_order_relaxed) ? 1 : 0;
+    }
+
+    void wake()
+    {
+        m_waker.wake();
+    }
+
+    StepResult finish()
+    {
+        m_video_queue.close();
+        m_audio_queue.close();
+        if (m_subtitle_queue != nullptr)
+        {
+            m_subtitle_queue->close();
+        }
+        return StepResult::Done;
+    }
+
+    std::optional<PendingSeek> take_seek()
+    {
+        if (m_seek_o.load(std::memory_order_acquire) == k_no_seek)
+        {
+            return std::nullopt; // the common case, without the lock
+        }
+        std::lock_guard lock(m_seek_mutex);
+        const int64_t   packed = m_seek_o.exchange(k_no_seek, std::memory_order_acq_rel);
+        if (packed == k_no_seek)
+        {
+            return std::nullopt;
+        }
+        const SeekMode mode = (packed & 1) != 0 ? SeekMode::Accurate : SeekMode::Keyframe;
+        return PendingSeek {.request = {.target_us = packed >> 1, .mode = mode}, .serial = m_serial.current()};
+    }
+
+    // Queues a control packet for every selected stream. `audio_switch`: the audio flush is
+    // marked as the start of a newly selected track (the decoder changes codec there).
+    void queue_control(int64_t serial, bool eof, int64_t target_ts, bool audio_switch = false)
+    {
+        const std::pair<int, QueueAtomic<ptr_packet_t>*> outputs[] = {{m_video_stream_index, &m_video_queue},
+                                                                      {m_audio_stream_index, &m_audio_queue},
+                                                                      {m_subtitle_stream_index, m_subtitle_queue}};
+        for (const auto& [index, queue] : outputs)
+        {
+            if (index < 0 || queue == nullptr)
             {
                 continue;
-                // ignore non-video/audio packets
+            }
+            ptr_packet_t marker = m_packet_pool.acquire();
+            if (marker == nullptr)
+            {
+                return;
             }
 
-            if (pushed == false)
+            const AVRational tb = m_p_format_ctx->streams[index]->time_base;
+            const int64_t    pts = target_ts == AV_NOPTS_VALUE
+                                     ? AV_NOPTS_VALUE
+                                     : av_rescale_q(target_ts, AVRational {1, AV_TIME_BASE}, tb);
+            make_control(marker.get(), serial, eof, pts);
+            if (audio_switch && index == m_audio_stream_index)
             {
-                break; // downstream closed
+                marker->flags |= k_control_switch;
             }
+            marker->time_base = tb;
+            m_outbox.put(*queue, std::move(marker));
         }
+    }
 
-        m_video_queue.close();
-        m_audio_queue.close();
-    };
-};
\ No newline at end of file
+    void seek_to(const SeekRequest& request, int64_t serial, bool audio_switched = false)
+    {
+        const int64_t ts = request.target_us + start_us();
+
+        // keyframe at or before ts, so an accurate seek can decode forward to it
+        int ret = seek_indexed(ts);
+        if (ret < 0)
+        {
+            ret = avformat_seek_file(m_p_format_ctx.get(), -1, std::numeric_limits<int64_t>::min(), ts, ts, 0);
+        }
+        if (ret < 0)
+        {
+            std::print(stderr, "[Demux] seek to {} us failed\n", request.target_us);
+        }
+        queue_control(serial, false, request.mode == SeekMode::Accurate ? ts : AV_NOPTS_VALUE, audio_switched);
+    }
+
+    [[nodiscard]] bool byte_seekable() const
+    {
+        const AVInputFormat* format = m_p_format_ctx->iformat;
+        if (format == nullptr || format->name == nullptr || (format->flags & AVFMT_NO_BYTE_SEEK) != 0)
+        {
+            return false;
+        }
+        const std::string_view name = format->name;
+        return name == "mpegts" || name == "mpeg";
+    }
+
+    // ts in AV_TIME_BASE; negative when there is no usable index
+    int seek_indexed(int64_t ts)
+    {
+        const KeyframeIndex* index = m_indexer != nullptr ? m_indexer->index() : nullptr;
+        if (index == nullptr || index->empty() || index->stream_index() != m_video_stream_index)
+        {
+            return -1;
+        }
+
+        const int64_t       target = av_rescale_q(ts, AVRational {1, AV_TIME_BASE}, index->time_base());
+        const KeyframeEntry entry  = *index->lookup(target);
+
+        // MPEG-TS/PS resync on the packet at any byte offset, so the keyframe's offset skips their
+        // linear timestamp search; other containers (MKV, MP4) keep parser state that only a
+        // timestamp seek restores, and get the keyframe's exact pts, found without scanning
+        if (entry.pos >= 0 && byte_seekable())
+        {
+            if (av_seek_frame(m_p_format_ctx.get(), -1, entry.pos, AVSEEK_FLAG_BYTE) >= 0)
+            {
+                return 0;
+            }
+        }
+        return avformat_seek_file(m_p_format_ctx.get(), m_video_stream_index, entry.pts, entry.pts, entry.pts, 0);
+    }
+};
@@ -0,0 +1,404 @@
+#pragma once
+
+extern "C"
+{
+#include "libavutil/error.h"
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LITEP_POSIX_IO 1
+#endif
+
+#include "./input_source.h"
+
+enum class IoMode
+{
+    Buffered,  // libavformat's own file protocol: read() into a 32 KiB buffer
+    Mmap,      // reads and seeks served from a mapping of the whole file
+    ReadAhead, // an I/O thread keeps several large blocks ahead of the demuxer
+};
+
+inline const char* io_mode_name(IoMode mode)
+{
+    switch (mode)
+    {
+    case IoMode::Mmap:
+        return "mmap";
+    case IoMode::ReadAhead:
+        return "readahead";
+    case IoMode::Buffered:
+    default:
+        return "buffered";
+    }
+}
+
+struct ReadAheadConfig
+{
+    size_t block_bytes = 4 << 20;
+    size_t blocks      = 8; // read ahead of the demuxer: blocks * block_bytes
+};
+
+#if defined(LITEP_POSIX_IO)
+
+// No read() per AVIO buffer: a read is a memcpy out of the page cache, a seek is free.
+// The kernel's own read-ahead follows the access pattern (MADV_SEQUENTIAL).
+class MmapSource final : public InputSource
+{
+private:
+    const uint8_t* m_data = nullptr;
+    int64_t        m_size = 0;
+    int64_t        m_pos  = 0;
+
+public:
+    explicit MmapSource(const char* path)
+    {
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::print(stderr, "[IO] could not open {}\n", path);
+            return;
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* map = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                ::madvise(map, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                m_data = static_cast<const uint8_t*>(map);
+                m_size = st.st_size;
+            }
+        }
+        ::close(fd); // the mapping keeps the file
+        if (m_data == nullptr)
+        {
+            std::print(stderr, "[IO] could not map {}\n", path);
+        }
+    }
+
+    ~MmapSource() override
+    {
+        if (m_data != nullptr)
+        {
+            ::munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+        }
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_data != nullptr;
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        const int64_t n = std::min<int64_t>(size, m_size - m_pos);
+        if (n <= 0)
+        {
+            return AVERROR_EOF;
+        }
+        std::memcpy(buf, m_data + m_pos, static_cast<size_t>(n));
+        m_pos += n;
+        return static_cast<int>(n);
+    }
+
+    int64_t seek(int64_t offset, int whence) override
+    {
+        const int64_t base = whence == SEEK_CUR ? m_pos : whence == SEEK_END ? m_size : 0;
+        if (base + offset < 0)
+        {
+            return AVERROR(EINVAL);
+        }
+        m_pos = base + offset;
+        return m_pos;
+    }
+
+    [[nodiscard]] int64_t size() const override
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] int buffer_size() const override
+    {
+        return 256 << 10;
+    }
+};
+
+// A dedicated I/O thread reads large blocks with pread() while the demux stage parses the
+// previous ones, so a slow disk or network mount is never waited on more than once per
+// block. The kernel is told the pattern (sequential, and the window about to be read).
+//
+//   I/O thread: m_fetch_pos -> pread -> m_blocks (at most config.blocks)
+//   demux:      m_blocks.front() -> read() -> recycled block buffer
+class ReadAheadSource final : public InputSource
+{
+private:
+    struct Block
+    {
+        int64_t              offset = 0;
+        size_t               size   = 0;
+        std::vector<uint8_t> data;
+    };
+
+    int                               m_fd   = -1;
+    int64_t                           m_size = 0;
+    ReadAheadConfig                   m_config;
+    mutable std::mutex                m_mutex;
+    std::condition_variable_any       m_cv;
+    std::deque<Block>                 m_blocks;        // contiguous, the first one holds m_pos
+    std::vector<std::vector<uint8_t>> m_spare;         // block buffers to reuse
+    int64_t                           m_pos       = 0;
+    int64_t                           m_fetch_pos = 0; // next offset for the I/O thread
+    uint64_t                          m_seeks     = 0; // blocks read before a seek are discarded
+    int                               m_error     = 0;
+    std::jthread                      m_thread;
+
+public:
+    explicit ReadAheadSource(const char* path, const ReadAheadConfig& config = {}) : m_config(config)
+    {
+        m_config.block_bytes = std::max<size_t>(m_config.block_bytes, 64 << 10);
+        m_config.blocks      = std::max<size_t>(m_config.blocks, 2);
+
+        m_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0)
+        {
+            std::print(stderr, "[IO] could not open {}\n", path);
+            return;
+        }
+        struct stat info {};
+        if (::fstat(m_fd, &info) != 0)
+        {
+            std::print(stderr, "[IO] could not stat {}\n", path);
+            ::close(m_fd);
+            m_fd = -1;
+            return;
+        }
+        m_size = info.st_size;
+#if defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL); // larger kernel read-ahead window
+#endif
+
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                fetch_loop(st);
+            });
+    }
+
+    ~ReadAheadSource() override
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop(); // wakes the condition variable wait
+            m_thread.join();
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_fd >= 0;
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock,
+                  [this]
+                  {
+                      return !m_blocks.empty() || m_fetch_pos >= m_size || m_error != 0;
+                  });
+        if (m_blocks.empty())
+        {
+            return m_error != 0 ? m_error : AVERROR_EOF;
+        }
+
+        Block&       block  = m_blocks.front();
+        const size_t offset = static_cast<size_t>(m_pos - block.offset);
+        const size_t n      = std::min(static_cast<size_t>(size), block.size - offset);
+        std::memcpy(buf, block.data.data() + offset, n);
+        m_pos += static_cast<int64_t>(n);
+        if (offset + n == block.size)
+        {
+            retire_front();
+            m_cv.notify_all(); // room for the next block
+        }
+        return static_cast<int>(n);
+    }
+
+    int64_t seek(int64_t offset, int whence) override
+    {
+        std::lock_guard lock(m_mutex);
+        const int64_t   base   = whence == SEEK_CUR ? m_pos : whence == SEEK_END ? m_size : 0;
+        const int64_t   target = base + offset;
+        if (target < 0)
+        {
+            return AVERROR(EINVAL);
+        }
+
+        // forward within what is already buffered (libavformat skips a lot of small gaps)
+        while (!m_blocks.empty() && target >= m_blocks.front().offset + static_cast<int64_t>(m_blocks.front().size))
+        {
+            retire_front();
+        }
+        if (!m_blocks.empty() && target >= m_blocks.front().offset)
+        {
+            m_pos = target;
+            m_cv.notify_all();
+            return target;
+        }
+
+        while (!m_blocks.empty())
+        {
+            retire_front();
+        }
+        ++m_seeks;
+        m_pos       = target;
+        m_fetch_pos = target;
+        m_error     = 0;
+        m_cv.notify_all();
+        return target;
+    }
+
+    [[nodiscard]] int64_t size() const override
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] int buffer_size() const override
+    {
+        return 256 << 10;
+    }
+
+private:
+    // caller holds m_mutex
+    void retire_front()
+    {
+        m_spare.push_back(std::move(m_blocks.front().data));
+        m_blocks.pop_front();
+    }
+
+    void fetch_loop(const std::stop_token& st)
+    {
+        std::unique_lock lock(m_mutex);
+        while (!st.stop_requested())
+        {
+            const bool waiting = m_cv.wait(lock,
+                                           st,
+                                           [this]
+                                           {
+                                               return m_blocks.size() < m_config.blocks && m_fetch_pos < m_size
+                                                   && m_error == 0;
+                                           });
+            if (!waiting)
+            {
+                return; // stop requested
+            }
+
+            const int64_t        offset = m_fetch_pos;
+            const uint64_t       seeks  = m_seeks;
+            std::vector<uint8_t> data;
+            if (!m_spare.empty())
+            {
+                data = std::move(m_spare.back());
+                m_spare.pop_back();
+            }
+            lock.unlock();
+
+            data.resize(m_config.block_bytes);
+#if defined(POSIX_FADV_WILLNEED)
+            // the window after this block, so the disk keeps streaming while we copy
+            ::posix_fadvise(m_fd,
+                            offset + static_cast<int64_t>(m_config.block_bytes),
+                            static_cast<off_t>(m_config.block_bytes * m_config.blocks),
+                            POSIX_FADV_WILLNEED);
+#endif
+            size_t got = 0;
+            int    err = 0;
+            while (got < data.size())
+            {
+                const ssize_t n
+                    = ::pread(m_fd, data.data() + got, data.size() - got, offset + static_cast<off_t>(got));
+                if (n > 0)
+                {
+                    got += static_cast<size_t>(n);
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                err = n < 0 ? AVERROR(errno) : 0;
+                break; // end of file or error
+            }
+
+            lock.lock();
+            if (seeks != m_seeks)
+            {
+                m_spare.push_back(std::move(data)); // read for a position the demuxer left
+                continue;
+            }
+            if (got == 0)
+            {
+                m_error     = err;
+                m_fetch_pos = err != 0 ? m_fetch_pos : m_size; // short file: stop at the real end
+                m_spare.push_back(std::move(data));
+            }
+            else
+            {
+                m_blocks.push_back(Block {.offset = offset, .size = got, .data = std::move(data)});
+                m_fetch_pos = offset + static_cast<int64_t>(got);
+            }
+            m_cv.notify_all();
+        }
+    }
+};
+
+#endif // LITEP_POSIX_IO
+
+// nullptr for IoMode::Buffered, or when the mode is not available / the file cannot be opened
+inline std::unique_ptr<InputSource> open_file_source(const char*            path,
+                                                     IoMode                 mode,
+                                                     const ReadAheadConfig& read_ahead = {})
+{
+#if defined(LITEP_POSIX_IO)
+    if (mode == IoMode::Mmap)
+    {
+        auto source = std::make_unique<MmapSource>(path);
+        return source->ok() ? std::move(source) : nullptr;
+    }
+    if (mode == IoMode::ReadAhead)
+    {
+        auto source = std::make_unique<ReadAheadSource>(path, read_ahead);
+        return source->ok() ? std::move(source) : nullptr;
+    }
+#else
+    if (mode != IoMode::Buffered)
+    {
+        std::print(stderr, "[IO] {} is not available on this platform\n", io_mode_name(mode));
+    }
+#endif
+    static_cast<void>(path);
+    static_cast<void>(read_ahead);
+    return nullptr;
+}
@@ -0,0 +1,401 @@
+#pragma once
+
+extern "C"
+{
+#include "libavformat/avio.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Bytes for the demuxer from somewhere other than libavformat's own protocols.
+// Called from the demux stage only (one thread at a time), through an AVIOContext.
+class InputSource
+{
+public:
+    InputSource() = default;
+
+    InputSource(const InputSource&)              = delete;
+    InputSource& operator=(const InputSource&)   = delete;
+    InputSource(InputSource&&)                   = delete;
+    InputSource& operator=(InputSource&&)        = delete;
+    auto         operator<=>(const InputSource&) = delete;
+
+    virtual ~InputSource() = default;
+
+    // bytes copied into buf, AVERROR_EOF at the end, another AVERROR on failure
+    virtual int read(uint8_t* buf, int size) = 0;
+
+    // SEEK_SET / SEEK_CUR / SEEK_END; the new position or an AVERROR
+    virtual int64_t seek(int64_t offset, int whence) = 0;
+
+    // total bytes, negative when unknown
+    [[nodiscard]] virtual int64_t size() const
+    {
+        return -1;
+    }
+
+    [[nodiscard]] virtual bool seekable() const
+    {
+        return true;
+    }
+
+    // size of the AVIOContext buffer, i.e. how much libavformat asks for per read()
+    [[nodiscard]] virtual int buffer_size() const
+    {
+        return 64 << 10;
+    }
+
+    // Any thread: a read() waiting for data returns an error now, and so does every later one.
+    // Lets the demux stage be stopped while its source has nothing to give.
+    virtual void interrupt()
+    {
+    }
+};
+
+struct avio_context_deleter
+{
+    void operator()(AVIOContext* p) const noexcept
+    {
+        if (p != nullptr)
+        {
+            av_freep(&p->buffer); // may have been reallocated by libavformat
+            avio_context_free(&p);
+        }
+    }
+};
+
+using ptr_avio_t = std::unique_ptr<AVIOContext, avio_context_deleter>;
+
+// AVIOContext reading from `source`, which must outlive it. nullptr on allocation failure.
+inline ptr_avio_t make_avio(InputSource& source)
+{
+    auto read = [](void* opaque, uint8_t* buf, int size) -> int
+    {
+        return static_cast<InputSource*>(opaque)->read(buf, size);
+    };
+    auto seek = [](void* opaque, int64_t offset, int whence) -> int64_t
+    {
+        auto* self = static_cast<InputSource*>(opaque);
+        if ((whence & AVSEEK_SIZE) != 0)
+        {
+            const int64_t size = self->size();
+            return size >= 0 ? size : AVERROR(ENOSYS);
+        }
+        return self->seek(offset, whence & ~AVSEEK_FORCE);
+    };
+
+    const int size   = source.buffer_size();
+    auto*     buffer = static_cast<unsigned char*>(av_malloc(static_cast<size_t>(size)));
+    if (buffer == nullptr)
+    {
+        return nullptr;
+    }
+    AVIOContext* ctx
+        = avio_alloc_context(buffer, size, 0, &source, +read, nullptr, source.seekable() ? +seek : nullptr);
+    if (ctx == nullptr)
+    {
+        av_free(buffer);
+        return nullptr;
+    }
+    return ptr_avio_t {ctx};
+}
+
+// A buffer already in memory (a downloaded segment, a test clip). Seekable; a read is a
+// single copy straight into libavformat's buffer. `owner` keeps the bytes alive if the
+// caller does not.
+class MemorySource final : public InputSource
+{
+private:
+    std::shared_ptr<const void> m_owner;
+    std::span<const uint8_t>    m_data;
+    int64_t                     m_pos = 0;
+
+public:
+    explicit MemorySource(std::span<const uint8_t> data, std::shared_ptr<const void> owner = nullptr)
+        : m_owner(std::move(owner)), m_data(data)
+    {
+    }
+
+    explicit MemorySource(std::vector<uint8_t> data)
+    {
+        auto owned = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        m_data     = std::span<const uint8_t>(*owned);
+        m_owner    = std::move(owned);
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        const int64_t n = std::min<int64_t>(size, static_cast<int64_t>(m_data.size()) - m_pos);
+        if (n <= 0)
+        {
+            return AVERROR_EOF;
+        }
+        std::memcpy(buf, m_data.data() + m_pos, static_cast<size_t>(n));
+        m_pos += n;
+        return static_cast<int>(n);
+    }
+
+    int64_t seek(int64_t offset, int whence) override
+    {
+        const auto    end  = static_cast<int64_t>(m_data.size());
+        const int64_t base = whence == SEEK_CUR ? m_pos : whence == SEEK_END ? end : 0;
+        if (base + offset < 0)
+        {
+            return AVERROR(EINVAL);
+        }
+        m_pos = base + offset;
+        return m_pos;
+    }
+
+    [[nodiscard]] int64_t size() const override
+    {
+        return static_cast<int64_t>(m_data.size());
+    }
+};
+
+// Bytes pushed by the caller in chunks of any size, e.g. from a network callback.
+// Chunks are moved in, not copied, and at most `max_bytes` are held: push() blocks while
+// the demuxer is that far behind. Not seekable, so the container must be streamable (TS, MKV, fMP4).
+class ChunkSource final : public InputSource
+{
+private:
+    mutable std::mutex               m_mutex;
+    std::condition_variable          m_cv;
+    std::deque<std::vector<uint8_t>> m_chunks;
+    size_t                           m_offset      = 0; // consumed bytes of m_chunks.front()
+    size_t                           m_bytes       = 0; // unread bytes in m_chunks
+    size_t                           m_max_bytes   = 0;
+    bool                             m_closed      = false;
+    bool                             m_interrupted = false;
+
+public:
+    explicit ChunkSource(size_t max_bytes = 8 << 20) : m_max_bytes(std::max<size_t>(max_bytes, 1))
+    {
+    }
+
+    // Producer. Blocks while the buffer is full; a chunk larger than max_bytes is taken
+    // once the buffer is empty. false when the reader is gone (interrupted) or after close().
+    bool push(std::vector<uint8_t> chunk)
+    {
+        if (chunk.empty())
+        {
+            return true;
+        }
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock,
+                  [&]
+                  {
+                      return m_interrupted || m_closed || m_bytes == 0 || m_bytes + chunk.size() <= m_max_bytes;
+                  });
+        if (m_interrupted || m_closed)
+        {
+            return false;
+        }
+        m_bytes += chunk.size();
+        m_chunks.push_back(std::move(chunk));
+        m_cv.notify_all();
+        return true;
+    }
+
+    // Producer: end of stream. What is buffered is still read.
+    void close()
+    {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_cv.notify_all();
+    }
+
+    void interrupt() override
+    {
+        std::lock_guard lock(m_mutex);
+        m_interrupted = true;
+        m_cv.notify_all();
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock,
+                  [this]
+                  {
+                      return m_interrupted || m_closed || m_bytes > 0;
+                  });
+        if (m_interrupted)
+        {
+            return AVERROR_EXIT;
+        }
+        if (m_bytes == 0)
+        {
+            return AVERROR_EOF; // closed and drained
+        }
+
+        // one chunk at a time: libavformat asks again for the rest
+        const std::vector<uint8_t>& chunk = m_chunks.front();
+        const size_t                n     = std::min(static_cast<size_t>(size), chunk.size() - m_offset);
+        std::memcpy(buf, chunk.data() + m_offset, n);
+        m_offset += n;
+        m_bytes -= n;
+        if (m_offset == chunk.size())
+        {
+            m_chunks.pop_front();
+            m_offset = 0;
+            m_cv.notify_all(); // room for the producer
+        }
+        return static_cast<int>(n);
+    }
+
+    int64_t seek(int64_t /*offset*/, int /*whence*/) override
+    {
+        return AVERROR(ESPIPE);
+    }
+
+    [[nodiscard]] bool seekable() const override
+    {
+        return false;
+    }
+
+    // unread bytes, for the producer's own flow control
+    [[nodiscard]] size_t buffered() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_bytes;
+    }
+};
+
+// Pull-style: libavformat's reads go straight to the caller, who fills the buffer in place.
+using source_read_t = std::function<int(uint8_t* buf, int size)>;        // bytes, 0 at the end, < 0 error
+using source_seek_t = std::function<int64_t(int64_t offset, int whence)>; // new position, < 0 error
+
+class CallbackSource final : public InputSource
+{
+private:
+    source_read_t m_read;
+    source_seek_t m_seek; // empty: not seekable
+    int64_t       m_size;
+
+public:
+    explicit CallbackSource(source_read_t read, source_seek_t seek = {}, int64_t size = -1)
+        : m_read(std::move(read)), m_seek(std::move(seek)), m_size(size)
+    {
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        const int n = m_read(buf, size);
+        if (n == 0)
+        {
+            return AVERROR_EOF;
+        }
+        return n < 0 ? AVERROR(EIO) : std::min(n, size);
+    }
+
+    int64_t seek(int64_t offset, int whence) override
+    {
+        if (!m_seek)
+        {
+            return AVERROR(ESPIPE);
+        }
+        const int64_t pos = m_seek(offset, whence);
+        return pos < 0 ? AVERROR(EIO) : pos;
+    }
+
+    [[nodiscard]] int64_t size() const override
+    {
+        return m_size;
+    }
+
+    [[nodiscard]] bool seekable() const override
+    {
+        return static_cast<bool>(m_seek);
+    }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// A pipe or stdin ("-" as the input path). read(2) goes straight into libavformat's
+// buffer; the pipe itself is the bounded buffer, and a full pipe blocks the writer.
+class PipeSource final : public InputSource
+{
+private:
+    int              m_fd;
+    bool             m_owns_fd;
+    std::atomic_bool m_interrupted_o {false};
+
+public:
+    explicit PipeSource(int fd, bool owns_fd = false) : m_fd(fd), m_owns_fd(owns_fd)
+    {
+    }
+
+    ~PipeSource() override
+    {
+        if (m_owns_fd && m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    int read(uint8_t* buf, int size) override
+    {
+        for (;;)
+        {
+            if (m_interrupted_o.load(std::memory_order_acquire))
+            {
+                return AVERROR_EXIT;
+            }
+            // poll with a timeout, so interrupt() is seen while the writer is quiet
+            pollfd pfd {.fd = m_fd, .events = POLLIN, .revents = 0};
+            const int ready = ::poll(&pfd, 1, 100);
+            if (ready == 0 || (ready < 0 && errno == EINTR))
+            {
+                continue;
+            }
+            const ssize_t n = ::read(m_fd, buf, static_cast<size_t>(size));
+            if (n > 0)
+            {
+                return static_cast<int>(n);
+            }
+            if (n == 0)
+            {
+                return AVERROR_EOF;
+            }
+            if (errno != EINTR && errno != EAGAIN)
+            {
+                return AVERROR(errno);
+            }
+        }
+    }
+
+    int64_t seek(int64_t /*offset*/, int /*whence*/) override
+    {
+        return AVERROR(ESPIPE);
+    }
+
+    [[nodiscard]] bool seekable() const override
+    {
+        return false;
+    }
+
+    void interrupt() override
+    {
+        m_interrupted_o.store(true, std::memory_order_release);
+    }
+};
+#endif
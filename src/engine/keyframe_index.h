@@ -0,0 +1,408 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+#include "libavformat/avformat.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../utils/alias.h"
+#include "../utils/ffmpeg_deleter.h"
+
+struct KeyframeEntry
+{
+    int64_t pts = AV_NOPTS_VALUE; // video stream time base
+    int64_t pos = -1;             // byte offset of the packet, -1 when the demuxer does not know
+};
+
+// Sorted keyframe table of the video stream.
+class KeyframeIndex
+{
+private:
+    static constexpr char     k_magic[4] = {'L', 'P', 'K', 'I'};
+    static constexpr uint32_t k_version  = 1;
+
+    std::vector<KeyframeEntry> m_entries;
+    AVRational                 m_time_base {0, 1};
+    int                        m_stream_index = -1;
+
+public:
+    KeyframeIndex() = default;
+
+    KeyframeIndex(std::vector<KeyframeEntry> entries, AVRational time_base, int stream_index)
+        : m_entries(std::move(entries)), m_time_base(time_base), m_stream_index(stream_index)
+    {
+        std::sort(m_entries.begin(),
+                  m_entries.end(),
+                  [](const KeyframeEntry& a, const KeyframeEntry& b)
+                  {
+                      return a.pts < b.pts;
+                  });
+        m_entries.erase(std::unique(m_entries.begin(),
+                                    m_entries.end(),
+                                    [](const KeyframeEntry& a, const KeyframeEntry& b)
+                                    {
+                                        return a.pts == b.pts;
+                                    }),
+                        m_entries.end());
+    }
+
+    // Last keyframe at or before `pts` (binary search); the first one when pts precedes them all.
+    [[nodiscard]] std::optional<KeyframeEntry> lookup(int64_t pts) const
+    {
+        if (m_entries.empty())
+        {
+            return std::nullopt;
+        }
+        auto it = std::upper_bound(m_entries.begin(),
+                                   m_entries.end(),
+                                   pts,
+                                   [](int64_t value, const KeyframeEntry& e)
+                                   {
+                                       return value < e.pts;
+                                   });
+        return it == m_entries.begin() ? m_entries.front() : *std::prev(it);
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_entries.empty();
+    }
+
+    [[nodiscard]] AVRational time_base() const
+    {
+        return m_time_base;
+    }
+
+    [[nodiscard]] int stream_index() const
+    {
+        return m_stream_index;
+    }
+
+    // Sidecar layout (little-endian): magic, version, media size, media mtime, stream index,
+    // time base, entry count, then (pts, pos) pairs. 16 bytes per keyframe.
+    bool save(const std::string& sidecar, const std::string& media) const
+    {
+        const auto stamp = media_stamp(media);
+        if (!stamp)
+        {
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(sidecar).parent_path(), ec);
+        std::ofstream out(sidecar, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            return false;
+        }
+
+        out.write(k_magic, sizeof(k_magic));
+        put(out, k_version);
+        put(out, stamp->first);
+        put(out, stamp->second);
+        put(out, static_cast<int32_t>(m_stream_index));
+        put(out, static_cast<int32_t>(m_time_base.num));
+        put(out, static_cast<int32_t>(m_time_base.den));
+        put(out, static_cast<uint64_t>(m_entries.size()));
+        for (const KeyframeEntry& e : m_entries)
+        {
+            put(out, e.pts);
+            put(out, e.pos);
+        }
+        return out.good();
+    }
+
+    // nullopt when missing, malformed, or written for another version of the media file
+    static std::optional<KeyframeIndex> load(const std::string& sidecar, const std::string& media)
+    {
+        const auto stamp = media_stamp(media);
+        if (!stamp)
+        {
+            return std::nullopt;
+        }
+
+        std::ifstream in(sidecar, std::ios::binary);
+        if (!in.is_open())
+        {
+            return std::nullopt;
+        }
+
+        char     magic[4] {};
+        uint32_t version = 0;
+        int64_t  size = 0, mtime = 0;
+        int32_t  stream = -1, num = 0, den = 0;
+        uint64_t count = 0;
+        in.read(magic, sizeof(magic));
+        if (!in || !std::equal(magic, magic + 4, k_magic) || !get(in, version) || version != k_version)
+        {
+            return std::nullopt;
+        }
+        if (!get(in, size) || !get(in, mtime) || size != stamp->first || mtime != stamp->second)
+        {
+            return std::nullopt; // media changed since the index was written
+        }
+        if (!get(in, stream) || !get(in, num) || !get(in, den) || !get(in, count) || den <= 0)
+        {
+            return std::nullopt;
+        }
+
+        // no more entries than the file can hold
+        constexpr uint64_t header = 4 + 4 + 8 + 8 + 4 * 3 + 8;
+        std::error_code    ec;
+        const auto         bytes = std::filesystem::file_size(sidecar, ec);
+        if (ec || bytes < header || count > (bytes - header) / 16)
+        {
+            return std::nullopt;
+        }
+
+        std::vector<KeyframeEntry> entries(count);
+        for (KeyframeEntry& e : entries)
+        {
+            if (!get(in, e.pts) || !get(in, e.pos))
+            {
+                return std::nullopt;
+            }
+        }
+        return KeyframeIndex(std::move(entries), AVRational {num, den}, stream);
+    }
+
+    // In the user's cache directory, named after the media's absolute path, so read-only media
+    // directories work and nothing is left next to the files; next to the media without one.
+    static std::string sidecar_path(const std::string& media)
+    {
+        const std::filesystem::path dir = cache_dir();
+        if (dir.empty())
+        {
+            return media + ".kfidx";
+        }
+        std::error_code             ec;
+        const std::filesystem::path absolute = std::filesystem::absolute(media, ec);
+        const std::string           key      = ec ? media : absolute.lexically_normal().string();
+        const std::string           stem     = std::filesystem::path(media).stem().string();
+        return (dir / std::format("{}-{:016x}.kfidx", stem, std::hash<std::string> {}(key))).string();
+    }
+
+    // $XDG_CACHE_HOME/litePlayer (~/.cache, ~/Library/Caches on macOS, %LOCALAPPDATA% on Windows);
+    // empty when the environment names no home
+    static std::filesystem::path cache_dir()
+    {
+        std::filesystem::path base;
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+        {
+            base = xdg;
+        }
+#if defined(_WIN32)
+        else if (const char* local = std::getenv("LOCALAPPDATA"); local != nullptr && *local != '\0')
+        {
+            base = local;
+        }
+#else
+        else if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        {
+#if defined(__APPLE__)
+            base = std::filesystem::path(home) / "Library" / "Caches";
+#else
+            base = std::filesystem::path(home) / ".cache";
+#endif
+        }
+#endif
+        return base.empty() ? base : base / "litePlayer";
+    }
+
+private:
+    // size and mtime of a local file; URLs and pipes have none and are never persisted
+    static std::optional<std::pair<int64_t, int64_t>> media_stamp(const std::string& media)
+    {
+        std::error_code ec;
+        const auto      size = std::filesystem::file_size(media, ec);
+        if (ec)
+        {
+            return std::nullopt;
+        }
+        const auto mtime = std::filesystem::last_write_time(media, ec);
+        if (ec)
+        {
+            return std::nullopt;
+        }
+        return std::pair {static_cast<int64_t>(size), static_cast<int64_t>(mtime.time_since_epoch().count())};
+    }
+
+    template <typename V>
+    static void put(std::ofstream& out, V value)
+    {
+        char bytes[sizeof(V)];
+        for (size_t i = 0; i < sizeof(V); ++i)
+        {
+            bytes[i] = static_cast<char>(static_cast<uint64_t>(value) >> (8 * i));
+        }
+        out.write(bytes, sizeof(V));
+    }
+
+    template <typename V>
+    static bool get(std::ifstream& in, V& value)
+    {
+        unsigned char bytes[sizeof(V)];
+        if (!in.read(reinterpret_cast<char*>(bytes), sizeof(V)))
+        {
+            return false;
+        }
+        uint64_t v = 0;
+        for (size_t i = 0; i < sizeof(V); ++i)
+        {
+            v |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        }
+        value = static_cast<V>(v);
+        return true;
+    }
+};
+
+// Builds a KeyframeIndex off the playback path: loads the sidecar (KeyframeIndex::sidecar_path)
+// if it is current, otherwise scans the file with its own format context (packets only, other
+// streams discarded, nothing decoded) and writes the sidecar for next time.
+class KeyframeIndexer
+{
+private:
+    std::string      m_path;
+    KeyframeIndex    m_index;
+    std::jthread     m_thread;
+    std::atomic_bool m_ready_o {false};
+    bool             m_persist = true;
+
+public:
+    explicit KeyframeIndexer(std::string path, bool persist = true)
+        : m_path(std::move(path)), m_persist(persist)
+    {
+    }
+
+    KeyframeIndexer(const KeyframeIndexer&)              = delete;
+    KeyframeIndexer& operator=(const KeyframeIndexer&)   = delete;
+    KeyframeIndexer(KeyframeIndexer&&)                   = delete;
+    KeyframeIndexer& operator=(KeyframeIndexer&&)        = delete;
+    auto             operator<=>(const KeyframeIndexer&) = delete;
+
+    ~KeyframeIndexer()
+    {
+        stop();
+    }
+
+    void run()
+    {
+        if (m_thread.joinable() || ready())
+        {
+            return;
+        }
+
+        // a current sidecar makes reopening instant
+        if (auto loaded = KeyframeIndex::load(KeyframeIndex::sidecar_path(m_path), m_path))
+        {
+            m_index = std::move(*loaded);
+            m_ready_o.store(true, std::memory_order_release);
+            return;
+        }
+
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                task(st);
+            });
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_thread.join();
+        }
+    }
+
+    // The index may only be read once this returns true; it never changes afterwards.
+    [[nodiscard]] bool ready() const
+    {
+        return m_ready_o.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] const KeyframeIndex* index() const
+    {
+        return ready() ? &m_index : nullptr;
+    }
+
+private:
+    void task(const std::stop_token& st)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        AVFormatContext* raw = nullptr;
+        if (avformat_open_input(&raw, m_path.c_str(), nullptr, nullptr) < 0)
+        {
+            std::print(stderr, "[Index] could not open {}\n", m_path);
+            return;
+        }
+        ptr_format_ctx_t ctx {raw};
+        if (avformat_find_stream_info(ctx.get(), nullptr) < 0)
+        {
+            return;
+        }
+
+        const int video = av_find_best_stream(ctx.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (video < 0)
+        {
+            return;
+        }
+        for (unsigned i = 0; i < ctx->nb_streams; ++i)
+        {
+            ctx->streams[i]->discard = static_cast<int>(i) == video ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+
+        std::vector<KeyframeEntry> entries;
+        ptr_packet_t               pkt {av_packet_alloc()};
+        while (st.stop_requested() == false && av_read_frame(ctx.get(), pkt.get()) >= 0)
+        {
+            if (pkt->stream_index == video && (pkt->flags & AV_PKT_FLAG_KEY) != 0)
+            {
+                const int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                if (pts != AV_NOPTS_VALUE)
+                {
+                    entries.push_back(KeyframeEntry {.pts = pts, .pos = pkt->pos});
+                }
+            }
+            av_packet_unref(pkt.get());
+        }
+        if (st.stop_requested())
+        {
+            return; // partial: neither published nor persisted
+        }
+
+        m_index = KeyframeIndex(std::move(entries), ctx->streams[video]->time_base, video);
+        m_ready_o.store(true, std::memory_order_release);
+
+        const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::print("[Index] {} keyframes in {:.0f} ms\n", m_index.size(), ms);
+
+        if (m_persist && !m_index.save(KeyframeIndex::sidecar_path(m_path), m_path))
+        {
+            std::print(stderr, "[Index] could not write sidecar for {}\n", m_path);
+        }
+    }
+};
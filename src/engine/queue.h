@@ -3,6 +3,7 @@
 #include <concepts>
 #include <cstddef>
 #include <optional>
+#include <stdexcept>
 #include <vector>
 
 template <typename T>
@@ -50,9 +51,10 @@ public:
         return (tail - head) & m_mask;
     }
 
-    void set_item(size_t index, T&& item)
+    template <typename Y>
+    void set_item(size_t index, Y&& item)
     {
-        m_data[index] = std::move(item);
+        m_data[index] = std::forward<Y>(item);
     }
 
     T move_item(size_t index)
@@ -220,19 +222,576 @@ public:
 };
 
 //
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#include "../utils/trace.h"
+
+using queue_clock_t    = std::chrono::steady_clock;
+using queue_deadline_t = queue_clock_t::time_point;
+
+inline constexpr queue_deadline_t queue_no_deadline = queue_deadline_t::max();
+
+inline void cpu_relax()
+{
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Wait strategies share one protocol:
+//   ticket = prepare();  re-check the queue;  wait(ticket, deadline);
+// and the other side calls notify() after it changed the queue. wait() returns
+// false once the deadline has passed, true when the caller should re-check.
+
+// Spin briefly, then give up the time slice. Lowest latency, never sleeps.
+class SpinYieldWait
+{
+private:
+    static constexpr int k_spin_count = 64;
+
+public:
+    [[nodiscard]] uint32_t prepare() const
+    {
+        return 0;
+    }
+
+    bool wait(uint32_t /*ticket*/, queue_deadline_t deadline)
+    {
+        for (int i = 0; i < k_spin_count; ++i)
+        {
+            cpu_relax();
+        }
+        std::this_thread::yield();
+        return deadline == queue_no_deadline || queue_clock_t::now() < deadline;
+    }
+
+    void notify()
+    {
+    }
+};
+
+// Spin briefly, then park the thread on the epoch word (futex on Linux).
+// atomic::wait has no timeout, so bounded waits poll in short sleeps instead.
+class ParkingWait
+{
+private:
+    static constexpr int k_spin_count = 128;
+    static constexpr auto k_poll_step = std::chrono::microseconds(500);
+
+    std::atomic<uint32_t> m_epoch_o {0};
+    std::atomic<uint32_t> m_waiters_o {0};
+
+public:
+    [[nodiscard]] uint32_t prepare() const
+    {
+        return m_epoch_o.load(std::memory_order_seq_cst);
+    }
+
+    bool wait(uint32_t ticket, queue_deadline_t deadline)
+    {
+        for (int i = 0; i < k_spin_count; ++i)
+        {
+            if (m_epoch_o.load(std::memory_order_relaxed) != ticket)
+            {
+                return true;
+            }
+            cpu_relax();
+        }
+
+        if (deadline != queue_no_deadline)
+        {
+            const auto now = queue_clock_t::now();
+            if (now >= deadline)
+            {
+                return false;
+            }
+            const queue_clock_t::duration remaining = deadline - now;
+            std::this_thread::sleep_for(std::min<queue_clock_t::duration>(remaining, k_poll_step));
+            return true;
+        }
+
+        m_waiters_o.fetch_add(1, std::memory_order_seq_cst);
+        m_epoch_o.wait(ticket, std::memory_order_seq_cst);
+        m_waiters_o.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void notify()
+    {
+        m_epoch_o.fetch_add(1, std::memory_order_seq_cst);
+        if (m_waiters_o.load(std::memory_order_seq_cst) != 0)
+        {
+            m_epoch_o.notify_all();
+        }
+    }
+};
+
+// Spin briefly, then block on a condition variable until notified or the deadline.
+class TimedWait
+{
+private:
+    static constexpr int k_spin_count = 128;
+
+    std::mutex              m_mtx;
+    std::condition_variable m_cond;
+    std::atomic<uint32_t>   m_epoch_o {0};
+    std::atomic<uint32_t>   m_waiters_o {0};
+
+public:
+    [[nodiscard]] uint32_t prepare() const
+    {
+        return m_epoch_o.load(std::memory_order_seq_cst);
+    }
+
+    bool wait(uint32_t ticket, queue_deadline_t deadline)
+    {
+        for (int i = 0; i < k_spin_count; ++i)
+        {
+            if (m_epoch_o.load(std::memory_order_relaxed) != ticket)
+            {
+                return true;
+            }
+            cpu_relax();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_waiters_o.fetch_add(1, std::memory_order_seq_cst);
+
+        auto changed = [&]
+        {
+            return m_epoch_o.load(std::memory_order_seq_cst) != ticket;
+        };
+
+        bool woken = true;
+        if (deadline == queue_no_deadline)
+        {
+            m_cond.wait(lock, changed);
+        }
+        else
+        {
+            woken = m_cond.wait_until(lock, deadline, changed);
+        }
+
+        m_waiters_o.fetch_sub(1, std::memory_order_relaxed);
+        return woken;
+    }
+
+    void notify()
+    {
+        m_epoch_o.fetch_add(1, std::memory_order_seq_cst);
+        if (m_waiters_o.load(std::memory_order_seq_cst) != 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+            }
+            m_cond.notify_all();
+        }
+    }
+};
 
+enum class QueuePolicy
+{
+    SPSC, // one producer, one consumer: wait-free, cached indices
+    MPSC, // sequence-numbered slots, single consumer
+    MPMC, // sequence-numbered slots (Vyukov)
+};
+
+// Single-producer/single-consumer ring.
+// The slot is written before the tail is published (release), and the consumer only
+// touches a slot after observing that tail (acquire), so an unwritten slot is never read.
+// Each side caches the other side's index and only reloads it when the cache says full/empty.
 template <typename T>
-class QueueAtomic
+class SpscRing
 {
 private:
     RingBuffer<T> m_data;
-    alignas(64) std::atomic<size_t> m_head_o {0};
+
+    // producer side
     alignas(64) std::atomic<size_t> m_tail_o {0};
+    size_t m_head_cache = 0;
+
+    // consumer side
+    alignas(64) std::atomic<size_t> m_head_o {0};
+    size_t m_tail_cache = 0;
+
+public:
+    explicit SpscRing(size_t size) : m_data(size)
+    {
+    }
+
+    template <typename Y>
+    bool try_push(Y&& item)
+    {
+        const size_t tail = m_tail_o.load(std::memory_order_relaxed);
+        const size_t next = m_data.next_index(tail);
+        if (next == m_head_cache)
+        {
+            m_head_cache = m_head_o.load(std::memory_order_acquire);
+            if (next == m_head_cache)
+            {
+                return false;
+            }
+        }
+
+        m_data.set_item(tail, std::forward<Y>(item));
+        m_tail_o.store(next, std::memory_order_release);
+        return true;
+    }
+
+    size_t try_push_batch(std::vector<T>& items)
+    {
+        size_t tail  = m_tail_o.load(std::memory_order_relaxed);
+        size_t count = 0;
+        for (auto& item : items)
+        {
+            const size_t next = m_data.next_index(tail);
+            if (next == m_head_cache)
+            {
+                m_head_cache = m_head_o.load(std::memory_order_acquire);
+                if (next == m_head_cache)
+                {
+                    break;
+                }
+            }
+
+            m_data.set_item(tail, std::move(item));
+            tail = next;
+            ++count;
+        }
+
+        if (count > 0)
+        {
+            m_tail_o.store(tail, std::memory_order_release);
+        }
+        return count;
+    }
+
+    std::optional<T> try_pop()
+    {
+        const size_t head = m_head_o.load(std::memory_order_relaxed);
+        if (head == m_tail_cache)
+        {
+            m_tail_cache = m_tail_o.load(std::memory_order_acquire);
+            if (head == m_tail_cache)
+            {
+                return std::nullopt;
+            }
+        }
+
+        T item = m_data.move_item(head);
+        m_head_o.store(m_data.next_index(head), std::memory_order_release);
+        return item;
+    }
+
+    size_t try_pop_batch(std::vector<T>& out_items, size_t max_count)
+    {
+        size_t head = m_head_o.load(std::memory_order_relaxed);
+        m_tail_cache = m_tail_o.load(std::memory_order_acquire);
+
+        size_t count = 0;
+        while (head != m_tail_cache && count < max_count)
+        {
+            out_items.push_back(m_data.move_item(head));
+            head = m_data.next_index(head);
+            ++count;
+        }
+
+        if (count > 0)
+        {
+            m_head_o.store(head, std::memory_order_release);
+        }
+        return count;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        const size_t head = m_head_o.load(std::memory_order_acquire);
+        const size_t tail = m_tail_o.load(std::memory_order_acquire);
+        return m_data.calc_size(head, tail);
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_data.get_size();
+    }
+};
+
+// Bounded multi-producer ring with a sequence number per slot (Vyukov).
+// A slot's sequence tells both sides whose turn it is, so claiming an index and
+// publishing the data are separate steps and readers wait for the publish, not the claim.
+template <typename T, bool multi_consumer>
+class SequencedRing
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    const size_t            m_mask;
+
+    alignas(64) std::atomic<size_t> m_enqueue_o {0};
+    alignas(64) std::atomic<size_t> m_dequeue_o {0};
+
+public:
+    explicit SequencedRing(size_t size) : m_cells(new Cell[size]), m_mask(size - 1)
+    {
+        if ((size & m_mask) != 0)
+        {
+            throw std::invalid_argument("Size must be power of 2");
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename Y>
+    bool try_push(Y&& item)
+    {
+        size_t pos = m_enqueue_o.load(std::memory_order_relaxed);
+        Cell*  cell;
+
+        for (;;)
+        {
+            cell                = &m_cells[pos & m_mask];
+            const size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueue_o.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = m_enqueue_o.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::forward<Y>(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t try_push_batch(std::vector<T>& items)
+    {
+        size_t count = 0;
+        for (auto& item : items)
+        {
+            if (!try_push(std::move(item)))
+            {
+                break;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    std::optional<T> try_pop()
+    {
+        size_t pos = m_dequeue_o.load(std::memory_order_relaxed);
+        Cell*  cell;
+
+        for (;;)
+        {
+            cell                = &m_cells[pos & m_mask];
+            const size_t   seq  = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0)
+            {
+                if constexpr (multi_consumer)
+                {
+                    if (m_dequeue_o.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else
+                {
+                    m_dequeue_o.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return std::nullopt; // empty, or the claimed slot is not published yet
+            }
+            else
+            {
+                pos = m_dequeue_o.load(std::memory_order_relaxed);
+            }
+        }
+
+        T item = std::move(cell->data);
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return item;
+    }
+
+    size_t try_pop_batch(std::vector<T>& out_items, size_t max_count)
+    {
+        size_t count = 0;
+        while (count < max_count)
+        {
+            auto item = try_pop();
+            if (item == std::nullopt)
+            {
+                break;
+            }
+            out_items.push_back(std::move(*item));
+            ++count;
+        }
+        return count;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        const size_t head = m_dequeue_o.load(std::memory_order_acquire);
+        const size_t tail = m_enqueue_o.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+};
+
+// Optional media budget on top of the slot count. A producer is held back while
+// admitting its item would exceed either limit; an empty queue always admits one item.
+struct QueueBudget
+{
+    int64_t max_bytes       = 0; // 0: unlimited
+    int64_t max_duration_us = 0; // 0: unlimited
+};
+
+struct QueueCost
+{
+    int64_t bytes       = 0;
+    int64_t duration_us = 0;
+};
+
+// Cost of one item for budgeted queues; specialised for packets/frames in queue_cost.h.
+template <typename T>
+struct queue_item_cost
+{
+    static QueueCost measure(const T& /*item*/)
+    {
+        return {};
+    }
+};
+
+// Wakes a cooperative stage (see stage.h) that found a queue full or empty and returned
+// instead of blocking. Called from whichever thread pushed/popped, so wake() must be cheap.
+struct QueueWaker
+{
+    virtual void wake() noexcept = 0;
+
+protected:
+    ~QueueWaker() = default;
+};
+
+// Where a waker is registered. Calls come from any thread; set() returns only once no call
+// into the previous waker is still in progress, so its owner may free it right afterwards.
+class WakerSlot
+{
+private:
+    std::atomic<QueueWaker*> m_waker_o {nullptr};
+    std::atomic<uint32_t>    m_calls_o {0};
+
+public:
+    WakerSlot() = default;
+
+    WakerSlot(const WakerSlot&)              = delete;
+    WakerSlot& operator=(const WakerSlot&)   = delete;
+    WakerSlot(WakerSlot&&)                   = delete;
+    WakerSlot& operator=(WakerSlot&&)        = delete;
+    auto       operator<=>(const WakerSlot&) = delete;
+
+    ~WakerSlot() = default;
+
+    void set(QueueWaker* waker)
+    {
+        // seq_cst pairs with wake(): either it sees the new waker, or this sees its call
+        m_waker_o.store(waker, std::memory_order_seq_cst);
+        while (m_calls_o.load(std::memory_order_seq_cst) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void wake() noexcept
+    {
+        if (m_waker_o.load(std::memory_order_acquire) == nullptr)
+        {
+            return; // nothing registered: queues without a stage pay no more than this
+        }
+        m_calls_o.fetch_add(1, std::memory_order_seq_cst);
+        if (QueueWaker* waker = m_waker_o.load(std::memory_order_seq_cst))
+        {
+            waker->wake();
+        }
+        m_calls_o.fetch_sub(1, std::memory_order_release);
+    }
+
+    [[nodiscard]] bool registered() const
+    {
+        return m_waker_o.load(std::memory_order_relaxed) != nullptr;
+    }
+};
+
+// push()/pop() block according to the wait strategy and only fail once the queue is
+// closed (pop still drains what is left). try_* never block; *_until give up at the deadline.
+template <typename T, QueuePolicy P = QueuePolicy::SPSC, typename Wait = ParkingWait>
+class QueueAtomic
+{
+private:
+    using ring_t = std::conditional_t<P == QueuePolicy::SPSC,
+                                      SpscRing<T>,
+                                      SequencedRing<T, P == QueuePolicy::MPMC>>;
+
+    ring_t            m_data;
+    const QueueBudget m_budget;
+    const bool        m_budgeted;
     alignas(64) std::atomic<bool> m_is_running_o {true};
+    alignas(64) std::atomic<int64_t> m_bytes_o {0};
+    std::atomic<int64_t> m_duration_o {0};
+    alignas(64) Wait m_not_empty;
+    std::atomic<uint64_t> m_empty_waits_o {0}; // pops that had to block (consumer starved)
+    alignas(64) Wait m_not_full;
+    std::atomic<uint64_t> m_full_waits_o {0}; // pushes that had to block (producer throttled)
+    WakerSlot             m_consumer_waker; // woken by pushes and close()
+    WakerSlot             m_producer_waker; // woken by pops and close()
 
 public:
-    explicit QueueAtomic(size_t size = 128) : m_data(size)
+    static constexpr QueuePolicy policy = P;
+
+    explicit QueueAtomic(size_t size = 128, QueueBudget budget = {})
+        : m_data(size)
+        , m_budget(budget)
+        , m_budgeted(budget.max_bytes > 0 || budget.max_duration_us > 0)
     {
     }
 
@@ -251,137 +810,336 @@ public:
         requires std::constructible_from<T, Y&&>
     bool push(Y&& item)
     {
-        size_t tail;
-        size_t next;
+        return push_until(std::forward<Y>(item), queue_no_deadline);
+    }
+
+    template <typename Y>
+        requires std::constructible_from<T, Y&&>
+    bool push_until(Y&& item, queue_deadline_t deadline)
+    {
+        const QueueCost cost    = measure(item);
+        bool            blocked = false;
 
-        do
+        for (;;)
         {
-            tail = m_tail_o.load(std::memory_order_acquire);
-            next = m_data.next_index(tail);
+            // take the ticket first so a close() after the check still wakes us
+            const uint32_t ticket = m_not_full.prepare();
+            if (!m_is_running_o.load(std::memory_order_acquire))
+            {
+                return false;
+            }
 
-            // 检查队列是否已满或已停止
-            // 注意：此处 load head 必须用 acquire 确保看到消费者的最新进度
-            if (!m_is_running_o.load(std::memory_order_acquire)
-                || next == m_head_o.load(std::memory_order_acquire))
+            if (admit(cost))
+            {
+                charge(cost);
+                // try_push only consumes the item when it succeeds
+                if (m_data.try_push(std::forward<Y>(item)))
+                {
+                    m_not_empty.notify();
+                    m_consumer_waker.wake();
+                    return true;
+                }
+                refund(cost);
+            }
+
+            if (!blocked)
+            {
+                blocked = true;
+                m_full_waits_o.fetch_add(1, std::memory_order_relaxed);
+            }
+            LITEP_TRACE_SCOPE("queue full wait");
+            if (!m_not_full.wait(ticket, deadline))
             {
                 return false;
             }
+        }
+    }
 
-            // 尝试“认领”这个 tail 索引。如果失败，说明其他生产者抢先了一步
+    template <typename Y>
+        requires std::constructible_from<T, Y&&>
+    bool try_push(Y&& item)
+    {
+        if (!m_is_running_o.load(std::memory_order_acquire))
+        {
+            return false;
         }
-        while (!m_tail_o.compare_exchange_weak(
-            tail, next, std::memory_order_release, std::memory_order_relaxed));
 
-        // 认领成功后，写入数据
-        // 注意：在多生产者环境下，这要求 RingBuffer 的槽位能处理并发写入（或者通过索引解耦）
-        m_data.set_item(tail, std::forward<Y>(item));
+        const QueueCost cost = measure(item);
+        if (!admit(cost))
+        {
+            note_full();
+            return false;
+        }
 
+        charge(cost);
+        if (!m_data.try_push(std::forward<Y>(item)))
+        {
+            refund(cost);
+            note_full();
+            return false;
+        }
+        m_not_empty.notify();
+        m_consumer_waker.wake();
         return true;
     }
 
     size_t push_batch(std::vector<T>& items)
     {
-        size_t t     = m_tail_o.load(std::memory_order_relaxed);
+        if (!m_is_running_o.load(std::memory_order_acquire))
+        {
+            return 0;
+        }
+
         size_t count = 0;
-        for (auto& item : items)
+        if (m_budgeted)
         {
-            size_t next = m_data.next_index(t);
-            if (next == m_head_o.load(std::memory_order_acquire))
+            for (auto& item : items)
             {
-                break;
+                const QueueCost cost = measure(item);
+                if (!admit(cost))
+                {
+                    break;
+                }
+                charge(cost);
+                if (!m_data.try_push(std::move(item)))
+                {
+                    refund(cost);
+                    break;
+                }
+                ++count;
             }
+        }
+        else
+        {
+            count = m_data.try_push_batch(items);
+        }
 
-            m_data.set_item(t, std::move(item));
-            t = next;
-            ++count;
+        if (count > 0)
+        {
+            m_not_empty.notify();
+            m_consumer_waker.wake();
         }
-        m_tail_o.store(t, std::memory_order_release);
         return count;
     }
 
     std::optional<T> pop()
     {
-        size_t head;
-        size_t next;
+        return pop_until(queue_no_deadline);
+    }
 
-        do
+    std::optional<T> pop_until(queue_deadline_t deadline)
+    {
+        bool blocked = false;
+        for (;;)
         {
-            head = m_head_o.load(std::memory_order_acquire);
-
-            // 检查队列是否为空
-            // 注意：此处 load tail 必须用 acquire 确保看到生产者的最新进度
-            if (head == m_tail_o.load(std::memory_order_acquire))
+            const uint32_t ticket = m_not_empty.prepare();
+            if (auto item = take())
             {
-                return std::nullopt;
+                return item;
             }
 
-            next = m_data.next_index(head);
+            if (!m_is_running_o.load(std::memory_order_acquire))
+            {
+                // a push may have landed between the empty check and close()
+                return take();
+            }
 
-            // 尝试“认领”这个 head 索引。如果失败，说明其他消费者抢先拿走了这笔数据
+            if (!blocked)
+            {
+                blocked = true;
+                m_empty_waits_o.fetch_add(1, std::memory_order_relaxed);
+            }
+            LITEP_TRACE_SCOPE("queue empty wait");
+            if (!m_not_empty.wait(ticket, deadline))
+            {
+                return std::nullopt;
+            }
         }
-        while (!m_head_o.compare_exchange_weak(
-            head, next, std::memory_order_release, std::memory_order_relaxed));
+    }
 
-        // 认领成功后，移动数据
-        return m_data.move_item(head);
+    std::optional<T> try_pop()
+    {
+        auto item = take();
+        if (item == std::nullopt && m_consumer_waker.registered())
+        {
+            m_empty_waits_o.fetch_add(1, std::memory_order_relaxed);
+        }
+        return item;
     }
 
     size_t pop_batch(std::vector<T>& out_items, size_t max_count)
     {
-        size_t h     = m_head_o.load(std::memory_order_relaxed);
-        size_t t     = m_tail_o.load(std::memory_order_acquire);
-        size_t count = 0;
+        const size_t first = out_items.size();
+        const size_t count = m_data.try_pop_batch(out_items, max_count);
+        if (count > 0)
+        {
+            if (m_budgeted)
+            {
+                for (size_t i = first; i < out_items.size(); ++i)
+                {
+                    refund(measure(out_items[i]));
+                }
+            }
+            m_not_full.notify();
+            m_producer_waker.wake();
+        }
+        return count;
+    }
 
-        while (h != t && count < max_count)
+    // Drops everything currently queued. This is a consumer-side operation:
+    // call it from the consumer thread, or after close() once both sides have stopped.
+    size_t clear()
+    {
+        size_t count = 0;
+        while (auto item = m_data.try_pop())
         {
-            out_items.push_back(m_data.move_item(h));
-            h = m_data.next_index(h);
+            refund(measure(*item));
             ++count;
         }
-
         if (count > 0)
         {
-            m_head_o.store(h, std::memory_order_release);
+            m_not_full.notify();
+            m_producer_waker.wake();
         }
         return count;
     }
 
-    // todo: may cause racing
-    bool clear()
+    // Wakes every blocked producer and consumer; pushes fail from now on.
+    void close()
+    {
+        m_is_running_o.store(false, std::memory_order_release);
+        m_not_full.notify();
+        m_not_empty.notify();
+        m_producer_waker.wake();
+        m_consumer_waker.wake();
+    }
+
+    // Cooperative stages register here instead of blocking (null to unregister).
+    // Unregistering waits out a wake() the other side is making, so the waker can be freed after.
+    void set_consumer_waker(QueueWaker* waker)
+    {
+        m_consumer_waker.set(waker);
+    }
+
+    void set_producer_waker(QueueWaker* waker)
     {
-        if (m_is_running_o.load(std::memory_order_relaxed))
+        m_producer_waker.set(waker);
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return m_data.size();
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_data.capacity();
+    }
+
+    // Budget accounting; only tracked when the queue was given a budget.
+    [[nodiscard]] int64_t bytes() const
+    {
+        return m_bytes_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int64_t duration_us() const
+    {
+        return m_duration_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] const QueueBudget& budget() const
+    {
+        return m_budget;
+    }
+
+    [[nodiscard]] bool running_status() const
+    {
+        return m_is_running_o.load(std::memory_order_acquire);
+    }
+
+    // telemetry: blocking push()/pop() calls that found the queue full / empty,
+    // plus try_push()/try_pop() misses of a registered cooperative stage
+    [[nodiscard]] uint64_t full_waits() const
+    {
+        return m_full_waits_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t empty_waits() const
+    {
+        return m_empty_waits_o.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::optional<T> take()
+    {
+        auto item = m_data.try_pop();
+        if (item != std::nullopt)
         {
-            return false;
+            refund(measure(*item));
+            m_not_full.notify();
+            m_producer_waker.wake();
         }
+        return item;
+    }
 
-        size_t h = m_head_o.load(std::memory_order_relaxed);
-        size_t t = m_tail_o.load(std::memory_order_relaxed);
-
-        m_data.clear_range(h, t);
+    void note_full()
+    {
+        if (m_producer_waker.registered())
+        {
+            m_full_waits_o.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
 
-        m_head_o.store(0, std::memory_order_relaxed);
-        m_tail_o.store(0, std::memory_order_relaxed);
-        return true;
+    template <typename Y>
+    QueueCost measure(const Y& item) const
+    {
+        if (!m_budgeted)
+        {
+            return {};
+        }
+        return queue_item_cost<T>::measure(item);
     }
 
-    void close()
+    bool admit(const QueueCost& cost) const
     {
-        if (m_is_running_o.load(std::memory_order_acquire) == false)
+        if (!m_budgeted)
         {
-            return;
+            return true;
         }
-        m_is_running_o.store(false, std::memory_order_release);
+
+        const int64_t bytes    = m_bytes_o.load(std::memory_order_acquire);
+        const int64_t duration = m_duration_o.load(std::memory_order_acquire);
+        if (bytes <= 0 && duration <= 0)
+        {
+            return true; // never starve the consumer because of one oversized item
+        }
+        if (m_budget.max_bytes > 0 && bytes + cost.bytes > m_budget.max_bytes)
+        {
+            return false;
+        }
+        if (m_budget.max_duration_us > 0 && duration + cost.duration_us > m_budget.max_duration_us)
+        {
+            return false;
+        }
+        return true;
     }
 
-    [[nodiscard]] size_t size() const
+    // charged before the slot is published, so the consumer's refund can never run first
+    void charge(const QueueCost& cost)
     {
-        auto tail = m_tail_o.load(std::memory_order_acquire);
-        auto head = m_head_o.load(std::memory_order_acquire);
-        return (tail - head) & m_data.get_size();
+        if (m_budgeted)
+        {
+            m_bytes_o.fetch_add(cost.bytes, std::memory_order_acq_rel);
+            m_duration_o.fetch_add(cost.duration_us, std::memory_order_acq_rel);
+        }
     }
 
-    [[nodiscard]] bool running_status() const
+    void refund(const QueueCost& cost)
     {
-        return m_is_running_o.load();
+        if (m_budgeted)
+        {
+            m_bytes_o.fetch_sub(cost.bytes, std::memory_order_acq_rel);
+            m_duration_o.fetch_sub(cost.duration_us, std::memory_order_acq_rel);
+        }
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+#include "libavutil/frame.h"
+#include "libavutil/mathematics.h"
+}
+
+#include "../utils/alias.h"
+#include "./queue.h"
+
+// Budget costs for the media queues: bytes from the payload buffers,
+// duration from the item's duration in its own time base.
+
+inline int64_t duration_to_us(int64_t duration, AVRational time_base)
+{
+    if (duration <= 0 || time_base.num <= 0 || time_base.den <= 0)
+    {
+        return 0;
+    }
+    return av_rescale_q(duration, time_base, AVRational {1, 1000000});
+}
+
+template <>
+struct queue_item_cost<ptr_packet_t>
+{
+    static QueueCost measure(const ptr_packet_t& pkt)
+    {
+        if (pkt == nullptr)
+        {
+            return {};
+        }
+        return QueueCost {pkt->size, duration_to_us(pkt->duration, pkt->time_base)};
+    }
+};
+
+template <>
+struct queue_item_cost<ptr_frame_t>
+{
+    static QueueCost measure(const ptr_frame_t& frame)
+    {
+        if (frame == nullptr)
+        {
+            return {};
+        }
+
+        int64_t bytes = 0;
+        for (const AVBufferRef* buf : frame->buf)
+        {
+            if (buf != nullptr)
+            {
+                bytes += static_cast<int64_t>(buf->size);
+            }
+        }
+
+        int64_t duration_us = duration_to_us(frame->duration, frame->time_base);
+        if (duration_us == 0 && frame->nb_samples > 0 && frame->sample_rate > 0)
+        {
+            duration_us = static_cast<int64_t>(frame->nb_samples) * 1000000 / frame->sample_rate;
+        }
+        return QueueCost {bytes, duration_us};
+    }
+};
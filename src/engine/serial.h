@@ -0,0 +1,159 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+#include "libavutil/frame.h"
+}
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// `opaque` of packets and frames: seek generation in the high bits, the demux time of the
+// packet (pipeline_now_us(), 0 = unknown) in the low bits for latency telemetry.
+inline constexpr int     k_stamp_bits  = 44; // ~200 days of microseconds
+inline constexpr int64_t k_stamp_mask  = (int64_t {1} << k_stamp_bits) - 1;
+inline constexpr int64_t k_serial_mask = (int64_t {1} << (63 - k_stamp_bits)) - 1;
+
+// Microseconds on a process-wide steady timeline; never 0.
+inline int64_t pipeline_now_us()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point epoch = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - epoch).count() + 1;
+}
+
+// Seek generation of one pipeline. A seek bumps it first, so every stage can drop
+// items of older generations right away instead of decoding/uploading/playing them.
+// Wraps after k_serial_mask seeks; only equality is ever compared.
+class SerialCounter
+{
+private:
+    std::atomic<int64_t> m_value_o {0};
+
+public:
+    SerialCounter() = default;
+
+    SerialCounter(const SerialCounter&)              = delete;
+    SerialCounter& operator=(const SerialCounter&)   = delete;
+    SerialCounter(SerialCounter&&)                   = delete;
+    SerialCounter& operator=(SerialCounter&&)        = delete;
+    auto           operator<=>(const SerialCounter&) = delete;
+
+    ~SerialCounter() = default;
+
+    [[nodiscard]] int64_t current() const
+    {
+        return m_value_o.load(std::memory_order_acquire) & k_serial_mask;
+    }
+
+    int64_t bump()
+    {
+        return (m_value_o.fetch_add(1, std::memory_order_acq_rel) + 1) & k_serial_mask;
+    }
+};
+
+// Control items travel in the media queues, in order with the data:
+//   flush  - first item of a new generation. Decoders flush their codec state; `pts` is the
+//            discard-before time of an accurate seek (AV_NOPTS_VALUE for a keyframe seek).
+//   eof    - the demuxer reached the end. Decoders drain delayed frames, but the pipeline
+//            stays up, so a later seek can continue from it.
+// A control packet has no data and stream_index k_control_stream;
+// a control frame has no buffers. Both are told apart by k_control_eof in `flags`.
+// A flush packet with k_control_switch starts the stream the demuxer switched the track to.
+inline constexpr int k_control_stream = -1;
+inline constexpr int k_control_eof    = 1 << 30;
+inline constexpr int k_control_switch = 1 << 29;
+
+inline int64_t tag_of(const void* opaque)
+{
+    return static_cast<int64_t>(reinterpret_cast<intptr_t>(opaque));
+}
+
+inline void* make_tag(int64_t serial, int64_t stamp_us)
+{
+    return reinterpret_cast<void*>(
+        static_cast<intptr_t>((serial & k_serial_mask) << k_stamp_bits | (stamp_us & k_stamp_mask)));
+}
+
+inline int64_t serial_of(const AVPacket* pkt)
+{
+    return tag_of(pkt->opaque) >> k_stamp_bits;
+}
+
+inline int64_t serial_of(const AVFrame* frame)
+{
+    return tag_of(frame->opaque) >> k_stamp_bits;
+}
+
+inline int64_t stamp_of(const AVPacket* pkt)
+{
+    return tag_of(pkt->opaque) & k_stamp_mask;
+}
+
+inline int64_t stamp_of(const AVFrame* frame)
+{
+    return tag_of(frame->opaque) & k_stamp_mask;
+}
+
+inline void set_serial(AVPacket* pkt, int64_t serial, int64_t stamp_us = 0)
+{
+    pkt->opaque = make_tag(serial, stamp_us);
+}
+
+inline void set_serial(AVFrame* frame, int64_t serial, int64_t stamp_us = 0)
+{
+    frame->opaque = make_tag(serial, stamp_us);
+}
+
+inline bool is_control(const AVPacket* pkt)
+{
+    return pkt->stream_index == k_control_stream && pkt->data == nullptr;
+}
+
+inline bool is_control(const AVFrame* frame)
+{
+    return frame->buf[0] == nullptr;
+}
+
+inline bool is_eof(const AVPacket* pkt)
+{
+    return is_control(pkt) && (pkt->flags & k_control_eof) != 0;
+}
+
+inline bool is_eof(const AVFrame* frame)
+{
+    return is_control(frame) && (frame->flags & k_control_eof) != 0;
+}
+
+inline bool is_flush(const AVPacket* pkt)
+{
+    return is_control(pkt) && (pkt->flags & k_control_eof) == 0;
+}
+
+inline bool is_flush(const AVFrame* frame)
+{
+    return is_control(frame) && (frame->flags & k_control_eof) == 0;
+}
+
+inline bool is_track_switch(const AVPacket* pkt)
+{
+    return is_flush(pkt) && (pkt->flags & k_control_switch) != 0;
+}
+
+// `pkt` must be blank (fresh from the pool)
+inline void make_control(AVPacket* pkt, int64_t serial, bool eof, int64_t pts = AV_NOPTS_VALUE)
+{
+    pkt->stream_index = k_control_stream;
+    pkt->flags        = eof ? k_control_eof : 0;
+    pkt->pts          = pts;
+    set_serial(pkt, serial);
+}
+
+inline void make_control(AVFrame* frame, int64_t serial, bool eof, int64_t pts = AV_NOPTS_VALUE)
+{
+    frame->flags = eof ? k_control_eof : 0;
+    frame->pts   = pts;
+    set_serial(frame, serial);
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include "../utils/trace.h"
+#include "./queue.h"
+
+// Pipeline stages (Demuxer, Decoder) are written as step functions: each call does a
+// bounded amount of work and never blocks. Where they run is up to a StageHost:
+// a thread per stage (ThreadHost) or a pool shared by every stream (PipelineExecutor).
+enum class StepResult
+{
+    Progress, // did something, call again
+    Idle,     // waiting for a queue or a seek; whoever changes that wakes the runner
+    Done,     // finished (stop requested or input closed), never called again
+};
+
+using stage_step_t = std::function<StepResult(const std::stop_token&)>;
+
+// Drives one stage. Registered as the stage's waker, so wake() can come from any thread.
+class StageRunner : public QueueWaker
+{
+public:
+    StageRunner() = default;
+
+    StageRunner(const StageRunner&)              = delete;
+    StageRunner& operator=(const StageRunner&)   = delete;
+    StageRunner(StageRunner&&)                   = delete;
+    StageRunner& operator=(StageRunner&&)        = delete;
+    auto         operator<=>(const StageRunner&) = delete;
+
+    virtual ~StageRunner() = default;
+
+    virtual void start() = 0;
+
+    // Requests stop and returns once step() is not running and will not be called again.
+    virtual void stop() = 0;
+};
+
+class StageHost
+{
+public:
+    // `name` must be a string literal (it labels trace tracks)
+    virtual std::unique_ptr<StageRunner> create(stage_step_t step, const char* name) = 0;
+
+protected:
+    ~StageHost() = default;
+};
+
+// One dedicated thread that parks on an epoch counter while the stage is idle.
+class ThreadRunner final : public StageRunner
+{
+private:
+    stage_step_t                 m_step;
+    [[maybe_unused]] const char* m_name; // trace track label
+    std::jthread                 m_thread;
+    std::atomic<uint32_t>        m_epoch_o {0};
+    std::atomic_bool             m_parked_o {false};
+
+public:
+    ThreadRunner(stage_step_t step, const char* name) : m_step(std::move(step)), m_name(name)
+    {
+    }
+
+    ~ThreadRunner() override
+    {
+        stop();
+    }
+
+    void start() override
+    {
+        if (m_thread.joinable())
+        {
+            return;
+        }
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                LITEP_TRACE_THREAD(m_name);
+                for (;;)
+                {
+                    // read before stepping: a wake during the step is never lost
+                    const uint32_t seen   = m_epoch_o.load(std::memory_order_acquire);
+                    const StepResult step = m_step(st);
+                    if (step == StepResult::Done)
+                    {
+                        return;
+                    }
+                    if (step == StepResult::Idle)
+                    {
+                        park(seen);
+                    }
+                }
+            });
+    }
+
+    void stop() override
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            wake();
+            m_thread.join();
+        }
+    }
+
+    void wake() noexcept override
+    {
+        m_epoch_o.fetch_add(1, std::memory_order_seq_cst);
+        if (m_parked_o.load(std::memory_order_seq_cst))
+        {
+            m_epoch_o.notify_one();
+        }
+    }
+
+private:
+    void park(uint32_t seen)
+    {
+        // seq_cst pairs with wake(): either it sees m_parked_o, or we see its new epoch
+        m_parked_o.store(true, std::memory_order_seq_cst);
+        m_epoch_o.wait(seen, std::memory_order_seq_cst);
+        m_parked_o.store(false, std::memory_order_relaxed);
+    }
+};
+
+// Default host: a thread per stage, as before the executor existed.
+class ThreadHost final : public StageHost
+{
+public:
+    static ThreadHost& shared()
+    {
+        static ThreadHost host;
+        return host;
+    }
+
+    std::unique_ptr<StageRunner> create(stage_step_t step, const char* name) override
+    {
+        return std::make_unique<ThreadRunner>(std::move(step), name);
+    }
+};
+
+enum class OutboxState
+{
+    Empty,  // everything handed on
+    Full,   // a queue is full; the stage goes idle until it is popped
+    Closed, // a queue was closed downstream
+};
+
+// Items a stage produced but could not hand on yet, in order, each with its destination.
+template <typename T>
+class StageOutbox
+{
+private:
+    std::deque<std::pair<QueueAtomic<T>*, T>> m_items;
+
+public:
+    void put(QueueAtomic<T>& queue, T item)
+    {
+        m_items.emplace_back(&queue, std::move(item));
+    }
+
+    OutboxState flush()
+    {
+        while (!m_items.empty())
+        {
+            auto& [queue, item] = m_items.front();
+            // try_push leaves the item alone when it fails
+            if (!queue->try_push(std::move(item)))
+            {
+                return queue->running_status() ? OutboxState::Full : OutboxState::Closed;
+            }
+            m_items.pop_front();
+        }
+        return OutboxState::Empty;
+    }
+
+    void clear()
+    {
+        m_items.clear();
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return m_items.empty();
+    }
+};
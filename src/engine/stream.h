@@ -0,0 +1,217 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+#include "libavutil/frame.h"
+}
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <print>
+#include <stop_token>
+#include <string>
+
+#include "../utils/ffmpeg_deleter.h"
+#include "./decoder.h"
+#include "./demuxer.h"
+#include "./queue.h"
+#include "./serial.h"
+#include "./stage.h"
+#include "./thread_budget.h"
+
+// Per-stream buffering for a many-stream session. Much smaller than the single-player
+// budgets in main.cpp: with 64 streams every megabyte per stream counts 64 times.
+struct StreamConfig
+{
+    size_t      packet_slots = 256;
+    QueueBudget packet_budget {.max_bytes = 8 << 20, .max_duration_us = 2'000'000};
+    size_t      frame_slots = 8;
+    QueueBudget frame_budget {.max_bytes = 48 << 20, .max_duration_us = 500'000};
+    bool        loop = true; // seek back to the start at the end of the file
+    // codec threads come out of one process-wide budget instead of a thread per core each
+    DecoderConfig decoder {.budget = &DecodeThreadBudget::shared()};
+};
+
+// One video-only pipeline (demux -> decode -> frame queue) of a PlaybackSession.
+// Frames are consumed by the render thread (VideoWall) or, headless, by a counting sink
+// stage that runs on the same host as demux and decode.
+class MediaStream
+{
+private:
+    using ptr_packet_t = std::unique_ptr<AVPacket, av_packet_deleter>;
+    using ptr_frame_t  = std::unique_ptr<AVFrame, av_frame_deleter>;
+
+    std::string                  m_path;
+    bool                         m_loop;
+    QueueAtomic<ptr_packet_t>    m_video_packets;
+    QueueAtomic<ptr_packet_t>    m_audio_packets; // never fed: audio is discarded in the demuxer
+    QueueAtomic<ptr_frame_t>     m_frames;
+    Demuxer                      m_demux;
+    std::unique_ptr<Decoder>     m_decode;
+    std::unique_ptr<StageRunner> m_sink; // headless only
+    std::atomic<uint64_t>        m_frames_o {0};
+    std::atomic_bool             m_finished_o {false};
+
+public:
+    MediaStream(const char* path, const StreamConfig& config)
+        : m_path(path)
+        , m_loop(config.loop)
+        , m_video_packets(config.packet_slots, config.packet_budget)
+        , m_audio_packets(1)
+        , m_frames(config.frame_slots, config.frame_budget)
+        , m_demux(m_video_packets, m_audio_packets, path, DemuxerConfig {.streams = {.video_only = true}})
+    {
+        const AVCodecParameters* codecpar = m_demux.video_codecpar();
+        if (codecpar == nullptr)
+        {
+            return;
+        }
+        m_decode = std::make_unique<Decoder>(m_video_packets, m_frames, codecpar, config.decoder);
+        m_decode->follow(m_demux.serial());
+    }
+
+    MediaStream(const MediaStream&)              = delete;
+    MediaStream& operator=(const MediaStream&)   = delete;
+    MediaStream(MediaStream&&)                   = delete;
+    MediaStream& operator=(MediaStream&&)        = delete;
+    auto         operator<=>(const MediaStream&) = delete;
+
+    ~MediaStream()
+    {
+        stop();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_decode != nullptr && m_decode->ready();
+    }
+
+    void start(StageHost& host, bool headless)
+    {
+        if (!ok())
+        {
+            std::print(stderr, "[Stream] {} not ready, start() skipped\n", m_path);
+            return;
+        }
+        m_decode->run(host); // opens the codec
+        if (!m_decode->ready())
+        {
+            return; // the codec would not open: finished() from here on
+        }
+        if (headless && m_sink == nullptr)
+        {
+            m_sink = host.create(
+                [this](const std::stop_token& st)
+                {
+                    return drain(st);
+                },
+                "frame sink");
+            m_frames.set_consumer_waker(m_sink.get());
+            m_sink->start();
+        }
+        m_demux.run(host);
+    }
+
+    void stop()
+    {
+        m_demux.stop();
+        if (m_decode != nullptr)
+        {
+            m_decode->stop();
+        }
+        if (m_sink != nullptr)
+        {
+            m_sink->stop();
+            m_frames.set_consumer_waker(nullptr);
+            m_sink.reset();
+        }
+    }
+
+    // Consumer side. Frames of an older serial than demuxer().serial() are stale.
+    [[nodiscard]] QueueAtomic<ptr_frame_t>& frames()
+    {
+        return m_frames;
+    }
+
+    [[nodiscard]] Demuxer& demuxer()
+    {
+        return m_demux;
+    }
+
+    [[nodiscard]] const std::string& path() const
+    {
+        return m_path;
+    }
+
+    // Size the consumer shows the frames at; a much smaller one is decoded cheaper (Decoder::target_size).
+    void view_size(int width, int height)
+    {
+        if (m_decode != nullptr)
+        {
+            m_decode->target_size(width, height);
+        }
+    }
+
+    // Called by the consumer when it reaches the eof frame of the current serial.
+    void on_eof()
+    {
+        if (m_loop)
+        {
+            m_demux.seek(SeekRequest {.target_us = 0});
+            return;
+        }
+        m_finished_o.store(true, std::memory_order_release);
+    }
+
+    // decoded frames the consumer took off frames(), shown or not
+    void consumed(uint64_t count = 1)
+    {
+        m_frames_o.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t frames_decoded() const
+    {
+        return m_frames_o.load(std::memory_order_relaxed);
+    }
+
+    // the end was reached without looping (or the stream never started)
+    [[nodiscard]] bool finished() const
+    {
+        return !ok() || m_finished_o.load(std::memory_order_acquire);
+    }
+
+private:
+    // Headless consumer: counts frames and handles the end of the stream, nothing else.
+    StepResult drain(const std::stop_token& st)
+    {
+        if (st.stop_requested())
+        {
+            return StepResult::Done;
+        }
+
+        std::optional<ptr_frame_t> frame = m_frames.try_pop();
+        if (frame == std::nullopt)
+        {
+            return m_frames.running_status() ? StepResult::Idle : StepResult::Done;
+        }
+
+        const AVFrame* f = frame->get();
+        if (serial_of(f) != m_demux.serial().current())
+        {
+            return StepResult::Progress; // decoded before a loop seek
+        }
+        if (is_control(f))
+        {
+            if (is_eof(f))
+            {
+                on_eof();
+            }
+            return StepResult::Progress;
+        }
+        consumed();
+        return StepResult::Progress;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Process-wide cap on codec threads, split evenly across the decoders running under it.
+// Without it every decoder asks FFmpeg for one thread per core: 32 streams on 16 cores
+// end up with hundreds of threads. Decoders join when they are built and leave in stop();
+// their codecs open in run() with the share at that point, and running decoders pick up a
+// new share at their next keyframe (see Decoder).
+class DecodeThreadBudget
+{
+private:
+    mutable std::mutex m_mutex;
+    int                m_total   = 1;
+    int                m_members = 0;
+    std::atomic_int    m_share_o {1};
+
+public:
+    explicit DecodeThreadBudget(int total = default_total()) : m_total(std::max(total, 1))
+    {
+        m_share_o.store(m_total, std::memory_order_relaxed);
+    }
+
+    DecodeThreadBudget(const DecodeThreadBudget&)              = delete;
+    DecodeThreadBudget& operator=(const DecodeThreadBudget&)   = delete;
+    DecodeThreadBudget(DecodeThreadBudget&&)                   = delete;
+    DecodeThreadBudget& operator=(DecodeThreadBudget&&)        = delete;
+    auto                operator<=>(const DecodeThreadBudget&) = delete;
+
+    ~DecodeThreadBudget() = default;
+
+    static DecodeThreadBudget& shared()
+    {
+        static DecodeThreadBudget budget;
+        return budget;
+    }
+
+    static int default_total()
+    {
+        return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+
+    void set_total(int total)
+    {
+        std::lock_guard lock(m_mutex);
+        m_total = std::max(total, 1);
+        rebalance();
+    }
+
+    void join()
+    {
+        std::lock_guard lock(m_mutex);
+        ++m_members;
+        rebalance();
+    }
+
+    void leave()
+    {
+        std::lock_guard lock(m_mutex);
+        m_members = std::max(m_members - 1, 0);
+        rebalance();
+    }
+
+    // Threads per decoder right now; 1 means no codec threading at all.
+    [[nodiscard]] int share() const
+    {
+        return m_share_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int total() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_total;
+    }
+
+    [[nodiscard]] int members() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_members;
+    }
+
+private:
+    static int split(int total, int members)
+    {
+        return std::max(total / std::max(members, 1), 1);
+    }
+
+    void rebalance()
+    {
+        m_share_o.store(split(m_total, m_members), std::memory_order_relaxed);
+    }
+};
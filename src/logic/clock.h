@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// All clocks in this file are in seconds on the media timeline; "now" is steady_clock.
+inline double clock_now_seconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline std::chrono::steady_clock::time_point clock_time_point(double seconds)
+{
+    using namespace std::chrono;
+    return steady_clock::time_point(duration_cast<steady_clock::duration>(duration<double>(seconds)));
+}
+
+// One running clock. Stores pts minus the wall time of the last update, so reading it
+// extrapolates at real-time speed and an update is a single atomic store.
+// Written by the stage that owns it (audio output, render loop), read by anyone.
+class MediaClock
+{
+private:
+    static constexpr double k_invalid = std::numeric_limits<double>::quiet_NaN();
+
+    std::atomic<double> m_drift_o {k_invalid};
+
+public:
+    MediaClock() = default;
+
+    MediaClock(const MediaClock&)              = delete;
+    MediaClock& operator=(const MediaClock&)   = delete;
+    MediaClock(MediaClock&&)                   = delete;
+    MediaClock& operator=(MediaClock&&)        = delete;
+    auto        operator<=>(const MediaClock&) = delete;
+
+    ~MediaClock() = default;
+
+    void set(double pts, double now = clock_now_seconds())
+    {
+        m_drift_o.store(pts - now, std::memory_order_release);
+    }
+
+    // NaN until the first set()
+    [[nodiscard]] double get(double now = clock_now_seconds()) const
+    {
+        return m_drift_o.load(std::memory_order_acquire) + now;
+    }
+
+    [[nodiscard]] bool valid() const
+    {
+        return !std::isnan(m_drift_o.load(std::memory_order_acquire));
+    }
+
+    void reset()
+    {
+        m_drift_o.store(k_invalid, std::memory_order_release);
+    }
+};
+
+enum class ClockMaster
+{
+    Audio,
+    Video,
+    External, // system clock, anchored at the first frame
+};
+
+// The three clocks and which one the others follow.
+// An audio master that has not started yet (or a file without audio) falls back to external.
+class SyncClock
+{
+private:
+    // beyond this the clocks are not describing the same timeline (discontinuity, bad pts)
+    static constexpr double k_nosync_threshold = 10.0;
+    // external clock is pulled onto the audio clock when they disagree by more than this
+    static constexpr double k_external_resync = 0.1;
+
+    std::atomic<ClockMaster> m_master_o;
+
+public:
+    MediaClock audio;
+    MediaClock video;
+    MediaClock external;
+
+    explicit SyncClock(ClockMaster master = ClockMaster::Audio) : m_master_o(master)
+    {
+    }
+
+    SyncClock(const SyncClock&)              = delete;
+    SyncClock& operator=(const SyncClock&)   = delete;
+    SyncClock(SyncClock&&)                   = delete;
+    SyncClock& operator=(SyncClock&&)        = delete;
+    auto       operator<=>(const SyncClock&) = delete;
+
+    ~SyncClock() = default;
+
+    void select(ClockMaster master)
+    {
+        m_master_o.store(master, std::memory_order_release);
+    }
+
+    [[nodiscard]] ClockMaster selected() const
+    {
+        return m_master_o.load(std::memory_order_acquire);
+    }
+
+    // the master actually in effect right now
+    [[nodiscard]] ClockMaster effective() const
+    {
+        const ClockMaster master = selected();
+        if (master == ClockMaster::Audio && !audio.valid())
+        {
+            return ClockMaster::External;
+        }
+        return master;
+    }
+
+    [[nodiscard]] const MediaClock& master_clock() const
+    {
+        switch (effective())
+        {
+        case ClockMaster::Audio:
+            return audio;
+        case ClockMaster::Video:
+            return video;
+        case ClockMaster::External:
+        default:
+            return external;
+        }
+    }
+
+    [[nodiscard]] double master_time(double now = clock_now_seconds()) const
+    {
+        return master_clock().get(now);
+    }
+
+    // Drift correction for the fallback clock: once audio runs, external follows it,
+    // so a later fallback (audio underrun, track switch) continues from the right place.
+    void correct_drift(double now = clock_now_seconds())
+    {
+        if (!audio.valid())
+        {
+            return;
+        }
+        const double a = audio.get(now);
+        if (!external.valid() || std::fabs(external.get(now) - a) > k_external_resync)
+        {
+            external.set(a, now);
+        }
+    }
+
+    [[nodiscard]] static bool in_sync_range(double diff)
+    {
+        return std::fabs(diff) < k_nosync_threshold;
+    }
+
+    void reset()
+    {
+        audio.reset();
+        video.reset();
+        external.reset();
+    }
+};
+
+enum class FrameAction
+{
+    Present,
+    Drop,
+};
+
+struct FrameDecision
+{
+    FrameAction action     = FrameAction::Present;
+    double      present_at = 0.0; // steady_clock seconds
+    double      lateness   = 0.0; // > 0: behind the master by this much
+};
+
+struct PacerStats
+{
+    uint64_t presented = 0;
+    uint64_t dropped   = 0;
+    double   max_late  = 0.0;
+};
+
+enum class PacingMode
+{
+    Smooth, // present each frame at its pts on the master clock
+    Live,   // present as soon as possible; drop frames while newer ones are waiting
+};
+
+// Decides when (or whether) each video frame is shown against the master clock,
+// and tells the decoder to skip non-reference frames while presentation keeps missing deadlines.
+class VideoPacer
+{
+private:
+    static constexpr double k_default_frame = 1.0 / 30.0;
+    static constexpr double k_max_frame     = 0.1; // pts gaps above this are not a frame rate
+    static constexpr int    k_max_drops     = 8;   // always show something, even when hopelessly late
+    static constexpr int    k_skip_after    = 3;   // consecutive late frames before skipping decodes
+    static constexpr int    k_resume_after  = 30;  // consecutive on-time frames before decoding all again
+
+    SyncClock&       m_clock;
+    PacingMode       m_mode;
+    double           m_last_pts       = std::numeric_limits<double>::quiet_NaN();
+    double           m_frame_duration = k_default_frame;
+    int              m_drops_in_row   = 0;
+    int              m_late_in_row    = 0;
+    int              m_ontime_in_row  = 0;
+    std::atomic_bool m_skip_nonref_o {false};
+    PacerStats       m_stats {};
+
+public:
+    explicit VideoPacer(SyncClock& clock, PacingMode mode = PacingMode::Smooth) : m_clock(clock), m_mode(mode)
+    {
+    }
+
+    VideoPacer(const VideoPacer&)              = delete;
+    VideoPacer& operator=(const VideoPacer&)   = delete;
+    VideoPacer(VideoPacer&&)                   = delete;
+    VideoPacer& operator=(VideoPacer&&)        = delete;
+    auto        operator<=>(const VideoPacer&) = delete;
+
+    ~VideoPacer() = default;
+
+    // Render thread, for each frame in decode order. `backlog`: decoded frames already
+    // waiting behind this one (only used in live mode).
+    FrameDecision schedule(double pts, double now = clock_now_seconds(), size_t backlog = 0)
+    {
+        update_frame_duration(pts);
+        if (m_mode == PacingMode::Live)
+        {
+            return schedule_live(now, backlog);
+        }
+        m_clock.correct_drift(now);
+
+        // video/external masters start at the first frame
+        MediaClock& self = m_clock.effective() == ClockMaster::Video ? m_clock.video : m_clock.external;
+        if (m_clock.effective() != ClockMaster::Audio && !self.valid())
+        {
+            self.set(pts, now);
+        }
+
+        double diff = pts - m_clock.master_time(now);
+        if (!SyncClock::in_sync_range(diff))
+        {
+            // discontinuity: show now and re-anchor the clock we own
+            if (m_clock.effective() != ClockMaster::Audio)
+            {
+                self.set(pts, now);
+            }
+            diff = 0.0;
+        }
+
+        FrameDecision decision;
+        decision.lateness   = -diff;
+        decision.present_at = now + std::max(0.0, diff);
+
+        const bool late = -diff > std::max(m_frame_duration, 0.02);
+        if (late && m_drops_in_row < k_max_drops)
+        {
+            decision.action = FrameAction::Drop;
+        }
+        account(decision, late);
+        return decision;
+    }
+
+    // Render thread, after the frame reached the screen.
+    void presented(double pts, double now = clock_now_seconds())
+    {
+        m_clock.video.set(pts, now);
+    }
+
+    // Read by the decode thread (see Decoder::skip_nonref).
+    [[nodiscard]] bool skip_nonref() const
+    {
+        return m_skip_nonref_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] double frame_duration() const
+    {
+        return m_frame_duration;
+    }
+
+    [[nodiscard]] const PacerStats& stats() const
+    {
+        return m_stats;
+    }
+
+    void reset()
+    {
+        m_last_pts      = std::numeric_limits<double>::quiet_NaN();
+        m_drops_in_row  = 0;
+        m_late_in_row   = 0;
+        m_ontime_in_row = 0;
+        m_skip_nonref_o.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    // Latency over smoothness: nothing waits for a pts. Whatever queued up behind the
+    // current frame (a burst from the network, a slow swap) is caught up on by dropping.
+    FrameDecision schedule_live(double now, size_t backlog)
+    {
+        FrameDecision decision;
+        decision.present_at = now;
+        decision.lateness   = static_cast<double>(backlog) * m_frame_duration;
+
+        const bool late = backlog > 0;
+        if (late && m_drops_in_row < k_max_drops)
+        {
+            decision.action = FrameAction::Drop;
+        }
+        account(decision, late);
+        return decision;
+    }
+
+    void update_frame_duration(double pts)
+    {
+        if (!std::isnan(m_last_pts))
+        {
+            const double d = pts - m_last_pts;
+            if (d > 0.0 && d <= k_max_frame)
+            {
+                m_frame_duration = d;
+            }
+        }
+        m_last_pts = pts;
+    }
+
+    void account(const FrameDecision& decision, bool late)
+    {
+        if (decision.action == FrameAction::Drop)
+        {
+            ++m_stats.dropped;
+            ++m_drops_in_row;
+        }
+        else
+        {
+            ++m_stats.presented;
+            m_drops_in_row = 0;
+        }
+        m_stats.max_late = std::max(m_stats.max_late, decision.lateness);
+
+        // hysteresis, so skipping does not toggle on every other frame
+        if (late)
+        {
+            m_ontime_in_row = 0;
+            if (++m_late_in_row >= k_skip_after)
+            {
+                m_skip_nonref_o.store(true, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            m_late_in_row = 0;
+            if (++m_ontime_in_row >= k_resume_after)
+            {
+                m_skip_nonref_o.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <print>
+#include <vector>
+
+#include "../engine/decoder.h"
+#include "../engine/demuxer.h"
+#include "./clock.h"
+
+struct SeekStats
+{
+    uint64_t seeks     = 0; // requested
+    uint64_t completed = 0; // reached a first frame (superseded seeks never do)
+    double   last_ms   = 0.0;
+    double   max_ms    = 0.0;
+    double   total_ms  = 0.0;
+
+    [[nodiscard]] double mean_ms() const
+    {
+        return completed > 0 ? total_ms / static_cast<double>(completed) : 0.0;
+    }
+};
+
+// User-facing playback control. Seeks go to the demuxer, which stamps a new serial on
+// everything after them; the render side reports frames back so seek-to-first-frame
+// latency is measured where the user sees it.
+class PlaybackController
+{
+private:
+    Demuxer&             m_demuxer;
+    Decoder*             m_audio_decoder = nullptr;
+    int                  m_audio_track   = -1; // stream index
+    std::atomic<int64_t> m_pending_serial_o {-1};
+    std::atomic<double>  m_requested_at_o {0.0}; // clock_now_seconds() of the pending seek
+    std::atomic<double>  m_position_o {0.0};     // seconds from the start, last presented frame
+    mutable std::mutex   m_stats_mutex; // seeks come from the event thread, on_frame() from the render thread
+    SeekStats            m_stats {};
+
+public:
+    explicit PlaybackController(Demuxer& demuxer) : m_demuxer(demuxer), m_audio_track(demuxer.audio_stream_index())
+    {
+    }
+
+    PlaybackController(const PlaybackController&)              = delete;
+    PlaybackController& operator=(const PlaybackController&)   = delete;
+    PlaybackController(PlaybackController&&)                   = delete;
+    PlaybackController& operator=(PlaybackController&&)        = delete;
+    auto                operator<=>(const PlaybackController&) = delete;
+
+    ~PlaybackController() = default;
+
+    // seconds from the start of the media
+    void seek(double seconds, SeekMode mode = SeekMode::Keyframe)
+    {
+        const double length = duration();
+        if (length > 0.0)
+        {
+            seconds = std::min(seconds, length);
+        }
+        seconds = std::max(seconds, 0.0);
+
+        m_requested_at_o.store(clock_now_seconds(), std::memory_order_relaxed);
+        const auto target_us = static_cast<int64_t>(std::llround(seconds * 1e6));
+        m_demuxer.seek(SeekRequest {.target_us = target_us, .mode = mode});
+        m_pending_serial_o.store(m_demuxer.serial().current(), std::memory_order_release);
+        count_seek();
+        m_position_o.store(seconds, std::memory_order_relaxed);
+    }
+
+    // The decoder of the selected audio track, needed to switch tracks.
+    void attach_audio(Decoder& decoder)
+    {
+        m_audio_decoder = &decoder;
+    }
+
+    // Next audio track of the input (wrapping around), resuming where playback is.
+    // Counts as a seek: the switch restarts the pipeline at the current position.
+    bool cycle_audio()
+    {
+        if (m_audio_decoder == nullptr || m_audio_track < 0)
+        {
+            return false;
+        }
+        const std::vector<TrackInfo>& tracks = m_demuxer.tracks();
+        for (size_t step = 1; step < tracks.size(); ++step)
+        {
+            const TrackInfo& track = tracks[(static_cast<size_t>(m_audio_track) + step) % tracks.size()];
+            if (track.type != AVMEDIA_TYPE_AUDIO)
+            {
+                continue;
+            }
+            if (!m_audio_decoder->change_codec(track.codecpar))
+            {
+                return false;
+            }
+            m_requested_at_o.store(clock_now_seconds(), std::memory_order_relaxed);
+            const auto resume_us = static_cast<int64_t>(std::llround(position() * 1e6));
+            if (!m_demuxer.select_audio(track.index, resume_us))
+            {
+                return false;
+            }
+            m_pending_serial_o.store(m_demuxer.serial().current(), std::memory_order_release);
+            count_seek();
+            m_audio_track = track.index;
+            std::print(stderr, "[Audio] track {} ({})\n", track.index, track.language.empty() ? "und" : track.language);
+            return true;
+        }
+        return false; // the only audio track
+    }
+
+    void seek_relative(double delta, SeekMode mode = SeekMode::Keyframe)
+    {
+        seek(position() + delta, mode);
+    }
+
+    // Render side, after a frame reached the screen. `pts` is in seconds on the stream timeline.
+    void on_frame(int64_t serial, double pts)
+    {
+        m_position_o.store(pts - static_cast<double>(m_demuxer.start_us()) / 1e6, std::memory_order_relaxed);
+
+        int64_t pending = serial;
+        if (m_pending_serial_o.compare_exchange_strong(pending, -1, std::memory_order_acq_rel))
+        {
+            const double    ms = (clock_now_seconds() - m_requested_at_o.load(std::memory_order_relaxed)) * 1e3;
+            std::lock_guard lock(m_stats_mutex);
+            ++m_stats.completed;
+            m_stats.last_ms = ms;
+            m_stats.max_ms  = std::max(m_stats.max_ms, ms);
+            m_stats.total_ms += ms;
+        }
+    }
+
+    // a frame of this serial is the latest seek's result, older ones must not be shown
+    [[nodiscard]] bool current(int64_t serial) const
+    {
+        return serial == m_demuxer.serial().current();
+    }
+
+    [[nodiscard]] bool seeking() const
+    {
+        return m_pending_serial_o.load(std::memory_order_acquire) >= 0;
+    }
+
+    [[nodiscard]] double position() const
+    {
+        return m_position_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] double duration() const
+    {
+        return static_cast<double>(m_demuxer.duration_us()) / 1e6;
+    }
+
+    [[nodiscard]] SeekStats stats() const
+    {
+        std::lock_guard lock(m_stats_mutex);
+        return m_stats;
+    }
+
+private:
+    void count_seek()
+    {
+        std::lock_guard lock(m_stats_mutex);
+        ++m_stats.seeks;
+    }
+};
@@ -1,104 +1,215 @@
-extern "C"
-{
-#include "libavcodec/packet.h"
-}
+#pragma once
 
 #include <exec/static_thread_pool.hpp>
 #include <stdexec/execution.hpp>
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include "../engine/stage.h"
+#include "../engine/thread_budget.h"
+#include "../utils/trace.h"
+
+using pool_scheduler_t = decltype(std::declval<exec::static_thread_pool&>().get_scheduler());
+
+// Runs a stage on the shared pool. Each wake schedules at most one slice; a slice calls
+// step() until it goes idle or uses up its budget, then yields so other streams get a turn.
+//
+//   Idle --wake--> Scheduled --slice starts--> Running --Idle--> Idle
+//                      ^                          |  \--wake--> Notified (slice reschedules)
+//                      \--------- budget used ----/
+//
+// Every transition is a read-modify-write, wake() included even when a slice is already due:
+// the RMWs on one atomic are totally ordered, so a waker either comes before a slice's switch
+// to Running (and that slice sees what was pushed before the wake) or sees Running and leaves
+// Notified behind. A plain load there would let both sides miss each other.
+class PooledRunner final : public StageRunner
+{
+private:
+    enum State : uint8_t
+    {
+        Idle,
+        Scheduled,
+        Running,
+        Notified, // woken while running: run again instead of going idle
+        Done,
+    };
+
+    static constexpr int k_slice_steps = 32;
+
+    // Shared with every scheduled slice: stop() returns as soon as a slice has stored Done,
+    // while that slice is still notifying the waiters, so the state outlives the runner.
+    struct Slices : std::enable_shared_from_this<Slices>
+    {
+        stage_step_t                 step;
+        [[maybe_unused]] const char* name; // trace span of each slice
+        pool_scheduler_t             scheduler;
+        std::stop_source             stop;
+        std::atomic<uint8_t>         state_o {Idle};
+
+        Slices(stage_step_t s, const char* n, pool_scheduler_t sched)
+            : step(std::move(s)), name(n), scheduler(std::move(sched))
+        {
+        }
+
+        void wake() noexcept
+        {
+            uint8_t state = state_o.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if (state == Done)
+                {
+                    return;
+                }
+                uint8_t next = state; // Scheduled / Notified: a slice is already due, written back as is
+                if (state == Idle)
+                {
+                    next = Scheduled;
+                }
+                else if (state == Running)
+                {
+                    next = Notified;
+                }
+                if (state_o.compare_exchange_weak(state, next, std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    if (state == Idle)
+                    {
+                        submit();
+                    }
+                    return;
+                }
+            }
+        }
+
+        void submit() noexcept
+        {
+            stdexec::start_detached(stdexec::schedule(scheduler)
+                                    | stdexec::then(
+                                        [self = shared_from_this()]()
+                                        {
+                                            self->run();
+                                        }));
+        }
+
+        void run()
+        {
+            LITEP_TRACE_SCOPE(name);
+            state_o.exchange(Running, std::memory_order_acq_rel);
+
+            StepResult result = StepResult::Progress;
+            for (int i = 0; i < k_slice_steps && result == StepResult::Progress; ++i)
+            {
+                result = step(stop.get_token());
+            }
+
+            if (result == StepResult::Done)
+            {
+                state_o.exchange(Done, std::memory_order_acq_rel);
+                state_o.notify_all();
+                return;
+            }
+            if (result == StepResult::Idle)
+            {
+                uint8_t running = Running;
+                if (state_o.compare_exchange_strong(running, Idle, std::memory_order_acq_rel))
+                {
+                    return; // the next push/pop/seek wakes it
+                }
+                // Notified: something changed after the step looked
+            }
+            state_o.exchange(Scheduled, std::memory_order_acq_rel);
+            submit();
+        }
+    };
+
+    std::shared_ptr<Slices> m_slices;
+
+public:
+    PooledRunner(stage_step_t step, const char* name, pool_scheduler_t scheduler)
+        : m_slices(std::make_shared<Slices>(std::move(step), name, std::move(scheduler)))
+    {
+    }
 
-#include "../engine/decoder.h"
-#include "../engine/demuxer.h"
-#include "../engine/queue.h"
-#include "../utils/ffmpeg_deleter.h"
+    ~PooledRunner() override
+    {
+        stop();
+    }
 
-int demux_sander()
-{
-    using ptr_packet_t = std::unique_ptr<AVPacket, av_packet_deleter>;
-    using ptr_frame_t  = std::unique_ptr<AVFrame, av_frame_deleter>;
-    // ... 前置参数处理和初始化 ...
-
-    // 1. 初始化线程池（建议至少 2 个线程，一个给 Demux，一个给 Decode）
-    exec::static_thread_pool pool(4);
-    auto                     sched = pool.get_scheduler();
-
-    QueueAtomic<ptr_packet_t> video_packet_queue;
-    QueueAtomic<ptr_packet_t> audio_packet_queue;
-    QueueAtomic<ptr_frame_t>  video_frame_queue;
-
-    Demuxer demux(video_packet_queue, audio_packet_queue, "../../../../ example.mp4");
-    Decoder decode(video_packet_queue, video_frame_queue, demux.video_codecpar());
-
-    // ... OpenGL / GLFW 初始化 ...
-
-    // 2. 使用 stdexec 启动异步任务
-    // 我们不希望阻塞主线程，因为主线程要跑渲染循环
-    auto demux_sender  = demux.schedule_run(sched);
-    auto decode_sender = stdexec::schedule(sched)
-                       | stdexec::then(
-                             [&]()
-                             {
-                                 decode.run();
-                             });
-
-    // 这里使用 start_detached 让他俩在后台跑起来
-    // 或者使用 when_all 配合一个异步 scope
-    stdexec::start_detached(std::move(demux_sender));
-    stdexec::start_detached(std::move(decode_sender));
-
-    // 3. 主线程渲染循环 (Sender/Receiver 分界点)
-    // 渲染循环本身通常不建议封装进 stdexec 链条，因为 GLFW 要求在主线程操作窗口
-    while (!quit)
+    void start() override
     {
-        // ... 原有的渲染逻辑 (glfwPollEvents, pop frame, sleep, render) ...
+        m_slices->wake();
     }
 
-    // 4. 清理
-    demux.stop();
-    decode.stop();
-    // 线程池会在析构时自动 join，或者可以显式等待
-    return 0;
-}
+    void stop() override
+    {
+        m_slices->stop.request_stop();
+        m_slices->wake(); // an idle stage has to run once more to see the stop
+        for (uint8_t state = m_slices->state_o.load(std::memory_order_acquire); state != Done;
+             state         = m_slices->state_o.load(std::memory_order_acquire))
+        {
+            m_slices->state_o.wait(state, std::memory_order_acquire);
+        }
+    }
+
+    void wake() noexcept override
+    {
+        m_slices->wake();
+    }
+};
 
-int fun()
+// A fixed set of threads shared by every stage of every stream: an idle stage costs
+// nothing, so N streams need far fewer threads than 2+ per stream. Stages opt in with
+// Demuxer::run(executor) / Decoder::run(executor). Must outlive the stages it runs.
+class PipelineExecutor final : public StageHost
 {
-    // 1. 显式指定执行上下文和调度器
-    // exec 是 stdexec 参考实现中提供的线程池扩展
-    exec::static_thread_pool pool(8);
-    stdexec::scheduler auto  sched = pool.get_scheduler();
-
-    // 2. 纯粹的显式调用链
-    // 注意：管道符 | 依赖于 ADL（参数相关查找），因此不需要对每个算子写完整命名空间，
-    // 但为了绝对的明确性，我们在链条的起始点和转换点使用完整路径。
-    auto work = stdexec::schedule(sched)
-              | stdexec::then(
-                    []()
-                    {
-                        return 100;
-                    })
-              | stdexec::then(
-                    [](int val)
-                    {
-                        return val * val;
-                    })
-              | stdexec::let_value(
-                    [](int val)
-                    {
-                        // 返回一个新的 sender
-                        return stdexec::just(val + 1);
-                    });
+private:
+    exec::static_thread_pool m_pool;
+
+public:
+    explicit PipelineExecutor(uint32_t threads = default_threads()) : m_pool(threads)
+    {
+    }
 
-    // 3. 显式启动并处理结果
-    // sync_wait 是一个阻塞调用，返回一个 std::optional<std::tuple<...>>
-    auto result = stdexec::sync_wait(work);
+    PipelineExecutor(const PipelineExecutor&)              = delete;
+    PipelineExecutor& operator=(const PipelineExecutor&)   = delete;
+    PipelineExecutor(PipelineExecutor&&)                   = delete;
+    PipelineExecutor& operator=(PipelineExecutor&&)        = delete;
+    auto              operator<=>(const PipelineExecutor&) = delete;
 
-    if (result.has_value())
+    ~PipelineExecutor() = default;
+
+    std::unique_ptr<StageRunner> create(stage_step_t step, const char* name) override
     {
-        // 使用结构化绑定获取 tuple 中的值
-        auto [final_value] = result.value();
-        std::cout << "Computed Result: " << final_value << std::endl;
+        return std::make_unique<PooledRunner>(std::move(step), name, m_pool.get_scheduler());
     }
 
-    return 0;
-}
+    [[nodiscard]] pool_scheduler_t scheduler()
+    {
+        return m_pool.get_scheduler();
+    }
+
+    // Decoding spends most of its time inside FFmpeg's own codec threads,
+    // so the pool only has to keep demux and the send/receive calls moving.
+    static uint32_t default_threads()
+    {
+        return std::clamp(std::thread::hardware_concurrency() / 2, 2u, 4u);
+    }
+
+    // For a pool that runs `decoders` decoders under `budget`. Once their share is down to one
+    // thread, each codec decodes on the pool thread that feeds it, so the pool takes over the
+    // budget's threads; otherwise default_threads().
+    static uint32_t threads_for(const DecodeThreadBudget& budget, size_t decoders)
+    {
+        const auto total = static_cast<size_t>(budget.total());
+        if (decoders == 0 || total / decoders > 1)
+        {
+            return default_threads();
+        }
+        return std::max(default_threads(), static_cast<uint32_t>(std::min(decoders, total)));
+    }
+};
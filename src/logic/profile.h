@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../engine/decoder.h"
+#include "../engine/demuxer.h"
+#include "../engine/queue.h"
+#include "./clock.h"
+
+enum class LatencyProfile
+{
+    Standard, // files: deep buffers, smooth pacing
+    Low,      // live monitoring: glass-to-glass latency over smoothness
+};
+
+// Everything the single-stream player sets up differently per profile.
+struct PipelineProfile
+{
+    DemuxerConfig demux {};
+    DecoderConfig video_decoder {};
+
+    // Slot counts are only an upper bound; the byte/duration budgets are what
+    // keeps memory per stream predictable (a 4K yuv420p frame is ~12 MB).
+    // Powers of two (RingBuffer), and an SPSC ring holds one item less than its slots.
+    size_t      video_packet_slots = 1024;
+    size_t      audio_packet_slots = 1024;
+    size_t      video_frame_slots  = 128;
+    size_t      audio_frame_slots  = 256;
+    QueueBudget video_packet_budget {.max_bytes = 32 << 20, .max_duration_us = 5'000'000};
+    QueueBudget audio_packet_budget {.max_bytes = 4 << 20, .max_duration_us = 5'000'000};
+    QueueBudget video_frame_budget {.max_bytes = 128 << 20, .max_duration_us = 1'000'000};
+    QueueBudget audio_frame_budget {.max_bytes = 8 << 20, .max_duration_us = 1'000'000};
+
+    PacingMode pacing = PacingMode::Smooth;
+};
+
+inline PipelineProfile pipeline_profile(LatencyProfile profile)
+{
+    if (profile == LatencyProfile::Standard)
+    {
+        return PipelineProfile {};
+    }
+
+    // Default probing alone reads up to 5 s of stream before the first packet is
+    // delivered; with in-band parameters (TS, Annex B) a few packets are enough.
+    // Slice threading and low delay keep the decoder from holding frames back, and
+    // every queue is only a few frames deep, so latency cannot pile up in buffers.
+    return PipelineProfile {
+        .demux         = {.nobuffer = true, .probesize = 32 << 10, .analyzeduration_us = 100'000},
+        .video_decoder = {.threading = DecodeThreading::Slice, .low_delay = true},
+        .video_packet_slots  = 32,
+        .audio_packet_slots  = 32,
+        .video_frame_slots   = 4, // 3 frames
+        .audio_frame_slots   = 8,
+        .video_packet_budget = {.max_bytes = 4 << 20, .max_duration_us = 200'000},
+        .audio_packet_budget = {.max_bytes = 256 << 10, .max_duration_us = 200'000},
+        .video_frame_budget  = {.max_bytes = 48 << 20, .max_duration_us = 100'000},
+        .audio_frame_budget  = {.max_bytes = 1 << 20, .max_duration_us = 200'000},
+        .pacing              = PacingMode::Live,
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <print>
+#include <vector>
+
+#include "../engine/stream.h"
+#include "./executor.h"
+
+// Owns the streams of a video wall and the one pool all of their stages run on.
+// Fairness comes from the executor: a stage runs at most one slice at a time and yields
+// after it, so a stream with a fast decoder cannot starve the others of pool threads.
+class PlaybackSession
+{
+private:
+    PipelineExecutor                          m_executor; // declared first: outlives every stream
+    std::vector<std::unique_ptr<MediaStream>> m_streams;
+    bool                                      m_started = false;
+
+public:
+    explicit PlaybackSession(uint32_t threads = PipelineExecutor::default_threads()) : m_executor(threads)
+    {
+    }
+
+    PlaybackSession(const PlaybackSession&)              = delete;
+    PlaybackSession& operator=(const PlaybackSession&)   = delete;
+    PlaybackSession(PlaybackSession&&)                   = delete;
+    PlaybackSession& operator=(PlaybackSession&&)        = delete;
+    auto             operator<=>(const PlaybackSession&) = delete;
+
+    ~PlaybackSession()
+    {
+        stop();
+    }
+
+    // nullptr when the file cannot be played; the session is unchanged then.
+    // Before start() only.
+    MediaStream* add(const char* path, const StreamConfig& config = {})
+    {
+        if (m_started)
+        {
+            std::print(stderr, "[Session] already started, {} not added\n", path);
+            return nullptr;
+        }
+        auto stream = std::make_unique<MediaStream>(path, config);
+        if (!stream->ok())
+        {
+            std::print(stderr, "[Session] {} skipped\n", path);
+            return nullptr;
+        }
+        m_streams.push_back(std::move(stream));
+        return m_streams.back().get();
+    }
+
+    // headless: every stream gets a sink stage that counts and discards its frames
+    void start(bool headless = false)
+    {
+        if (m_started)
+        {
+            return;
+        }
+        m_started = true;
+        for (auto& stream : m_streams)
+        {
+            stream->start(m_executor, headless);
+        }
+    }
+
+    void stop()
+    {
+        for (auto& stream : m_streams)
+        {
+            stream->stop();
+        }
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return m_streams.size();
+    }
+
+    [[nodiscard]] MediaStream& stream(size_t i)
+    {
+        return *m_streams[i];
+    }
+
+    [[nodiscard]] std::vector<MediaStream*> streams()
+    {
+        std::vector<MediaStream*> out;
+        out.reserve(m_streams.size());
+        for (auto& stream : m_streams)
+        {
+            out.push_back(stream.get());
+        }
+        return out;
+    }
+
+    // over all streams
+    [[nodiscard]] uint64_t frames_decoded() const
+    {
+        uint64_t total = 0;
+        for (const auto& stream : m_streams)
+        {
+            total += stream->frames_decoded();
+        }
+        return total;
+    }
+
+    [[nodiscard]] bool all_finished() const
+    {
+        for (const auto& stream : m_streams)
+        {
+            if (!stream->finished())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
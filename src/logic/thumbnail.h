@@ -0,0 +1,468 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <print>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../engine/decoder.h"
+#include "../engine/demuxer.h"
+#include "../engine/queue.h"
+#include "../engine/serial.h"
+#include "../engine/stage.h"
+#include "../engine/thread_budget.h"
+#include "../utils/alias.h"
+#include "../utils/ffmpeg_deleter.h"
+#include "./executor.h"
+
+struct ThumbnailConfig
+{
+    int count      = 12;  // keyframes per file, one from each of `count` equal parts of the duration
+    int columns    = 4;
+    int tile_width = 320; // the height follows the picture's display aspect ratio
+    int gap        = 4;   // pixels between and around the tiles
+};
+
+// RGB24, rows top to bottom, no padding.
+struct ContactSheet
+{
+    int                  width  = 0;
+    int                  height = 0;
+    int                  tiles  = 0; // filled, in order; fewer than count when parts share a keyframe
+    std::vector<uint8_t> rgb;
+};
+
+// PNG for a .png path (FFmpeg's encoder), binary PPM otherwise.
+inline bool write_contact_sheet(const std::string& path, const ContactSheet& sheet)
+{
+    std::vector<uint8_t> bytes;
+    if (std::filesystem::path(path).extension() == ".png")
+    {
+        const AVCodec*                                           codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+        std::unique_ptr<AVCodecContext, av_codec_context_deleter> ctx(codec != nullptr ? avcodec_alloc_context3(codec)
+                                                                                         : nullptr);
+        ptr_frame_t                                              frame(av_frame_alloc());
+        ptr_packet_t                                             packet(av_packet_alloc());
+        if (ctx == nullptr || frame == nullptr || packet == nullptr)
+        {
+            std::print(stderr, "[Thumbnail] no PNG encoder\n");
+            return false;
+        }
+        ctx->width     = sheet.width;
+        ctx->height    = sheet.height;
+        ctx->pix_fmt   = AV_PIX_FMT_RGB24;
+        ctx->time_base = AVRational {1, 1};
+        if (avcodec_open2(ctx.get(), codec, nullptr) < 0)
+        {
+            std::print(stderr, "[Thumbnail] could not open the PNG encoder\n");
+            return false;
+        }
+        // the encoder only reads the picture, so it can point at the sheet
+        frame->format      = AV_PIX_FMT_RGB24;
+        frame->width       = sheet.width;
+        frame->height      = sheet.height;
+        frame->data[0]     = const_cast<uint8_t*>(sheet.rgb.data());
+        frame->linesize[0] = sheet.width * 3;
+        if (avcodec_send_frame(ctx.get(), frame.get()) < 0 || avcodec_receive_packet(ctx.get(), packet.get()) < 0)
+        {
+            std::print(stderr, "[Thumbnail] PNG encoding failed for {}\n", path);
+            return false;
+        }
+        bytes.assign(packet->data, packet->data + packet->size);
+    }
+    else
+    {
+        const std::string header = std::format("P6\n{} {}\n255\n", sheet.width, sheet.height);
+        bytes.assign(header.begin(), header.end());
+        bytes.insert(bytes.end(), sheet.rgb.begin(), sheet.rgb.end());
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::print(stderr, "[Thumbnail] could not write {}\n", path);
+        return false;
+    }
+    const bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// One file's contact sheet: demux -> decode (keyframes only) -> this stage, which scales each
+// frame straight into its tile and seeks to the next part. Between parts nothing is decoded but
+// the keyframe a seek lands on, and the small queues bound what is read past it.
+class ThumbnailJob
+{
+private:
+    using ptr_sws_t = std::unique_ptr<SwsContext, sws_context_deleter>;
+
+    std::string                  m_path;
+    ThumbnailConfig              m_config;
+    QueueAtomic<ptr_packet_t>    m_video_packets;
+    QueueAtomic<ptr_packet_t>    m_audio_packets; // never fed: audio is discarded in the demuxer
+    QueueAtomic<ptr_frame_t>     m_frames;
+    Demuxer                      m_demux;
+    std::unique_ptr<Decoder>     m_decode;
+    std::unique_ptr<StageRunner> m_runner;
+    std::atomic<uint32_t>*       m_finished = nullptr; // bumped and notified once done
+    ContactSheet                 m_sheet;
+    ptr_sws_t                    m_sws {nullptr};
+    int                          m_tile_w   = 0;
+    int                          m_tile_h   = 0;
+    int                          m_part     = 0; // part of the duration being sought
+    int64_t                      m_last_pts = AV_NOPTS_VALUE;
+    std::atomic_bool             m_done_o {false};
+
+public:
+    ThumbnailJob(const char* path, const ThumbnailConfig& config)
+        : m_path(path)
+        , m_config(config)
+        , m_video_packets(64, QueueBudget {.max_bytes = 16 << 20})
+        , m_audio_packets(1)
+        , m_frames(4)
+        , m_demux(m_video_packets, m_audio_packets, path, DemuxerConfig {.streams = {.video_only = true}})
+    {
+        const AVCodecParameters* codecpar = m_demux.video_codecpar();
+        if (codecpar == nullptr || m_demux.duration_us() <= 0 || m_config.count <= 0)
+        {
+            return; // no video, or nothing to space the parts over
+        }
+        // a keyframe is one frame: slice threads decode it without frame-threading delay
+        m_decode = std::make_unique<Decoder>(m_video_packets,
+                                             m_frames,
+                                             codecpar,
+                                             DecoderConfig {.threading      = DecodeThreading::Slice,
+                                                            .budget         = &DecodeThreadBudget::shared(),
+                                                            .keyframes_only = true});
+        m_decode->follow(m_demux.serial());
+        layout(codecpar);
+    }
+
+    ThumbnailJob(const ThumbnailJob&)              = delete;
+    ThumbnailJob& operator=(const ThumbnailJob&)   = delete;
+    ThumbnailJob(ThumbnailJob&&)                   = delete;
+    ThumbnailJob& operator=(ThumbnailJob&&)        = delete;
+    auto          operator<=>(const ThumbnailJob&) = delete;
+
+    ~ThumbnailJob()
+    {
+        stop();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_decode != nullptr && m_decode->ready();
+    }
+
+    // `finished`: optional, incremented and notified when the sheet is complete
+    void start(StageHost& host, std::atomic<uint32_t>* finished = nullptr)
+    {
+        if (!ok())
+        {
+            std::print(stderr, "[Thumbnail] {} not ready, start() skipped\n", m_path);
+            return;
+        }
+        m_finished = finished;
+        m_decode->run(host); // opens the codec
+        if (!m_decode->ready())
+        {
+            finish(); // done, without a tile
+            return;
+        }
+        m_runner = host.create(
+            [this](const std::stop_token& st)
+            {
+                return step(st);
+            },
+            "thumbnails");
+        m_frames.set_consumer_waker(m_runner.get());
+        seek_part();
+        m_demux.run(host);
+        m_runner->start();
+    }
+
+    void stop()
+    {
+        m_demux.stop();
+        if (m_decode != nullptr)
+        {
+            m_decode->stop();
+        }
+        if (m_runner != nullptr)
+        {
+            m_runner->stop();
+            m_frames.set_consumer_waker(nullptr);
+            m_runner.reset();
+        }
+    }
+
+    [[nodiscard]] bool done() const
+    {
+        return m_done_o.load(std::memory_order_acquire);
+    }
+
+    // complete once done()
+    [[nodiscard]] const ContactSheet& sheet() const
+    {
+        return m_sheet;
+    }
+
+    [[nodiscard]] const std::string& path() const
+    {
+        return m_path;
+    }
+
+private:
+    void layout(const AVCodecParameters* codecpar)
+    {
+        const AVRational sar    = codecpar->sample_aspect_ratio.num > 0 ? codecpar->sample_aspect_ratio
+                                                                        : AVRational {1, 1};
+        const double     aspect = static_cast<double>(codecpar->width) * av_q2d(sar) / std::max(codecpar->height, 1);
+        const int        gap    = std::max(m_config.gap, 0);
+        const int        cols   = std::clamp(m_config.columns, 1, m_config.count);
+        const int        rows   = (m_config.count + cols - 1) / cols;
+
+        m_tile_w       = std::max(m_config.tile_width, 2) & ~1;
+        m_tile_h       = std::max(static_cast<int>(std::lround(m_tile_w / std::max(aspect, 0.01))), 2) & ~1;
+        m_sheet.width  = cols * m_tile_w + (cols + 1) * gap;
+        m_sheet.height = rows * m_tile_h + (rows + 1) * gap;
+        m_sheet.rgb.assign(static_cast<size_t>(m_sheet.width) * m_sheet.height * 3, 0x20); // dark gray
+    }
+
+    // the middle of part m_part, so no part starts on the (often black) first frame
+    void seek_part()
+    {
+        const double at = (m_part + 0.5) / m_config.count * static_cast<double>(m_demux.duration_us());
+        m_demux.seek(SeekRequest {.target_us = static_cast<int64_t>(at), .mode = SeekMode::Keyframe});
+    }
+
+    StepResult step(const std::stop_token& st)
+    {
+        if (st.stop_requested())
+        {
+            return StepResult::Done;
+        }
+
+        std::optional<ptr_frame_t> frame = m_frames.try_pop();
+        if (frame == std::nullopt)
+        {
+            return m_frames.running_status() ? StepResult::Idle : finish();
+        }
+
+        const AVFrame* f = frame->get();
+        if (serial_of(f) != m_demux.serial().current())
+        {
+            return StepResult::Progress; // read before the latest seek
+        }
+        if (is_control(f))
+        {
+            return is_eof(f) ? next_part() : StepResult::Progress; // eof: no keyframe for this part
+        }
+
+        // parts closer together than the keyframe interval land on the same keyframe
+        const int64_t pts = f->best_effort_timestamp != AV_NOPTS_VALUE ? f->best_effort_timestamp : f->pts;
+        if (pts == AV_NOPTS_VALUE || pts != m_last_pts)
+        {
+            place(f);
+            m_last_pts = pts;
+        }
+        return next_part();
+    }
+
+    StepResult next_part()
+    {
+        if (++m_part >= m_config.count)
+        {
+            return finish();
+        }
+        seek_part();
+        return StepResult::Progress;
+    }
+
+    // Scales straight into the sheet: the destination planes are the tile's rows of the sheet.
+    void place(const AVFrame* frame)
+    {
+        const int cols = std::clamp(m_config.columns, 1, m_config.count);
+        const int gap  = std::max(m_config.gap, 0);
+        const int x    = gap + (m_sheet.tiles % cols) * (m_tile_w + gap);
+        const int y    = gap + (m_sheet.tiles / cols) * (m_tile_h + gap);
+
+        m_sws.reset(sws_getCachedContext(m_sws.release(),
+                                         frame->width,
+                                         frame->height,
+                                         static_cast<AVPixelFormat>(frame->format),
+                                         m_tile_w,
+                                         m_tile_h,
+                                         AV_PIX_FMT_RGB24,
+                                         SWS_AREA,
+                                         nullptr,
+                                         nullptr,
+                                         nullptr));
+        if (m_sws == nullptr)
+        {
+            std::print(stderr, "[Thumbnail] cannot scale pixel format {} of {}\n", frame->format, m_path);
+            return;
+        }
+
+        uint8_t*  dst[4]        = {m_sheet.rgb.data() + (static_cast<size_t>(y) * m_sheet.width + x) * 3};
+        const int dst_stride[4] = {m_sheet.width * 3};
+        sws_scale(m_sws.get(), frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+        ++m_sheet.tiles;
+    }
+
+    StepResult finish()
+    {
+        if (!m_done_o.exchange(true, std::memory_order_acq_rel) && m_finished != nullptr)
+        {
+            m_finished->fetch_add(1, std::memory_order_release);
+            m_finished->notify_all();
+        }
+        return StepResult::Done;
+    }
+};
+
+struct ThumbnailStats
+{
+    uint64_t files   = 0;
+    uint64_t written = 0;
+    uint64_t failed  = 0; // could not be opened, no video, no keyframe decoded, or the sheet could not be written
+    uint64_t tiles   = 0;
+};
+
+// Contact sheets for many files. Up to `parallel` jobs are in flight, and every stage of every
+// job runs on one executor, so the pool threads go wherever a demuxer or decoder has work.
+// Files are opened on the calling thread, one job at a time.
+class ThumbnailBatch
+{
+private:
+    PipelineExecutor m_executor; // declared first: outlives every job
+    ThumbnailConfig  m_config;
+    size_t           m_parallel;
+
+public:
+    // threads: 0 sizes the pool for `parallel` decoders (PipelineExecutor::threads_for)
+    explicit ThumbnailBatch(const ThumbnailConfig& config,
+                            size_t                 parallel = std::max(std::thread::hardware_concurrency(), 2u),
+                            uint32_t               threads  = 0)
+        : m_executor(threads > 0 ? threads : PipelineExecutor::threads_for(DecodeThreadBudget::shared(), parallel))
+        , m_config(config)
+        , m_parallel(std::max<size_t>(parallel, 1))
+    {
+    }
+
+    ThumbnailBatch(const ThumbnailBatch&)              = delete;
+    ThumbnailBatch& operator=(const ThumbnailBatch&)   = delete;
+    ThumbnailBatch(ThumbnailBatch&&)                   = delete;
+    ThumbnailBatch& operator=(ThumbnailBatch&&)        = delete;
+    auto            operator<=>(const ThumbnailBatch&) = delete;
+
+    ~ThumbnailBatch() = default;
+
+    // One sheet per input, written to out_dir as <file stem><extension> (".png" or ".ppm");
+    // inputs that share a stem ("a/clip.mp4", "b/clip.mov") get -2, -3... after it.
+    ThumbnailStats run(const std::vector<const char*>& paths,
+                       const std::string&              out_dir,
+                       const std::string&              extension = ".png")
+    {
+        struct Active
+        {
+            size_t                        input;
+            std::unique_ptr<ThumbnailJob> job;
+        };
+
+        const std::vector<std::string> names = output_names(paths, extension);
+        ThumbnailStats                 stats;
+        std::atomic<uint32_t>          finished_o {0};
+        std::vector<Active>            active;
+        size_t                         next = 0;
+
+        while (next < paths.size() || !active.empty())
+        {
+            while (next < paths.size() && active.size() < m_parallel)
+            {
+                ++stats.files;
+                auto job = std::make_unique<ThumbnailJob>(paths[next], m_config);
+                if (!job->ok())
+                {
+                    std::print(stderr, "[Thumbnail] {} skipped\n", job->path());
+                    ++stats.failed;
+                    ++next;
+                    continue;
+                }
+                job->start(m_executor, &finished_o);
+                active.push_back(Active {.input = next++, .job = std::move(job)});
+            }
+            if (active.empty())
+            {
+                continue;
+            }
+
+            const uint32_t seen = finished_o.load(std::memory_order_acquire);
+            auto           done = std::ranges::find_if(active,
+                                             [](const Active& a)
+                                             {
+                                                 return a.job->done();
+                                             });
+            if (done == active.end())
+            {
+                finished_o.wait(seen, std::memory_order_acquire);
+                continue;
+            }
+
+            ThumbnailJob& job = *done->job;
+            job.stop();
+            const std::filesystem::path out = std::filesystem::path(out_dir) / names[done->input];
+            if (job.sheet().tiles == 0)
+            {
+                std::print(stderr, "[Thumbnail] no keyframe decoded from {}\n", job.path());
+                ++stats.failed;
+            }
+            else if (write_contact_sheet(out.string(), job.sheet()))
+            {
+                ++stats.written;
+                stats.tiles += static_cast<uint64_t>(job.sheet().tiles);
+            }
+            else
+            {
+                ++stats.failed;
+            }
+            active.erase(done);
+        }
+        return stats;
+    }
+
+private:
+    static std::vector<std::string> output_names(const std::vector<const char*>& paths, const std::string& extension)
+    {
+        std::vector<std::string>        names;
+        std::unordered_set<std::string> used;
+        for (const char* path : paths)
+        {
+            const std::string stem = std::filesystem::path(path).stem().string();
+            std::string       name = stem + extension;
+            for (int n = 2; !used.insert(name).second; ++n)
+            {
+                name = std::format("{}-{}{}", stem, n, extension);
+            }
+            names.push_back(std::move(name));
+        }
+        return names;
+    }
+};
@@ -0,0 +1,520 @@
+#pragma once
+
+extern "C"
+{
+#include "libavutil/channel_layout.h"
+#include "libavutil/frame.h"
+#include "libswresample/swresample.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <print>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../engine/queue.h"
+#include "../engine/queue_cost.h"
+#include "../engine/serial.h"
+#include "../logic/clock.h"
+#include "../utils/alias.h"
+#include "../utils/ffmpeg_deleter.h"
+#include "../utils/trace.h"
+
+// Fixed output format of the audio stage: interleaved float samples.
+struct AudioFormat
+{
+    int sample_rate = 48000;
+    int channels    = 2;
+};
+
+// Single-producer/single-consumer ring of interleaved float samples.
+// Indices are monotonic sample counters, so read/write are one memcpy (two at the wrap)
+// and one atomic store each: safe to call from a device callback.
+class SampleRing
+{
+private:
+    std::vector<float> m_data;
+    const size_t       m_mask;
+
+    alignas(64) std::atomic<uint64_t> m_write_o {0};
+    std::atomic<uint64_t>             m_skip_to_o {0}; // producer-requested read position (flush)
+    alignas(64) std::atomic<uint64_t> m_read_o {0};
+
+public:
+    explicit SampleRing(size_t capacity) : m_mask(capacity - 1)
+    {
+        if ((capacity & m_mask) != 0)
+        {
+            throw std::invalid_argument("Size must be power of 2");
+        }
+        m_data.resize(capacity);
+    }
+
+    SampleRing(const SampleRing&)              = delete;
+    SampleRing& operator=(const SampleRing&)   = delete;
+    SampleRing(SampleRing&&)                   = delete;
+    SampleRing& operator=(SampleRing&&)        = delete;
+    auto        operator<=>(const SampleRing&) = delete;
+
+    ~SampleRing() = default;
+
+    // producer: copies up to `count` samples, returns how many fit
+    size_t write(const float* src, size_t count)
+    {
+        const uint64_t w = m_write_o.load(std::memory_order_relaxed);
+        const uint64_t r = m_read_o.load(std::memory_order_acquire);
+        const size_t   n = std::min(count, capacity() - static_cast<size_t>(w - r));
+
+        const size_t index = static_cast<size_t>(w) & m_mask;
+        const size_t first = std::min(n, capacity() - index);
+        std::memcpy(m_data.data() + index, src, first * sizeof(float));
+        std::memcpy(m_data.data(), src + first, (n - first) * sizeof(float));
+
+        m_write_o.store(w + n, std::memory_order_release);
+        return n;
+    }
+
+    // producer: everything written so far is skipped by the next read (after a seek)
+    void discard()
+    {
+        m_skip_to_o.store(m_write_o.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // consumer: copies up to `count` samples, returns how many were available
+    size_t read(float* dst, size_t count)
+    {
+        const uint64_t r = std::max(m_read_o.load(std::memory_order_relaxed),
+                                    m_skip_to_o.load(std::memory_order_acquire));
+        const uint64_t w = m_write_o.load(std::memory_order_acquire);
+        const size_t   n = std::min(count, static_cast<size_t>(w - r));
+
+        const size_t index = static_cast<size_t>(r) & m_mask;
+        const size_t first = std::min(n, capacity() - index);
+        std::memcpy(dst, m_data.data() + index, first * sizeof(float));
+        std::memcpy(dst + first, m_data.data(), (n - first) * sizeof(float));
+
+        m_read_o.store(r + n, std::memory_order_release);
+        return n;
+    }
+
+    [[nodiscard]] size_t available() const
+    {
+        const uint64_t w = m_write_o.load(std::memory_order_acquire);
+        const uint64_t r = std::max(m_read_o.load(std::memory_order_acquire),
+                                    m_skip_to_o.load(std::memory_order_acquire));
+        return static_cast<size_t>(w - r);
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // samples consumed so far; the audio clock is derived from it
+    [[nodiscard]] uint64_t total_read() const
+    {
+        return m_read_o.load(std::memory_order_acquire);
+    }
+};
+
+// Device-callback contract: fill `frames` frames, padding an underrun with silence.
+// No locks, no allocations. Returns the number of frames that carried real samples.
+inline size_t pull_audio(SampleRing& ring, float* out, size_t frames, int channels)
+{
+    const size_t wanted = frames * static_cast<size_t>(channels);
+    const size_t got    = ring.read(out, wanted);
+    std::fill(out + got, out + wanted, 0.0f);
+    return got / static_cast<size_t>(channels);
+}
+
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+
+    virtual bool start(SampleRing& ring, const AudioFormat& format) = 0;
+    virtual void stop()                                             = 0;
+};
+
+// Consumes at real-time rate and discards; keeps the pipeline (and the audio clock)
+// moving on machines without an audio device.
+class NullAudioSink final : public AudioSink
+{
+private:
+    static constexpr auto k_period = std::chrono::milliseconds(10);
+
+    std::vector<float> m_buffer;
+    std::jthread       m_thread;
+
+public:
+    ~NullAudioSink() override
+    {
+        stop();
+    }
+
+    bool start(SampleRing& ring, const AudioFormat& format) override
+    {
+        const size_t frames = static_cast<size_t>(format.sample_rate) * k_period.count() / 1000;
+        m_buffer.resize(frames * static_cast<size_t>(format.channels));
+
+        m_thread = std::jthread(
+            [this, &ring, frames, channels = format.channels](const std::stop_token& st)
+            {
+                auto next = std::chrono::steady_clock::now();
+                while (st.stop_requested() == false)
+                {
+                    pull_audio(ring, m_buffer.data(), frames, channels);
+                    next += k_period;
+                    std::this_thread::sleep_until(next);
+                }
+            });
+        return true;
+    }
+
+    void stop() override
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_thread.join();
+        }
+    }
+};
+
+// Converts decoded frames of any layout/rate/sample format into AudioFormat.
+class AudioResampler
+{
+private:
+    using ptr_swr_ctx_t = std::unique_ptr<SwrContext, swr_context_deleter>;
+
+    ptr_swr_ctx_t      m_ptr_swr_ctx {nullptr};
+    AudioFormat        m_out {};
+    std::vector<float> m_buffer; // grows to the largest frame, then stays
+    int                m_in_rate   = 0;
+    int                m_in_format = -1;
+    AVChannelLayout    m_in_layout {};
+
+public:
+    explicit AudioResampler(const AudioFormat& out) : m_out(out)
+    {
+    }
+
+    AudioResampler(const AudioResampler&)              = delete;
+    AudioResampler& operator=(const AudioResampler&)   = delete;
+    AudioResampler(AudioResampler&&)                   = delete;
+    AudioResampler& operator=(AudioResampler&&)        = delete;
+    auto            operator<=>(const AudioResampler&) = delete;
+
+    ~AudioResampler()
+    {
+        av_channel_layout_uninit(&m_in_layout);
+    }
+
+    // Converts one frame (or drains the resampler when frame is null). Returns the number of
+    // output frames now at data(), or a negative AVERROR.
+    int convert(const AVFrame* frame)
+    {
+        if (frame != nullptr && !configure(frame))
+        {
+            return AVERROR(EINVAL);
+        }
+        if (m_ptr_swr_ctx == nullptr)
+        {
+            return 0;
+        }
+
+        const int in_count  = frame != nullptr ? frame->nb_samples : 0;
+        const int out_count = swr_get_out_samples(m_ptr_swr_ctx.get(), in_count);
+        if (out_count <= 0)
+        {
+            return out_count;
+        }
+
+        const size_t needed = static_cast<size_t>(out_count) * static_cast<size_t>(m_out.channels);
+        if (m_buffer.size() < needed)
+        {
+            m_buffer.resize(needed);
+        }
+
+        uint8_t* out[1] = {reinterpret_cast<uint8_t*>(m_buffer.data())};
+        return swr_convert(m_ptr_swr_ctx.get(),
+                           out,
+                           out_count,
+                           frame != nullptr ? const_cast<const uint8_t**>(frame->extended_data) : nullptr,
+                           in_count);
+    }
+
+    [[nodiscard]] const float* data() const
+    {
+        return m_buffer.data();
+    }
+
+    // drops buffered input (after a seek); the next frame re-creates the context
+    void reset()
+    {
+        m_ptr_swr_ctx.reset();
+    }
+
+private:
+    bool configure(const AVFrame* frame)
+    {
+        if (m_ptr_swr_ctx != nullptr && frame->sample_rate == m_in_rate && frame->format == m_in_format
+            && av_channel_layout_compare(&frame->ch_layout, &m_in_layout) == 0)
+        {
+            return true;
+        }
+
+        AVChannelLayout out_layout {};
+        av_channel_layout_default(&out_layout, m_out.channels);
+
+        SwrContext* raw = nullptr;
+        const int   ret = swr_alloc_set_opts2(&raw,
+                                            &out_layout,
+                                            AV_SAMPLE_FMT_FLT,
+                                            m_out.sample_rate,
+                                            &frame->ch_layout,
+                                            static_cast<AVSampleFormat>(frame->format),
+                                            frame->sample_rate,
+                                            0,
+                                            nullptr);
+        av_channel_layout_uninit(&out_layout);
+        m_ptr_swr_ctx.reset(raw);
+        if (ret < 0 || swr_init(m_ptr_swr_ctx.get()) < 0)
+        {
+            std::print(stderr, "[Audio] could not configure resampler\n");
+            m_ptr_swr_ctx.reset();
+            return false;
+        }
+
+        m_in_rate   = frame->sample_rate;
+        m_in_format = frame->format;
+        av_channel_layout_uninit(&m_in_layout);
+        av_channel_layout_copy(&m_in_layout, &frame->ch_layout);
+        return true;
+    }
+};
+
+// Audio stage after the audio Decoder: resamples frames into a SampleRing
+// that an AudioSink drains from its own (callback) thread.
+class AudioOutput
+{
+private:
+    static constexpr size_t k_ring_samples = 1 << 16; // ~0.68 s of 48 kHz stereo
+
+    QueueAtomic<ptr_frame_t>& m_frame_queue;
+    AudioSink&                m_sink;
+    AudioFormat               m_format;
+    SampleRing                m_ring {k_ring_samples};
+    AudioResampler            m_resampler;
+    MediaClock*               m_clock          = nullptr;
+    const SerialCounter*      m_serial         = nullptr;
+    int64_t                   m_current_serial = 0;
+    double                    m_next_pts       = std::numeric_limits<double>::quiet_NaN(); // end of last write
+    std::jthread              m_thread;
+    std::atomic<bool>         m_finished_o {false};
+
+public:
+    // `clock` (optional) is kept at the pts of the sample the sink is about to play.
+    explicit AudioOutput(QueueAtomic<ptr_frame_t>& fq,
+                         AudioSink&                sink,
+                         AudioFormat               format = {},
+                         MediaClock*               clock  = nullptr)
+        : m_frame_queue(fq), m_sink(sink), m_format(format), m_resampler(format), m_clock(clock)
+    {
+    }
+
+    AudioOutput(const AudioOutput&)             = delete;
+    AudioOutput operator=(const AudioOutput&)   = delete;
+    AudioOutput(AudioOutput&&)                  = delete;
+    AudioOutput operator=(AudioOutput&&)        = delete;
+    auto        operator<=>(const AudioOutput&) = delete;
+
+    ~AudioOutput()
+    {
+        stop();
+    }
+
+    // Frames of older seek generations are dropped; a flush empties the ring. Call before run().
+    void follow(const SerialCounter& serial)
+    {
+        m_serial         = &serial;
+        m_current_serial = serial.current();
+    }
+
+    void run()
+    {
+        if (m_thread.joinable())
+        {
+            std::print(stderr, "[Audio] already running, run() skipped\n");
+            return;
+        }
+        if (!m_sink.start(m_ring, m_format))
+        {
+            std::print(stderr, "[Audio] sink failed to start, run() skipped\n");
+            return;
+        }
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                task(st);
+            });
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_frame_queue.close();
+            m_thread.join();
+        }
+        m_sink.stop();
+    }
+
+    // end of stream (or upstream closed) and every sample has been handed to the sink
+    [[nodiscard]] bool finished() const
+    {
+        return m_finished_o.load(std::memory_order_acquire) && m_ring.available() == 0;
+    }
+
+    [[nodiscard]] const SampleRing& ring() const
+    {
+        return m_ring;
+    }
+
+    [[nodiscard]] const AudioFormat& format() const
+    {
+        return m_format;
+    }
+
+private:
+    [[nodiscard]] bool stale(int64_t serial) const
+    {
+        return m_serial != nullptr && serial != m_serial->current();
+    }
+
+    // The pts (seconds) right after the last converted sample, minus what the sink has not
+    // read yet. `unwritten`: samples of the current frame still waiting for room in the ring,
+    // which m_next_pts already counts.
+    void update_clock(size_t unwritten = 0)
+    {
+        if (m_clock == nullptr || std::isnan(m_next_pts) || stale(m_current_serial))
+        {
+            return;
+        }
+        const double queued = static_cast<double>(m_ring.available() + unwritten)
+                            / (static_cast<double>(m_format.channels) * m_format.sample_rate);
+        m_clock->set(m_next_pts - queued);
+    }
+
+    void advance_pts(const AVFrame* frame, int frames)
+    {
+        if (frame != nullptr && frame->pts != AV_NOPTS_VALUE && frame->time_base.num > 0)
+        {
+            m_next_pts = static_cast<double>(frame->pts) * av_q2d(frame->time_base);
+        }
+        if (!std::isnan(m_next_pts))
+        {
+            m_next_pts += static_cast<double>(frames) / m_format.sample_rate;
+        }
+    }
+
+    // Blocks (by sleeping, the sink never signals) until every sample is in the ring.
+    bool write_all(const float* src, size_t count, const std::stop_token& st)
+    {
+        while (count > 0)
+        {
+            const size_t written = m_ring.write(src, count);
+            src += written;
+            count -= written;
+            if (count == 0)
+            {
+                break;
+            }
+            if (st.stop_requested() || stale(m_current_serial))
+            {
+                return false; // stopped, or seeked away from these samples
+            }
+            update_clock(count);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        update_clock();
+        return true;
+    }
+
+    // samples still buffered inside the resampler
+    void drain(const std::stop_token& st)
+    {
+        const int frames = m_resampler.convert(nullptr);
+        if (frames > 0)
+        {
+            const size_t samples = static_cast<size_t>(frames) * static_cast<size_t>(m_format.channels);
+            advance_pts(nullptr, frames);
+            write_all(m_resampler.data(), samples, st);
+        }
+    }
+
+    void on_flush(int64_t serial)
+    {
+        m_current_serial = serial;
+        m_finished_o.store(false, std::memory_order_release);
+        m_resampler.reset();
+        m_ring.discard();
+        m_next_pts = std::numeric_limits<double>::quiet_NaN();
+        if (m_clock != nullptr)
+        {
+            m_clock->reset(); // video follows the external clock until new samples arrive
+        }
+    }
+
+    void task(const std::stop_token& st)
+    {
+        LITEP_TRACE_THREAD("audio output");
+        const auto channels = static_cast<size_t>(m_format.channels);
+
+        while (st.stop_requested() == false)
+        {
+            auto frame_opt = m_frame_queue.pop();
+            if (frame_opt == std::nullopt)
+            {
+                break; // upstream closed
+            }
+
+            const AVFrame* frame = frame_opt->get();
+            if (is_flush(frame))
+            {
+                on_flush(serial_of(frame));
+                continue;
+            }
+            if (stale(serial_of(frame)))
+            {
+                continue; // queued before a seek
+            }
+            if (is_eof(frame))
+            {
+                drain(st); // play out the tail; a later seek starts a new generation
+                m_finished_o.store(true, std::memory_order_release);
+                continue;
+            }
+
+            const int frames = m_resampler.convert(frame);
+            if (frames <= 0)
+            {
+                continue;
+            }
+            advance_pts(frame, frames);
+            write_all(m_resampler.data(), static_cast<size_t>(frames) * channels, st);
+        }
+
+        drain(st);
+        m_finished_o.store(true, std::memory_order_release);
+    }
+};
@@ -0,0 +1,489 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <print>
+#include <string_view>
+#include <vector>
+
+// A GL 3.3 core context without a window or display server: EGL on Mesa's surfaceless
+// platform when it is there (llvmpipe on CI / render farm machines), otherwise the default
+// display with a pbuffer. Everything renders into a RenderTarget, not a default framebuffer.
+class OffscreenContext
+{
+private:
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+    EGLSurface m_surface = EGL_NO_SURFACE; // only without EGL_KHR_surfaceless_context
+    bool       m_ready   = false;
+
+public:
+    OffscreenContext()
+    {
+        m_ready = init();
+        if (!m_ready)
+        {
+            std::print(stderr, "[Offscreen] no EGL context (eglGetError 0x{:x})\n", eglGetError());
+            cleanup();
+        }
+    }
+
+    OffscreenContext(const OffscreenContext&)             = delete;
+    OffscreenContext operator=(const OffscreenContext&)   = delete;
+    OffscreenContext(OffscreenContext&&)                  = delete;
+    OffscreenContext operator=(OffscreenContext&&)        = delete;
+    auto             operator<=>(const OffscreenContext&) = delete;
+
+    ~OffscreenContext()
+    {
+        cleanup();
+    }
+
+    // current on the constructing thread, GL functions loaded
+    [[nodiscard]] bool ok() const
+    {
+        return m_ready;
+    }
+
+    // e.g. "Mesa/llvmpipe (LLVM 15.0.7, 256 bits)", for reports
+    [[nodiscard]] static std::string_view renderer_name()
+    {
+        const auto* name = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        return name != nullptr ? name : "";
+    }
+
+private:
+    static bool has_extension(const char* list, std::string_view name)
+    {
+        for (std::string_view rest = list != nullptr ? list : ""; !rest.empty();)
+        {
+            const size_t end = rest.find(' ');
+            if (rest.substr(0, end) == name)
+            {
+                return true;
+            }
+            rest = end == std::string_view::npos ? std::string_view {} : rest.substr(end + 1);
+        }
+        return false;
+    }
+
+    bool init()
+    {
+        // client extensions: queried without a display
+        const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+#if defined(EGL_PLATFORM_SURFACELESS_MESA)
+        if (has_extension(client, "EGL_MESA_platform_surfaceless"))
+        {
+            auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (get_platform_display != nullptr)
+            {
+                m_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            }
+        }
+#endif
+        if (m_display == EGL_NO_DISPLAY)
+        {
+            m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        if (m_display == EGL_NO_DISPLAY || eglInitialize(m_display, nullptr, nullptr) == EGL_FALSE)
+        {
+            m_display = EGL_NO_DISPLAY;
+            return false;
+        }
+        if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE)
+        {
+            return false;
+        }
+
+        const char*  display_ext = eglQueryString(m_display, EGL_EXTENSIONS);
+        const bool   surfaceless = has_extension(display_ext, "EGL_KHR_surfaceless_context");
+        const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                         surfaceless ? 0 : EGL_PBUFFER_BIT,
+                                         EGL_RENDERABLE_TYPE,
+                                         EGL_OPENGL_BIT,
+                                         EGL_RED_SIZE,
+                                         8,
+                                         EGL_GREEN_SIZE,
+                                         8,
+                                         EGL_BLUE_SIZE,
+                                         8,
+                                         EGL_ALPHA_SIZE,
+                                         8,
+                                         EGL_NONE};
+
+        EGLConfig config = nullptr;
+        EGLint    count  = 0;
+        if (eglChooseConfig(m_display, config_attribs, &config, 1, &count) == EGL_FALSE || count == 0)
+        {
+            return false;
+        }
+
+        // same version and profile as the window (open_window in main.cpp)
+        const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                          3,
+                                          EGL_CONTEXT_MINOR_VERSION,
+                                          3,
+                                          EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                          EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                          EGL_NONE};
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (m_context == EGL_NO_CONTEXT)
+        {
+            return false;
+        }
+
+        if (!surfaceless)
+        {
+            const EGLint pbuffer_attribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE}; // never drawn to
+            m_surface                      = eglCreatePbufferSurface(m_display, config, pbuffer_attribs);
+            if (m_surface == EGL_NO_SURFACE)
+            {
+                return false;
+            }
+        }
+        if (eglMakeCurrent(m_display, m_surface, m_surface, m_context) == EGL_FALSE)
+        {
+            return false;
+        }
+        if (gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)) == 0)
+        {
+            std::print(stderr, "[Offscreen] gladLoadGLLoader failed\n");
+            return false;
+        }
+        return true;
+    }
+
+    void cleanup()
+    {
+        if (m_display == EGL_NO_DISPLAY)
+        {
+            return;
+        }
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_surface != EGL_NO_SURFACE)
+        {
+            eglDestroySurface(m_display, m_surface);
+            m_surface = EGL_NO_SURFACE;
+        }
+        if (m_context != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(m_display, m_context);
+            m_context = EGL_NO_CONTEXT;
+        }
+        eglTerminate(m_display);
+        eglReleaseThread();
+        m_display = EGL_NO_DISPLAY;
+        m_ready   = false;
+    }
+};
+
+// RGBA8 color target of a fixed size; bind() before drawing, the Renderer draws into it
+// exactly as into a window.
+class RenderTarget
+{
+private:
+    GLuint m_fbo     = 0;
+    GLuint m_texture = 0;
+    int    m_width   = 0;
+    int    m_height  = 0;
+    bool   m_ready   = false;
+
+public:
+    // GL thread
+    RenderTarget(int w, int h) : m_width(w), m_height(h)
+    {
+        m_ready = init();
+    }
+
+    RenderTarget(const RenderTarget&)             = delete;
+    RenderTarget operator=(const RenderTarget&)   = delete;
+    RenderTarget(RenderTarget&&)                  = delete;
+    RenderTarget operator=(RenderTarget&&)        = delete;
+    auto         operator<=>(const RenderTarget&) = delete;
+
+    ~RenderTarget()
+    {
+        cleanup();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_ready;
+    }
+
+    [[nodiscard]] int width() const
+    {
+        return m_width;
+    }
+
+    [[nodiscard]] int height() const
+    {
+        return m_height;
+    }
+
+    // draws and reads (glReadPixels) go to this target, viewport covers it
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_width, m_height);
+    }
+
+    // Releases the GL objects; call while the context is still current.
+    void shutdown()
+    {
+        cleanup();
+    }
+
+private:
+    bool init()
+    {
+        if (m_width <= 0 || m_height <= 0)
+        {
+            return false;
+        }
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+        const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::print(stderr, "[Offscreen] framebuffer incomplete 0x{:x}\n", status);
+            cleanup();
+            return false;
+        }
+        return true;
+    }
+
+    void cleanup()
+    {
+        if (m_fbo != 0)
+        {
+            glDeleteFramebuffers(1, &m_fbo);
+            m_fbo = 0;
+        }
+        if (m_texture != 0)
+        {
+            glDeleteTextures(1, &m_texture);
+            m_texture = 0;
+        }
+        m_ready = false;
+    }
+};
+
+// A finished readback: tightly packed RGBA rows, bottom row first (GL's origin).
+// Only valid inside the FrameReadback::collect() callback.
+struct ReadbackFrame
+{
+    int64_t        tag    = 0; // what request() was given, e.g. the frame number
+    int            width  = 0;
+    int            height = 0;
+    const uint8_t* rgba   = nullptr;
+
+    [[nodiscard]] size_t bytes() const
+    {
+        return static_cast<size_t>(width) * height * 4;
+    }
+
+    // top-left origin, like the source frame
+    [[nodiscard]] const uint8_t* pixel(int x, int y) const
+    {
+        return rgba + (static_cast<size_t>(height - 1 - y) * width + x) * 4;
+    }
+};
+
+// Asynchronous glReadPixels of the bound framebuffer.
+//
+//   request(): glReadPixels into a free pixel pack buffer -> fence   (returns at once)
+//   collect(): fence signaled -> map -> callback -> slot free again
+//
+// With a few slots in flight the GPU is never waited on for the frame just drawn,
+// so reading back every frame costs about what the copy itself costs.
+class FrameReadback
+{
+private:
+    struct Slot
+    {
+        GLuint  pbo   = 0;
+        GLsync  fence = nullptr;
+        int64_t tag   = 0;
+    };
+
+    std::vector<Slot> m_slots;
+    std::deque<int>   m_in_flight; // oldest first
+    std::vector<int>  m_free;
+    int               m_width  = 0;
+    int               m_height = 0;
+
+public:
+    // GL thread
+    FrameReadback(int w, int h, int slot_count = 3) : m_width(w), m_height(h)
+    {
+        const auto bytes = static_cast<GLsizeiptr>(w) * h * 4;
+        m_slots.resize(std::max(slot_count, 1));
+        for (int i = 0; i < static_cast<int>(m_slots.size()); ++i)
+        {
+            glGenBuffers(1, &m_slots[i].pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            m_free.push_back(i);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    FrameReadback(const FrameReadback&)             = delete;
+    FrameReadback operator=(const FrameReadback&)   = delete;
+    FrameReadback(FrameReadback&&)                  = delete;
+    FrameReadback operator=(FrameReadback&&)        = delete;
+    auto          operator<=>(const FrameReadback&) = delete;
+
+    ~FrameReadback()
+    {
+        cleanup();
+    }
+
+    [[nodiscard]] size_t in_flight() const
+    {
+        return m_in_flight.size();
+    }
+
+    // Queues a copy of the bound read framebuffer. false when every slot is still in flight:
+    // collect() first.
+    bool request(int64_t tag)
+    {
+        if (m_free.empty())
+        {
+            return false;
+        }
+        const int index = m_free.back();
+        m_free.pop_back();
+        Slot& slot = m_slots[index];
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        // with a bound pack buffer the pointer argument is an offset into it
+        glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.tag   = tag;
+        m_in_flight.push_back(index);
+        return true;
+    }
+
+    // Hands finished readbacks, oldest first, to on_frame(const ReadbackFrame&).
+    // wait: block until every queued one is done (end of a run). Returns how many.
+    template <typename F>
+    int collect(F&& on_frame, bool wait = false)
+    {
+        int done = 0;
+        while (!m_in_flight.empty())
+        {
+            Slot&        slot   = m_slots[m_in_flight.front()];
+            const GLenum status = glClientWaitSync(
+                slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1'000'000'000 : 0);
+            if (status == GL_TIMEOUT_EXPIRED && !wait)
+            {
+                break; // later slots were fenced later
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            const auto  bytes = static_cast<GLsizeiptr>(m_width) * m_height * 4;
+            const auto* data
+                = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+            if (data != nullptr && status != GL_WAIT_FAILED)
+            {
+                on_frame(ReadbackFrame {.tag = slot.tag, .width = m_width, .height = m_height, .rgba = data});
+                ++done;
+            }
+            else
+            {
+                std::print(stderr, "[Offscreen] readback of {} failed\n", slot.tag);
+            }
+            if (data != nullptr)
+            {
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            m_free.push_back(m_in_flight.front());
+            m_in_flight.pop_front();
+        }
+        return done;
+    }
+
+    // Releases the GL objects; call while the context is still current.
+    void shutdown()
+    {
+        cleanup();
+    }
+
+private:
+    void cleanup()
+    {
+        for (Slot& slot : m_slots)
+        {
+            if (slot.fence != nullptr)
+            {
+                glDeleteSync(slot.fence);
+            }
+            if (slot.pbo != 0)
+            {
+                glDeleteBuffers(1, &slot.pbo);
+            }
+        }
+        m_slots.clear();
+        m_in_flight.clear();
+        m_free.clear();
+    }
+};
+
+// FNV-1a over the pixels: identical output on the same driver gives the same value,
+// so a changed checksum flags a changed render (compare per driver, not across them).
+inline uint64_t readback_checksum(const ReadbackFrame& frame)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < frame.bytes(); ++i)
+    {
+        hash = (hash ^ frame.rgba[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// binary PPM (alpha dropped), top row first
+inline bool write_ppm(const char* path, const ReadbackFrame& frame)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        std::print(stderr, "[Offscreen] could not write {}\n", path);
+        return false;
+    }
+    std::print(file, "P6\n{} {}\n255\n", frame.width, frame.height);
+    std::vector<uint8_t> row(static_cast<size_t>(frame.width) * 3);
+    for (int y = 0; y < frame.height; ++y)
+    {
+        for (int x = 0; x < frame.width; ++x)
+        {
+            std::memcpy(row.data() + static_cast<size_t>(x) * 3, frame.pixel(x, y), 3);
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+extern "C"
+{
+#include "libavutil/pixdesc.h"
+}
+
+#include <array>
+#include <cstddef>
+
+struct PlaneUpload
+{
+    size_t offset           = 0; // byte offset inside a packed upload buffer
+    int    width            = 0; // in texels
+    int    height           = 0;
+    int    channels         = 1; // 1: R, 2: interleaved RG (NV12/P010 chroma)
+    int    bytes_per_sample = 1; // 2 for > 8-bit formats, sampled from R16/RG16
+    int    row_bytes        = 0; // packed rows, no padding
+};
+
+// How one AVPixelFormat maps onto GL textures. Derived from the pixel format descriptor,
+// so chroma sizes are rounded up (odd widths keep their last chroma column).
+struct PlaneLayout
+{
+    int                        format = AV_PIX_FMT_NONE;
+    int                        width  = 0;
+    int                        height = 0;
+    std::array<PlaneUpload, 3> planes {};
+    int                        plane_count  = 0;
+    size_t                     total_bytes  = 0;
+    bool                       swap_uv      = false; // interleaved chroma stored V first (NV21)
+    float                      sample_scale = 1.0f;  // normalized sample -> [0, 1]
+
+    [[nodiscard]] bool valid() const
+    {
+        return plane_count > 0;
+    }
+
+    [[nodiscard]] bool semi_planar() const
+    {
+        return plane_count == 2;
+    }
+};
+
+// Planar (3-plane) or semi-planar (2-plane) little-endian YUV up to 16 bits;
+// anything else returns an invalid layout and has to be converted upstream.
+inline PlaneLayout plane_layout(int format, int w, int h)
+{
+    PlaneLayout layout;
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(format));
+    if (desc == nullptr || w <= 0 || h <= 0)
+    {
+        return layout;
+    }
+
+    constexpr uint64_t unsupported = AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM
+                                   | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB;
+    if ((desc->flags & unsupported) != 0 || desc->nb_components < 3)
+    {
+        return layout;
+    }
+
+    const int plane_count = av_pix_fmt_count_planes(static_cast<AVPixelFormat>(format));
+    if (plane_count != 2 && plane_count != 3)
+    {
+        return layout;
+    }
+
+    const AVComponentDescriptor& luma = desc->comp[0];
+    if (luma.depth > 16 || luma.plane != 0)
+    {
+        return layout;
+    }
+
+    const int bytes_per_sample = luma.depth > 8 ? 2 : 1;
+    size_t    offset           = 0;
+
+    for (int p = 0; p < plane_count; ++p)
+    {
+        // the components stored in plane p, in any order (NV21 keeps V before U)
+        int channels = 0;
+        int step     = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            const AVComponentDescriptor& comp = desc->comp[c];
+            if (comp.plane != p)
+            {
+                continue;
+            }
+            if ((step != 0 && comp.step != step) || comp.depth != luma.depth || comp.shift != luma.shift)
+            {
+                return PlaneLayout {};
+            }
+            step = comp.step;
+            ++channels;
+        }
+        if (channels == 0 || channels > 2 || step != channels * bytes_per_sample)
+        {
+            return PlaneLayout {};
+        }
+
+        PlaneUpload& plane     = layout.planes[p];
+        plane.offset           = offset;
+        plane.width            = p == 0 ? w : AV_CEIL_RSHIFT(w, desc->log2_chroma_w);
+        plane.height           = p == 0 ? h : AV_CEIL_RSHIFT(h, desc->log2_chroma_h);
+        plane.channels         = channels;
+        plane.bytes_per_sample = bytes_per_sample;
+        plane.row_bytes        = plane.width * channels * bytes_per_sample;
+        offset += static_cast<size_t>(plane.row_bytes) * plane.height;
+    }
+
+    layout.format      = format;
+    layout.width       = w;
+    layout.height      = h;
+    layout.plane_count = plane_count;
+    layout.total_bytes = offset;
+    layout.swap_uv     = plane_count == 2 && desc->comp[1].offset > desc->comp[2].offset;
+
+    // R16 normalizes to value / 65535; undo that for 10/12-bit samples, MSB-aligned (P010) or not
+    if (bytes_per_sample == 2)
+    {
+        const double max_code = static_cast<double>(((1 << luma.depth) - 1) << luma.shift);
+        layout.sample_scale   = static_cast<float>(65535.0 / max_code);
+    }
+    return layout;
+}
@@ -0,0 +1,466 @@
+#pragma once
+
+#include "glad/glad.h"
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libavutil/rational.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+
+#include "../engine/serial.h"
+#include "../logic/clock.h"
+#include "../utils/trace.h"
+#include "./upload.h"
+#include "./video.h"
+
+// Display refresh seen from the render thread. With a swap interval of 1, glfwSwapBuffers
+// returns right after a vsync, so the spacing of swap returns is the refresh interval
+// (or a multiple of it, when a swap missed one). Smoothed, so one late wakeup does not move it.
+class VsyncEstimator
+{
+private:
+    static constexpr double k_min_interval = 1.0 / 360.0;
+    static constexpr double k_max_interval = 1.0 / 20.0;
+    static constexpr double k_alpha        = 0.05; // weight of one new measurement
+    static constexpr double k_tolerance    = 0.25; // of the interval; beyond this a gap is not a whole refresh count
+
+    double   m_interval;
+    double   m_last   = std::numeric_limits<double>::quiet_NaN();
+    uint64_t m_missed = 0;
+
+public:
+    // `nominal`: the monitor's advertised refresh interval, used until swaps have been measured
+    explicit VsyncEstimator(double nominal = 1.0 / 60.0)
+        : m_interval(std::clamp(nominal, k_min_interval, k_max_interval))
+    {
+    }
+
+    VsyncEstimator(const VsyncEstimator&)              = delete;
+    VsyncEstimator& operator=(const VsyncEstimator&)   = delete;
+    VsyncEstimator(VsyncEstimator&&)                   = delete;
+    VsyncEstimator& operator=(VsyncEstimator&&)        = delete;
+    auto            operator<=>(const VsyncEstimator&) = delete;
+
+    ~VsyncEstimator() = default;
+
+    // after each swap returned
+    void swapped(double now = clock_now_seconds())
+    {
+        if (!std::isnan(m_last))
+        {
+            const double  gap       = now - m_last;
+            const int64_t refreshes = std::llround(gap / m_interval);
+            if (refreshes >= 1)
+            {
+                const double period = gap / static_cast<double>(refreshes);
+                if (std::fabs(period - m_interval) < k_tolerance * m_interval)
+                {
+                    m_interval = std::clamp(
+                        m_interval + k_alpha * (period - m_interval), k_min_interval, k_max_interval);
+                    m_missed += static_cast<uint64_t>(refreshes - 1);
+                }
+            }
+        }
+        m_last = now;
+    }
+
+    [[nodiscard]] double interval() const
+    {
+        return m_interval;
+    }
+
+    // first refresh after `now`
+    [[nodiscard]] double next(double now = clock_now_seconds()) const
+    {
+        if (std::isnan(m_last))
+        {
+            return now + m_interval;
+        }
+        double at = m_last + m_interval;
+        if (at <= now)
+        {
+            at += std::ceil((now - at) / m_interval) * m_interval;
+        }
+        return at;
+    }
+
+    // refreshes that passed without a swap
+    [[nodiscard]] uint64_t missed() const
+    {
+        return m_missed;
+    }
+};
+
+// How many refreshes each frame stays on screen when the frame rate is not the refresh rate.
+// The ratio is spread evenly with the remainder carried over (24 fps at 60 Hz: 3,2,3,2...,
+// 25 fps at 60 Hz: 3,2,3,2,2...), instead of switching whenever the clock crosses a refresh:
+// a master clock jittering around a boundary turns 3:2 into 3:3:2:2, which reads as judder.
+// The plan only holds while it agrees with the clock to within a refresh.
+class CadencePlanner
+{
+private:
+    static constexpr double k_max_error = 1.0; // refreshes
+
+    double m_carry    = 0.0; // refreshes owed to (> 0) or borrowed from (< 0) the next frames
+    double m_shown_at = std::numeric_limits<double>::quiet_NaN();
+    double m_hold     = 0.0; // refreshes planned for the frame on screen
+
+public:
+    CadencePlanner() = default;
+
+    CadencePlanner(const CadencePlanner&)              = delete;
+    CadencePlanner& operator=(const CadencePlanner&)   = delete;
+    CadencePlanner(CadencePlanner&&)                   = delete;
+    CadencePlanner& operator=(CadencePlanner&&)        = delete;
+    auto            operator<=>(const CadencePlanner&) = delete;
+
+    ~CadencePlanner() = default;
+
+    // A new frame went up at the refresh `at`. `on_plan`: it was the planned switch, so the
+    // carry is kept; otherwise the cadence restarts from this frame.
+    void shown(double at, double frame_duration, double interval, bool on_plan = true)
+    {
+        const double exact = frame_duration / interval + (on_plan ? m_carry : 0.0);
+        m_hold             = std::max(1.0, std::round(exact));
+        m_carry            = std::clamp(exact - m_hold, -1.0, 1.0);
+        m_shown_at         = at;
+    }
+
+    // a frame has been shown since the last reset()
+    [[nodiscard]] bool active() const
+    {
+        return !std::isnan(m_shown_at);
+    }
+
+    [[nodiscard]] bool planned(double deadline, double interval) const
+    {
+        return active() && std::round((deadline - m_shown_at) / interval) >= m_hold;
+    }
+
+    // past the planned refresh: the next frame was not ready in time
+    [[nodiscard]] bool overdue(double deadline, double interval) const
+    {
+        return active() && std::round((deadline - m_shown_at) / interval) > m_hold;
+    }
+
+    // Whether the next frame goes up at the refresh `deadline`. `error`: its pts minus the
+    // master clock at that refresh, in refreshes (> 0: early).
+    [[nodiscard]] bool switch_at(double deadline, double interval, double error) const
+    {
+        if (!active())
+        {
+            return error <= 0.5; // no plan yet: nearest refresh
+        }
+        if (planned(deadline, interval))
+        {
+            return error <= k_max_error; // unless it is more than a refresh early
+        }
+        return error <= -k_max_error; // off plan only when it would be more than a refresh late
+    }
+
+    void reset()
+    {
+        m_carry    = 0.0;
+        m_shown_at = std::numeric_limits<double>::quiet_NaN();
+        m_hold     = 0.0;
+    }
+};
+
+struct PresentStats
+{
+    uint64_t swaps         = 0;
+    uint64_t shown         = 0; // new frames put on screen
+    uint64_t repeated      = 0; // swaps that showed the previous frame again
+    uint64_t superseded    = 0; // released unshown: a newer ready frame matched the refresh better
+    uint64_t off_cadence   = 0; // frames put up at another refresh than planned, to follow the clock
+    uint64_t late          = 0; // frames not ready by their planned refresh
+    uint64_t missed_vsyncs = 0; // refreshes that passed without a swap
+};
+
+// A frame that reached the screen with the last render().
+struct PresentedFrame
+{
+    int64_t serial = 0;
+    double  pts    = std::numeric_limits<double>::quiet_NaN(); // seconds, NaN if the frame had none
+    int64_t stamp  = 0;
+};
+
+// Triple-buffered presentation at display rate, on the render thread.
+//
+//   collect(): filled upload slots -> pacer (drop if already late) -> ready set (at most `depth`)
+//   render():  the newest ready frame due at the coming refresh is drawn; older ones are
+//              retired right away, so their slots go back to the copy worker and the decoder
+//              keeps going; with nothing new the last picture is drawn again
+//   swapped(): swap return times feed the refresh estimate that the next deadline comes from
+//
+// In smooth mode frames switch on a planned cadence (see CadencePlanner), corrected by the
+// master clock when they drift a refresh apart. Waiting for frames stops at upload_by(), which
+// leaves room for the measured upload + draw time before the refresh.
+//
+// Popping frames and swapping never wait on each other: a slow swap leaves frames in the ready
+// set, a decode hiccup leaves the previous picture on screen for another refresh.
+// Give the uploader at least one slot more than `depth`, otherwise its worker idles while the set is full.
+class FramePresenter
+{
+private:
+    struct Ready
+    {
+        int     index  = 0; // upload slot
+        int64_t serial = 0;
+        double  pts    = std::numeric_limits<double>::quiet_NaN();
+    };
+
+    PboUploader&         m_uploader;
+    VideoPacer&          m_pacer;
+    SyncClock&           m_clock;
+    PacingMode           m_mode;
+    AVRational           m_time_base;
+    size_t               m_depth;
+    const SerialCounter* m_serial   = nullptr;
+    int64_t              m_timeline = -1; // serial of the frames in the ready set
+    std::deque<Ready>    m_ready;         // decode order
+    VsyncEstimator       m_vsync;
+    CadencePlanner       m_cadence;
+    PresentStats         m_stats {};
+    double               m_render_cost = 0.002; // seconds, upload + draw, smoothed
+    bool                 m_has_image   = false;
+
+public:
+    FramePresenter(PboUploader& uploader,
+                   VideoPacer&  pacer,
+                   SyncClock&   clock,
+                   PacingMode   mode,
+                   AVRational   time_base,
+                   double       nominal_interval = 1.0 / 60.0,
+                   size_t       depth            = 3)
+        : m_uploader(uploader),
+          m_pacer(pacer),
+          m_clock(clock),
+          m_mode(mode),
+          m_time_base(time_base),
+          m_depth(std::max<size_t>(depth, 1)),
+          m_vsync(nominal_interval)
+    {
+    }
+
+    FramePresenter(const FramePresenter&)              = delete;
+    FramePresenter& operator=(const FramePresenter&)   = delete;
+    FramePresenter(FramePresenter&&)                   = delete;
+    FramePresenter& operator=(FramePresenter&&)        = delete;
+    auto            operator<=>(const FramePresenter&) = delete;
+
+    ~FramePresenter() = default;
+
+    // Frames of older seek generations are retired without being shown.
+    void follow(const SerialCounter& serial)
+    {
+        m_serial = &serial;
+    }
+
+    [[nodiscard]] double next_vsync(double now = clock_now_seconds()) const
+    {
+        return m_vsync.next(now);
+    }
+
+    [[nodiscard]] double vsync_interval() const
+    {
+        return m_vsync.interval();
+    }
+
+    // Latest time to stop waiting for frames and start rendering for the refresh at `deadline`.
+    [[nodiscard]] double upload_by(double deadline) const
+    {
+        return deadline - std::clamp(2.0 * m_render_cost, 0.002, 0.5 * m_vsync.interval());
+    }
+
+    // Fills the ready set. Waits for a frame until `until` (steady_clock seconds) only while
+    // nothing is due at `deadline`; otherwise takes what the uploader already has.
+    void collect(double deadline, double until)
+    {
+        LITEP_TRACE_SCOPE("present collect");
+        while (m_ready.size() < m_depth)
+        {
+            const auto wait_until = due_index(deadline) == std::nullopt ? clock_time_point(until)
+                                                                        : std::chrono::steady_clock::now();
+            const auto index      = m_uploader.take_ready(wait_until);
+            if (index == std::nullopt)
+            {
+                return;
+            }
+            admit(*index);
+        }
+    }
+
+    // GL thread, once per refresh, before the swap: draws what should be on screen at `deadline`.
+    // Returns the frame if it is a new one.
+    std::optional<PresentedFrame> render(Renderer& renderer, double deadline)
+    {
+        const double                start = clock_now_seconds();
+        const std::optional<size_t> due   = due_index(deadline);
+        if (due == std::nullopt)
+        {
+            if (m_has_image)
+            {
+                renderer.draw();
+                ++m_stats.repeated;
+            }
+            else
+            {
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+            return std::nullopt;
+        }
+
+        for (size_t i = 0; i < *due; ++i)
+        {
+            m_uploader.retire(m_ready.front().index);
+            m_ready.pop_front();
+            ++m_stats.superseded;
+        }
+        const Ready       ready = m_ready.front();
+        const UploadSlot& slot  = m_uploader.slot(ready.index);
+        m_ready.pop_front();
+
+        const PresentedFrame frame {.serial = ready.serial, .pts = ready.pts, .stamp = slot.stamp};
+        renderer.renderSlot(slot);
+        m_uploader.retire(ready.index);
+        m_has_image = true;
+        ++m_stats.shown;
+
+        const bool on_plan = m_cadence.planned(deadline, m_vsync.interval());
+        m_stats.off_cadence += m_cadence.active() && !on_plan ? 1 : 0;
+        m_stats.late += m_cadence.overdue(deadline, m_vsync.interval()) ? 1 : 0;
+        m_cadence.shown(deadline, m_pacer.frame_duration(), m_vsync.interval(), on_plan);
+        m_render_cost += 0.1 * ((clock_now_seconds() - start) - m_render_cost);
+        return frame;
+    }
+
+    void swapped(double now = clock_now_seconds())
+    {
+        m_vsync.swapped(now);
+        ++m_stats.swaps;
+    }
+
+    // the uploader has stopped and every frame it published has been shown or released
+    [[nodiscard]] bool drained() const
+    {
+        return m_ready.empty() && !m_uploader.running_status() && m_uploader.ready_count() == 0;
+    }
+
+    // ready frames held, not shown yet
+    [[nodiscard]] size_t ready_count() const
+    {
+        return m_ready.size();
+    }
+
+    [[nodiscard]] PresentStats stats() const
+    {
+        PresentStats stats  = m_stats;
+        stats.missed_vsyncs = m_vsync.missed();
+        return stats;
+    }
+
+    // Releases the held slots; before PboUploader::shutdown().
+    void clear()
+    {
+        for (const Ready& ready : m_ready)
+        {
+            m_uploader.retire(ready.index);
+        }
+        m_ready.clear();
+    }
+
+private:
+    [[nodiscard]] bool stale(int64_t serial) const
+    {
+        return m_serial != nullptr && serial != m_serial->current();
+    }
+
+    [[nodiscard]] double pts_seconds(const UploadSlot& slot) const
+    {
+        const AVRational tb = slot.time_base.num > 0 && slot.time_base.den > 0 ? slot.time_base : m_time_base;
+        if (slot.pts == AV_NOPTS_VALUE || tb.num <= 0 || tb.den <= 0)
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return static_cast<double>(slot.pts) * av_q2d(tb);
+    }
+
+    void admit(int index)
+    {
+        const UploadSlot& slot = m_uploader.slot(index);
+        if (stale(slot.serial))
+        {
+            m_uploader.retire(index); // decoded before a seek
+            return;
+        }
+        if (slot.serial != m_timeline)
+        {
+            // first frame after a seek: the timeline jumped, start pacing from scratch
+            clear();
+            m_timeline = slot.serial;
+            m_clock.reset();
+            m_pacer.reset();
+            m_cadence.reset();
+        }
+
+        // frames without a usable pts are shown at the next refresh
+        const double pts = pts_seconds(slot);
+        if (!std::isnan(pts))
+        {
+            const size_t        backlog  = m_ready.size() + m_uploader.ready_count();
+            const FrameDecision decision = m_pacer.schedule(pts, clock_now_seconds(), backlog);
+            if (decision.action == FrameAction::Drop)
+            {
+                m_uploader.retire(index); // behind the master: not worth a refresh
+                return;
+            }
+        }
+        m_ready.push_back(Ready {.index = index, .serial = slot.serial, .pts = pts});
+    }
+
+    // The frame for the refresh at `deadline`, nullopt to keep the current one. The front frame
+    // goes up when the cadence says so; frames behind it replace it if the clock says they are
+    // due as well (a frame is on screen from its refresh until the next one, so a frame is due
+    // once its pts is at most half a refresh past the master clock).
+    [[nodiscard]] std::optional<size_t> due_index(double deadline) const
+    {
+        if (m_ready.empty())
+        {
+            return std::nullopt;
+        }
+        const double interval = m_vsync.interval();
+        const double master   = m_clock.master_time(deadline);
+        auto         error    = [&](size_t i)
+        {
+            const double pts = m_ready[i].pts;
+            if (m_mode == PacingMode::Live || std::isnan(pts) || std::isnan(master)
+                || !SyncClock::in_sync_range(pts - master))
+            {
+                return -std::numeric_limits<double>::infinity(); // show now
+            }
+            return (pts - master) / interval;
+        };
+
+        if (!m_cadence.switch_at(deadline, interval, error(0)))
+        {
+            return std::nullopt;
+        }
+        size_t due = 0;
+        while (due + 1 < m_ready.size() && error(due + 1) <= 0.5)
+        {
+            ++due;
+        }
+        return due;
+    }
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+#include "glad/glad.h"
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <print>
+#include <thread>
+#include <vector>
+
+#include "../engine/queue.h"
+#include "../engine/queue_cost.h"
+#include "../engine/serial.h"
+#include "../utils/alias.h"
+#include "../utils/trace.h"
+#include "./pixel_layout.h"
+
+inline bool gl_has_buffer_storage()
+{
+#if defined(GL_ARB_buffer_storage)
+    if (GLAD_GL_ARB_buffer_storage)
+    {
+        return true;
+    }
+#endif
+#if defined(GL_VERSION_4_4)
+    if (GLAD_GL_VERSION_4_4)
+    {
+        return true;
+    }
+#endif
+    return false;
+}
+
+struct UploadSlot
+{
+    GLuint      pbo      = 0;
+    uint8_t*    ptr      = nullptr; // mapped, written by the copy worker
+    size_t      capacity = 0;
+    GLsync      fence    = nullptr;
+    PlaneLayout layout {};
+    ptr_frame_t frame; // set instead when the frame does not fit: uploaded from client memory
+    int64_t     pts       = AV_NOPTS_VALUE;
+    AVRational  time_base = {0, 1};
+    int64_t     serial    = 0; // seek generation of the frame
+    int64_t     stamp     = 0; // pipeline_now_us() when its packet was read, 0 if unknown
+};
+
+// Ring of pixel unpack buffers between a copy worker and the GL thread.
+//
+//   worker:    frame queue -> free slot -> memcpy planes into mapped PBO -> ready
+//   GL thread: ready -> glTexSubImage2D from the PBO -> fence -> (signaled) -> free
+//
+// With GL 4.4 / ARB_buffer_storage the buffers stay persistently (coherently) mapped;
+// otherwise each slot is re-mapped unsynchronized on the GL thread once its fence
+// has signaled. Either way the GL thread never copies pixel data itself.
+class PboUploader
+{
+private:
+    static constexpr int k_max_slots = 4;
+
+    std::vector<UploadSlot>   m_slots;
+    QueueAtomic<ptr_frame_t>& m_frame_queue;
+    QueueAtomic<int>          m_free {8};  // GL thread -> worker
+    QueueAtomic<int>          m_ready {8}; // worker -> GL thread
+    std::deque<int>           m_in_flight; // GL thread only
+    std::jthread              m_thread;
+    const SerialCounter*      m_serial     = nullptr;
+    int                       m_width      = 0;
+    int                       m_height     = 0;
+    int                       m_format     = AV_PIX_FMT_NONE;
+    bool                      m_persistent = false;
+    bool                      m_ready_ok   = false;
+
+public:
+    // Must be constructed on the thread that owns the GL context.
+    // Slots are sized for the stream's declared format; other frames fall back to a direct upload.
+    explicit PboUploader(QueueAtomic<ptr_frame_t>& fq, int w, int h, int format, int slot_count = 3)
+        : m_frame_queue(fq), m_width(w), m_height(h), m_format(format)
+    {
+        m_ready_ok = init(std::min(slot_count, k_max_slots));
+    }
+
+    PboUploader(const PboUploader&)             = delete;
+    PboUploader operator=(const PboUploader&)   = delete;
+    PboUploader(PboUploader&&)                  = delete;
+    PboUploader operator=(PboUploader&&)        = delete;
+    auto        operator<=>(const PboUploader&) = delete;
+
+    ~PboUploader()
+    {
+        stop();
+        cleanup();
+    }
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_ready_ok;
+    }
+
+    [[nodiscard]] bool persistent() const
+    {
+        return m_persistent;
+    }
+
+    // Frames of older seek generations are dropped before they take a slot. Call before run().
+    void follow(const SerialCounter& serial)
+    {
+        m_serial = &serial;
+    }
+
+    void run()
+    {
+        if (!m_ready_ok)
+        {
+            std::print(stderr, "[Upload] not ready, run() skipped\n");
+            return;
+        }
+        if (m_thread.joinable())
+        {
+            std::print(stderr, "[Upload] already running, run() skipped\n");
+            return;
+        }
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                task(st);
+            });
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_free.close();
+            m_ready.close();
+            m_thread.join();
+        }
+    }
+
+    // Releases the GL objects; call while the context is still current.
+    void shutdown()
+    {
+        stop();
+        cleanup();
+    }
+
+    // GL thread: next filled slot, waiting at most until the deadline.
+    std::optional<int> take_ready(queue_deadline_t deadline)
+    {
+        auto index = m_ready.pop_until(deadline);
+        if (index != std::nullopt && !m_persistent)
+        {
+            UploadSlot& slot = m_slots[*index];
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            slot.ptr = nullptr;
+        }
+        return index;
+    }
+
+    // filled slots not taken yet
+    [[nodiscard]] size_t ready_count() const
+    {
+        return m_ready.size();
+    }
+
+    [[nodiscard]] const UploadSlot& slot(int index) const
+    {
+        return m_slots[index];
+    }
+
+    // GL thread: the slot's texture updates have been issued; recycle it once the GPU is done.
+    void retire(int index)
+    {
+        UploadSlot& slot = m_slots[index];
+        slot.frame.reset(); // a direct upload has already copied it
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_in_flight.push_back(index);
+    }
+
+    // GL thread: hand slots whose fence has signaled back to the worker. Call once per frame.
+    void reclaim()
+    {
+        while (!m_in_flight.empty())
+        {
+            UploadSlot&  slot   = m_slots[m_in_flight.front()];
+            const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                break; // later slots were fenced later
+            }
+
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+            if (!m_persistent && !map_slot(slot))
+            {
+                std::print(stderr, "[Upload] could not re-map slot\n");
+                m_in_flight.pop_front();
+                continue;
+            }
+            m_free.try_push(m_in_flight.front()); // never full: capacity exceeds the slot count
+            m_in_flight.pop_front();
+        }
+    }
+
+    // false once the worker has stopped; take_ready() still drains what it published
+    [[nodiscard]] bool running_status() const
+    {
+        return m_ready.running_status();
+    }
+
+private:
+    bool init(int slot_count)
+    {
+        if (m_width <= 0 || m_height <= 0 || slot_count <= 0)
+        {
+            return false;
+        }
+
+        PlaneLayout layout = plane_layout(m_format, m_width, m_height);
+        if (!layout.valid())
+        {
+            layout = plane_layout(AV_PIX_FMT_YUV420P, m_width, m_height);
+        }
+        const size_t bytes = layout.total_bytes;
+        m_persistent       = gl_has_buffer_storage();
+
+        m_slots.resize(slot_count);
+        for (int i = 0; i < slot_count; ++i)
+        {
+            UploadSlot& slot = m_slots[i];
+            slot.capacity    = bytes;
+            glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+
+#if defined(GL_ARB_buffer_storage) || defined(GL_VERSION_4_4)
+            if (m_persistent)
+            {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, flags);
+                slot.ptr = static_cast<uint8_t*>(
+                    glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), flags));
+            }
+#endif
+            if (!m_persistent)
+            {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+                map_slot(slot);
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (slot.ptr == nullptr)
+            {
+                std::print(stderr, "[Upload] could not map pixel buffer\n");
+                cleanup();
+                return false;
+            }
+            m_free.try_push(i);
+        }
+        return true;
+    }
+
+    static bool map_slot(UploadSlot& slot)
+    {
+        // The fence already signaled, so the driver does not need to synchronize the map.
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        slot.ptr = static_cast<uint8_t*>(
+            glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(slot.capacity), flags));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return slot.ptr != nullptr;
+    }
+
+    void cleanup()
+    {
+        for (UploadSlot& slot : m_slots)
+        {
+            if (slot.fence != nullptr)
+            {
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+            }
+            if (slot.pbo != 0)
+            {
+                if (slot.ptr != nullptr)
+                {
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    slot.ptr = nullptr;
+                }
+                glDeleteBuffers(1, &slot.pbo);
+                slot.pbo = 0;
+            }
+        }
+        m_slots.clear();
+        m_in_flight.clear();
+    }
+
+    static void copy_frame(UploadSlot& slot, const AVFrame* frame, const PlaneLayout& layout)
+    {
+        for (int i = 0; i < layout.plane_count; ++i)
+        {
+            const PlaneUpload& plane = layout.planes[i];
+            const uint8_t*     src   = frame->data[i];
+            uint8_t*           dst   = slot.ptr + plane.offset;
+            for (int row = 0; row < plane.height; ++row)
+            {
+                std::memcpy(dst, src, plane.row_bytes);
+                src += frame->linesize[i];
+                dst += plane.row_bytes;
+            }
+        }
+        slot.layout = layout;
+    }
+
+    [[nodiscard]] bool stale(int64_t serial) const
+    {
+        return m_serial != nullptr && serial != m_serial->current();
+    }
+
+    void task(const std::stop_token& st)
+    {
+        LITEP_TRACE_THREAD("upload");
+        while (st.stop_requested() == false)
+        {
+            auto frame_opt = m_frame_queue.pop();
+            if (frame_opt == std::nullopt)
+            {
+                break; // upstream closed
+            }
+
+            auto& frame = *frame_opt;
+            if (is_control(frame.get()) || stale(serial_of(frame.get())))
+            {
+                continue; // markers only matter to decoders; render side tracks slot.serial
+            }
+
+            auto index = m_free.pop();
+            if (index == std::nullopt)
+            {
+                break; // stopped
+            }
+
+            UploadSlot& slot = m_slots[*index];
+            slot.pts         = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp
+                                                                              : frame->pts;
+            slot.time_base   = frame->time_base;
+            slot.serial      = serial_of(frame.get());
+            slot.stamp       = stamp_of(frame.get());
+            const PlaneLayout layout = plane_layout(frame->format, frame->width, frame->height);
+
+            if (layout.valid() && layout.total_bytes <= slot.capacity)
+            {
+                LITEP_TRACE_SCOPE("copy planes");
+                copy_frame(slot, frame.get(), layout);
+                // the source frame goes back to its pool here, not after the GPU upload
+                frame.reset();
+            }
+            else
+            {
+                slot.layout = layout;
+                slot.frame  = std::move(frame);
+            }
+
+            if (m_ready.push(*index) == false)
+            {
+                break;
+            }
+        }
+
+        m_ready.close();
+    }
+};
@@ -7,19 +7,30 @@ extern "C"
 }
 
 #include <print>
+#include <string>
+#include <unordered_map>
+
+#include "../utils/trace.h"
+#include "./pixel_layout.h"
+#include "./upload.h"
 
 class Renderer
 {
 private:
-    int    width         = 0;
-    int    height        = 0;
-    GLuint textures[3]   = {0, 0, 0};
-    GLuint shaderProgram = 0;
-    GLuint VAO = 0, VBO = 0;
-    GLint  texYLoc_ = -1;
-    GLint  texULoc_ = -1;
-    GLint  texVLoc_ = -1;
-    bool   init_ok_ = false;
+    int         width         = 0;
+    int         height        = 0;
+    GLuint      textures[3]   = {0, 0, 0};
+    GLuint      shaderProgram = 0; // program of the current format, owned by programs_
+    GLuint      VAO = 0, VBO = 0;
+    PlaneLayout layout_ {};
+    int         rejectedFormat_ = AV_PIX_FMT_NONE;
+    bool        mipmaps_        = false;
+    bool        init_ok_        = false;
+
+    // shader variants are compiled on first use of a pixel format and kept
+    std::string                     vertSrc_;
+    std::string                     fragSrc_;
+    std::unordered_map<int, GLuint> programs_;
 
 public:
     explicit Renderer(int w, int h, const char* vertSrc, const char* fragSrc)
@@ -48,39 +59,26 @@ public:
         cleanup();
     }
 
-    bool init(int w, int h, const char* vertSrc, const char* fragSrc)
+    // Mipmapped textures, for pictures drawn smaller than the frame (a wall tile): plain linear
+    // filtering skips source pixels and shimmers below half size. Costs a mip build per upload.
+    void setMipmaps(bool on)
     {
-        init_ok_ = false;
-        cleanup();
-
-        width  = w;
-        height = h;
-
-        // YUV texture
-        glGenTextures(3, textures);
-        for (int i = 0; i < 3; ++i)
+        mipmaps_ = on;
+        for (int i = 0; i < layout_.plane_count; ++i)
         {
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, textures[i]);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            if (i == 0)
-            {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-            }
-            else
-            {
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width / 2, height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter());
         }
+    }
 
-        shaderProgram = compileShader(vertSrc, fragSrc);
-        if (shaderProgram == 0)
-        {
-            return false;
-        }
+    bool init(int w, int h, const char* vertSrc, const char* fragSrc)
+    {
+        init_ok_ = false;
+        cleanup();
+
+        vertSrc_ = vertSrc != nullptr ? vertSrc : "";
+        fragSrc_ = fragSrc != nullptr ? fragSrc : "";
 
         // clang-format off
 			float vertices[] = {// pos      // tex
@@ -101,25 +99,72 @@ public:
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
         glBindVertexArray(0);
 
-        // fix sampler binding
-        glUseProgram(shaderProgram);
-        texYLoc_ = glGetUniformLocation(shaderProgram, "texY");
-        texULoc_ = glGetUniformLocation(shaderProgram, "texU");
-        texVLoc_ = glGetUniformLocation(shaderProgram, "texV");
-        if (texYLoc_ >= 0)
+        // most streams are yuv420p; anything else re-prepares on its first frame
+        if (!prepare(AV_PIX_FMT_YUV420P, w, h))
+        {
+            return false;
+        }
+
+        init_ok_ = true;
+        return true;
+    }
+
+    // Makes the textures and shader match a format/size. Cheap when nothing changed.
+    bool prepare(int format, int w, int h)
+    {
+        if (layout_.valid() && layout_.format == format && width == w && height == h)
+        {
+            return true;
+        }
+
+        const PlaneLayout layout = plane_layout(format, w, h);
+        if (!layout.valid())
         {
-            glUniform1i(texYLoc_, 0);
+            if (format != rejectedFormat_)
+            {
+                std::print(stderr, "Renderer: unsupported pixel format {}\n", format);
+                rejectedFormat_ = format;
+            }
+            return false;
         }
-        if (texULoc_ >= 0)
+
+        const GLuint program = programFor(layout);
+        if (program == 0)
         {
-            glUniform1i(texULoc_, 1);
+            return false;
         }
-        if (texVLoc_ >= 0)
+
+        if (textures[0] || textures[1] || textures[2])
         {
-            glUniform1i(texVLoc_, 2);
+            glDeleteTextures(3, textures);
+            textures[0] = textures[1] = textures[2] = 0;
         }
 
-        init_ok_ = true;
+        glGenTextures(layout.plane_count, textures);
+        for (int i = 0; i < layout.plane_count; ++i)
+        {
+            const PlaneUpload& plane = layout.planes[i];
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D,
+                         0,
+                         internalFormat(plane),
+                         plane.width,
+                         plane.height,
+                         0,
+                         pixelFormat(plane),
+                         pixelType(plane),
+                         nullptr);
+        }
+
+        layout_       = layout;
+        width         = w;
+        height        = h;
+        shaderProgram = program;
         return true;
     }
 
@@ -129,34 +174,195 @@ public:
         {
             return;
         }
+        if (uploadFrame(frame))
+        {
+            draw();
+        }
+    }
+
+    // Texture update from a filled pixel buffer slot (see upload.h); no client-memory copy.
+    void renderSlot(const UploadSlot& slot)
+    {
+        if (slot.frame != nullptr)
+        {
+            renderFrame(slot.frame.get());
+            return;
+        }
+        if (uploadSlot(slot))
+        {
+            draw();
+        }
+    }
+
+    bool uploadFrame(const AVFrame* frame)
+    {
+        LITEP_TRACE_SCOPE("upload frame");
+        if (!prepare(frame->format, frame->width, frame->height))
+        {
+            return false;
+        }
 
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
         // FFmpeg 帧可能带有 stride（linesize），按行长度上传更稳妥
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures[0]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[0]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, frame->data[0]);
+        // GL_UNPACK_ROW_LENGTH counts texels, not bytes
+        for (int i = 0; i < layout_.plane_count; ++i)
+        {
+            const PlaneUpload& plane = layout_.planes[i];
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i] / (plane.channels * plane.bytes_per_sample));
+            glTexSubImage2D(GL_TEXTURE_2D,
+                            0,
+                            0,
+                            0,
+                            plane.width,
+                            plane.height,
+                            pixelFormat(plane),
+                            pixelType(plane),
+                            frame->data[i]);
+        }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures[1]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[1]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, frame->data[1]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        buildMipmaps();
+        return true;
+    }
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, textures[2]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[2]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width / 2, height / 2, GL_RED, GL_UNSIGNED_BYTE, frame->data[2]);
+    bool uploadSlot(const UploadSlot& slot)
+    {
+        LITEP_TRACE_SCOPE("upload slot");
+        if (!prepare(slot.layout.format, slot.layout.width, slot.layout.height))
+        {
+            return false;
+        }
 
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0); // slot rows are tightly packed
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+
+        for (int i = 0; i < layout_.plane_count; ++i)
+        {
+            const PlaneUpload& plane = slot.layout.planes[i];
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            // with a bound unpack buffer the pointer argument is an offset into it
+            glTexSubImage2D(GL_TEXTURE_2D,
+                            0,
+                            0,
+                            0,
+                            plane.width,
+                            plane.height,
+                            pixelFormat(plane),
+                            pixelType(plane),
+                            reinterpret_cast<const void*>(plane.offset));
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        buildMipmaps();
+        return true;
+    }
 
+    void draw()
+    {
         glUseProgram(shaderProgram);
+        for (int i = 0; i < layout_.plane_count; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
         glBindVertexArray(VAO);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
         glBindVertexArray(0);
     }
 
 private:
+    GLint minFilter() const
+    {
+        return mipmaps_ ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    }
+
+    void buildMipmaps()
+    {
+        if (!mipmaps_)
+        {
+            return;
+        }
+        for (int i = 0; i < layout_.plane_count; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+    }
+
+    static GLint internalFormat(const PlaneUpload& plane)
+    {
+        if (plane.bytes_per_sample == 2)
+        {
+            return plane.channels == 2 ? GL_RG16 : GL_R16;
+        }
+        return plane.channels == 2 ? GL_RG8 : GL_R8;
+    }
+
+    static GLenum pixelFormat(const PlaneUpload& plane)
+    {
+        return plane.channels == 2 ? GL_RG : GL_RED;
+    }
+
+    static GLenum pixelType(const PlaneUpload& plane)
+    {
+        return plane.bytes_per_sample == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    }
+
+    // One shader variant per pixel format, selected by #defines after the #version line.
+    GLuint programFor(const PlaneLayout& layout)
+    {
+        if (auto it = programs_.find(layout.format); it != programs_.end())
+        {
+            return it->second;
+        }
+
+        std::string defines;
+        if (layout.semi_planar())
+        {
+            defines += "#define SEMI_PLANAR\n";
+        }
+        if (layout.swap_uv)
+        {
+            defines += "#define SWAP_UV\n";
+        }
+
+        std::string  frag     = fragSrc_;
+        const size_t line_end = frag.find('\n');
+        frag.insert(line_end == std::string::npos ? frag.size() : line_end + 1, defines);
+
+        const GLuint program = compileShader(vertSrc_.c_str(), frag.c_str());
+        if (program == 0)
+        {
+            return 0;
+        }
+
+        // fix sampler binding
+        glUseProgram(program);
+        const char* samplers[] = {"texY", "texU", "texV"};
+        for (int i = 0; i < 3; ++i)
+        {
+            const GLint loc = glGetUniformLocation(program, samplers[i]);
+            if (loc >= 0)
+            {
+                glUniform1i(loc, i);
+            }
+        }
+        const GLint scaleLoc = glGetUniformLocation(program, "sampleScale");
+        if (scaleLoc >= 0)
+        {
+            glUniform1f(scaleLoc, layout.sample_scale);
+        }
+
+        programs_.emplace(layout.format, program);
+        return program;
+    }
+
     void cleanup()
     {
         if (textures[0] || textures[1] || textures[2])
@@ -164,11 +370,13 @@ private:
             glDeleteTextures(3, textures);
             textures[0] = textures[1] = textures[2] = 0;
         }
-        if (shaderProgram != 0)
+        for (auto& [format, program] : programs_)
         {
-            glDeleteProgram(shaderProgram);
-            shaderProgram = 0;
+            glDeleteProgram(program);
         }
+        programs_.clear();
+        shaderProgram = 0;
+        layout_       = PlaneLayout {};
         if (VBO != 0)
         {
             glDeleteBuffers(1, &VBO);
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "glad/glad.h"
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libavutil/rational.h"
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "../engine/serial.h"
+#include "../engine/stream.h"
+#include "../logic/clock.h"
+#include "../utils/alias.h"
+#include "../utils/trace.h"
+#include "./present.h"
+#include "./video.h"
+
+// In framebuffer pixels, origin bottom-left like glViewport.
+struct TileRect
+{
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+};
+
+// Near-square grid, filled row by row from the top left.
+inline std::vector<TileRect> grid_layout(size_t count, int width, int height, int gap = 2)
+{
+    std::vector<TileRect> tiles;
+    if (count == 0 || width <= 0 || height <= 0)
+    {
+        return tiles;
+    }
+    const int cols   = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const int rows   = (static_cast<int>(count) + cols - 1) / cols;
+    const int cell_w = width / cols;
+    const int cell_h = height / rows;
+
+    tiles.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int col = static_cast<int>(i) % cols;
+        const int row = static_cast<int>(i) / cols;
+        tiles.push_back(TileRect {.x = col * cell_w + gap / 2,
+                                  .y = height - (row + 1) * cell_h + gap / 2,
+                                  .w = std::max(cell_w - gap, 1),
+                                  .h = std::max(cell_h - gap, 1)});
+    }
+    return tiles;
+}
+
+// Largest rect with the picture's aspect ratio, centered in `cell`.
+inline TileRect fit_aspect(const TileRect& cell, int pic_w, int pic_h)
+{
+    if (pic_w <= 0 || pic_h <= 0)
+    {
+        return cell;
+    }
+    const double scale = std::min(static_cast<double>(cell.w) / pic_w, static_cast<double>(cell.h) / pic_h);
+    const int    w     = std::max(static_cast<int>(pic_w * scale), 1);
+    const int    h     = std::max(static_cast<int>(pic_h * scale), 1);
+    return TileRect {.x = cell.x + (cell.w - w) / 2, .y = cell.y + (cell.h - h) / 2, .w = w, .h = h};
+}
+
+struct TileStats
+{
+    uint64_t shown   = 0;
+    uint64_t dropped = 0; // decoded but replaced by a newer frame before it was drawn
+};
+
+// Composites the streams of a PlaybackSession into one window, one GL context.
+// Runs on the GL thread: update() takes whatever frames are due at the coming refresh, draw()
+// renders the grid. Each stream keeps its own timeline (external clock anchored at its first
+// frame) and its own cadence, so the wall never waits for a slow stream; it shows that
+// stream's latest frame instead, and a 24 fps tile next to a 30 fps one still steps evenly.
+class VideoWall
+{
+private:
+    struct Tile
+    {
+        MediaStream*              stream = nullptr;
+        std::unique_ptr<Renderer> renderer;
+        ptr_frame_t               pending; // popped but not due yet
+        MediaClock                clock;
+        CadencePlanner            cadence;
+        double                    last_pts = std::numeric_limits<double>::quiet_NaN();
+        double                    frame    = 1.0 / 30.0; // pts step, seconds
+        TileStats                 stats;
+        int                       pic_w     = 0;
+        int                       pic_h     = 0;
+        int                       view_w    = 0; // last size passed to MediaStream::view_size
+        int                       view_h    = 0;
+        bool                      has_image = false;
+    };
+
+    std::vector<std::unique_ptr<Tile>> m_tiles;
+    int                                m_gap = 2;
+    bool                               m_ok  = false;
+
+public:
+    VideoWall(const std::vector<MediaStream*>& streams, const char* vertSrc, const char* fragSrc, int gap = 2)
+        : m_gap(gap)
+    {
+        m_tiles.reserve(streams.size());
+        for (MediaStream* stream : streams)
+        {
+            const auto [w, h] = stream->demuxer().video_size();
+            auto tile         = std::make_unique<Tile>();
+            tile->stream      = stream;
+            tile->renderer    = std::make_unique<Renderer>(w, h, vertSrc, fragSrc);
+            if (!tile->renderer->ok())
+            {
+                return;
+            }
+            tile->renderer->setMipmaps(true); // tiles are mostly smaller than their frames
+            m_tiles.push_back(std::move(tile));
+        }
+        m_ok = true;
+    }
+
+    VideoWall(const VideoWall&)              = delete;
+    VideoWall& operator=(const VideoWall&)   = delete;
+    VideoWall(VideoWall&&)                   = delete;
+    VideoWall& operator=(VideoWall&&)        = delete;
+    auto       operator<=>(const VideoWall&) = delete;
+
+    ~VideoWall() = default;
+
+    [[nodiscard]] bool ok() const
+    {
+        return m_ok;
+    }
+
+    // GL context must be current; releases textures and pending frames
+    void shutdown()
+    {
+        m_tiles.clear();
+    }
+
+    // Uploads the frame of every stream that should be on screen at the refresh `deadline`
+    // (steady_clock seconds); `interval`: the refresh interval. Never blocks.
+    void update(double deadline = clock_now_seconds(), double interval = 1.0 / 60.0)
+    {
+        LITEP_TRACE_SCOPE("wall update");
+        for (auto& tile : m_tiles)
+        {
+            update_tile(*tile, deadline, interval);
+        }
+    }
+
+    void draw(int fbw, int fbh)
+    {
+        glViewport(0, 0, fbw, fbh);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        const std::vector<TileRect> cells = grid_layout(m_tiles.size(), fbw, fbh, m_gap);
+        for (size_t i = 0; i < m_tiles.size(); ++i)
+        {
+            Tile&          tile = *m_tiles[i];
+            const TileRect rect = fit_aspect(cells[i], tile.pic_w, tile.pic_h);
+            if (rect.w != tile.view_w || rect.h != tile.view_h)
+            {
+                // decode no larger than the tile needs
+                tile.view_w = rect.w;
+                tile.view_h = rect.h;
+                tile.stream->view_size(rect.w, rect.h);
+            }
+            if (!tile.has_image)
+            {
+                continue;
+            }
+            glViewport(rect.x, rect.y, rect.w, rect.h);
+            tile.renderer->draw();
+        }
+        glViewport(0, 0, fbw, fbh);
+    }
+
+    [[nodiscard]] TileStats stats() const
+    {
+        TileStats total;
+        for (const auto& tile : m_tiles)
+        {
+            total.shown += tile->stats.shown;
+            total.dropped += tile->stats.dropped;
+        }
+        return total;
+    }
+
+private:
+    static double pts_seconds(const AVFrame* frame)
+    {
+        const int64_t pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp
+                                                                           : frame->pts;
+        if (pts == AV_NOPTS_VALUE || frame->time_base.num <= 0 || frame->time_base.den <= 0)
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return static_cast<double>(pts) * av_q2d(frame->time_base);
+    }
+
+    static void update_tile(Tile& tile, double deadline, double interval)
+    {
+        MediaStream& stream = *tile.stream;
+        ptr_frame_t  show;
+
+        for (;;)
+        {
+            if (tile.pending == nullptr)
+            {
+                std::optional<ptr_frame_t> next = stream.frames().try_pop();
+                if (next == std::nullopt)
+                {
+                    break;
+                }
+                tile.pending = std::move(*next);
+            }
+
+            const AVFrame* frame = tile.pending.get();
+            if (serial_of(frame) != stream.demuxer().serial().current())
+            {
+                tile.pending.reset(); // decoded before a loop seek
+                continue;
+            }
+            if (is_control(frame))
+            {
+                if (is_eof(frame))
+                {
+                    stream.on_eof();
+                }
+                else
+                {
+                    tile.clock.reset(); // the timeline restarts
+                    tile.cadence.reset();
+                    tile.last_pts = std::numeric_limits<double>::quiet_NaN();
+                }
+                tile.pending.reset();
+                continue;
+            }
+
+            // frames without a usable pts are shown as soon as they arrive
+            const double pts = pts_seconds(frame);
+            if (!std::isnan(pts))
+            {
+                if (!tile.clock.valid())
+                {
+                    tile.clock.set(pts, deadline);
+                }
+                const double error = (pts - tile.clock.get(deadline)) / interval;
+                if (!SyncClock::in_sync_range(error * interval))
+                {
+                    tile.clock.set(pts, deadline); // discontinuity: re-anchor
+                    tile.cadence.reset();
+                }
+                else if (show == nullptr ? !tile.cadence.switch_at(deadline, interval, error) : error > 0.5)
+                {
+                    break; // not due yet, keep it pending
+                }
+                const double step = pts - tile.last_pts;
+                if (step > 0.0 && step <= 0.1)
+                {
+                    tile.frame = step;
+                }
+                tile.last_pts = pts;
+            }
+
+            stream.consumed();
+            if (show != nullptr)
+            {
+                ++tile.stats.dropped;
+            }
+            show = std::move(tile.pending);
+        }
+
+        if (show != nullptr && tile.renderer->uploadFrame(show.get()))
+        {
+            tile.pic_w     = show->width;
+            tile.pic_h     = show->height;
+            tile.has_image = true;
+            ++tile.stats.shown;
+            tile.cadence.shown(deadline, tile.frame, interval, tile.cadence.planned(deadline, interval));
+        }
+    }
+};
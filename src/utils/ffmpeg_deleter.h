@@ -4,14 +4,33 @@ extern "C"
 {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libswresample/swresample.h"
+#include "libswscale/swscale.h"
+};
+
+// Implemented by object pools (see pool.h) that take AV objects back instead of freeing them.
+template <typename T>
+struct av_recycler
+{
+    virtual void recycle(T* p) noexcept = 0;
+
+protected:
+    ~av_recycler() = default;
 };
 
 struct av_packet_deleter
 {
+    av_recycler<AVPacket>* pool = nullptr; // null: plain av_packet_free
+
     void operator()(AVPacket* p) const noexcept
     {
         if (p)
         {
+            if (pool != nullptr)
+            {
+                pool->recycle(p);
+                return;
+            }
             av_packet_free(&p);
         }
     }
@@ -19,10 +38,17 @@ struct av_packet_deleter
 
 struct av_frame_deleter
 {
+    av_recycler<AVFrame>* pool = nullptr; // null: plain av_frame_free
+
     void operator()(AVFrame* p) const noexcept
     {
         if (p)
         {
+            if (pool != nullptr)
+            {
+                pool->recycle(p);
+                return;
+            }
             av_frame_free(&p);
         }
     }
@@ -48,4 +74,37 @@ struct av_codec_format_ctx_deleter
             avformat_close_input(&p);
         }
     }
-};
\ No newline at end of file
+};
+
+struct swr_context_deleter
+{
+    void operator()(SwrContext* p) const noexcept
+    {
+        if (p != nullptr)
+        {
+            swr_free(&p);
+        }
+    }
+};
+
+struct sws_context_deleter
+{
+    void operator()(SwsContext* p) const noexcept
+    {
+        if (p != nullptr)
+        {
+            sws_freeContext(p);
+        }
+    }
+};
+
+struct av_codec_parameters_deleter
+{
+    void operator()(AVCodecParameters* p) const noexcept
+    {
+        if (p != nullptr)
+        {
+            avcodec_parameters_free(&p);
+        }
+    }
+};
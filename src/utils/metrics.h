@@ -0,0 +1,568 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Pipeline telemetry. Stages only ever do relaxed fetch_adds on counters they own;
+// everything else (rates, queue sampling, export) happens on the reporter thread.
+
+// Latency histogram with HDR-style log-linear buckets: exact below 16 us, then 16 buckets per
+// power of two (<= 6.25% relative error) up to ~2^36 us. Lock-free, any number of writers.
+class LatencyHistogram
+{
+private:
+    static constexpr int      k_sub_bits     = 4;
+    static constexpr int      k_sub_count    = 1 << k_sub_bits;
+    static constexpr int      k_max_exponent = 36;
+    static constexpr size_t   k_buckets      = (k_max_exponent - k_sub_bits + 2) * k_sub_count;
+    static constexpr uint64_t k_max_value    = (uint64_t {1} << (k_max_exponent + 1)) - 1;
+
+    std::array<std::atomic<uint64_t>, k_buckets> m_counts_o {};
+    std::atomic<uint64_t>                        m_total_o {0};
+    std::atomic<uint64_t>                        m_sum_o {0};
+    std::atomic<uint64_t>                        m_max_o {0};
+
+public:
+    LatencyHistogram() = default;
+
+    LatencyHistogram(const LatencyHistogram&)              = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&)   = delete;
+    LatencyHistogram(LatencyHistogram&&)                   = delete;
+    LatencyHistogram& operator=(LatencyHistogram&&)        = delete;
+    auto              operator<=>(const LatencyHistogram&) = delete;
+
+    ~LatencyHistogram() = default;
+
+    void record(int64_t us)
+    {
+        const uint64_t v = std::min(static_cast<uint64_t>(std::max<int64_t>(us, 0)), k_max_value);
+        m_counts_o[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        m_total_o.fetch_add(1, std::memory_order_relaxed);
+        m_sum_o.fetch_add(v, std::memory_order_relaxed);
+
+        uint64_t seen = m_max_o.load(std::memory_order_relaxed);
+        while (v > seen && !m_max_o.compare_exchange_weak(seen, v, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    [[nodiscard]] uint64_t count() const
+    {
+        return m_total_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t sum() const
+    {
+        return m_sum_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t max() const
+    {
+        return m_max_o.load(std::memory_order_relaxed);
+    }
+
+    // q in [0, 1]; upper edge of the bucket holding the q-th sample, 0 when empty.
+    // Concurrent records may be half-visible, which only shifts the answer by a sample.
+    [[nodiscard]] uint64_t percentile(double q) const
+    {
+        uint64_t total = 0;
+        for (const auto& c : m_counts_o)
+        {
+            total += c.load(std::memory_order_relaxed);
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        const auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(total - 1)) + 1;
+        uint64_t   seen = 0;
+        for (size_t i = 0; i < k_buckets; ++i)
+        {
+            seen += m_counts_o[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(upper_of(i), max());
+            }
+        }
+        return max();
+    }
+
+private:
+    static size_t bucket_of(uint64_t v)
+    {
+        if (v < k_sub_count)
+        {
+            return static_cast<size_t>(v);
+        }
+        const int e   = static_cast<int>(std::bit_width(v)) - 1; // >= k_sub_bits
+        const auto sub = (v >> (e - k_sub_bits)) & (k_sub_count - 1);
+        return static_cast<size_t>(e - k_sub_bits + 1) * k_sub_count + static_cast<size_t>(sub);
+    }
+
+    // largest value that still falls into bucket i
+    static uint64_t upper_of(size_t i)
+    {
+        if (i < k_sub_count)
+        {
+            return i;
+        }
+        const int      e   = static_cast<int>(i / k_sub_count) + k_sub_bits - 1;
+        const uint64_t sub = i % k_sub_count;
+        return ((k_sub_count + sub + 1) << (e - k_sub_bits)) - 1;
+    }
+};
+
+// Work done by one stage. busy_us is time spent working (reading, decoding, rendering),
+// so busy_us / wall time says which stage is saturated.
+class StageMetrics
+{
+private:
+    std::atomic<uint64_t> m_items_o {0};
+    std::atomic<uint64_t> m_busy_us_o {0};
+
+public:
+    StageMetrics() = default;
+
+    StageMetrics(const StageMetrics&)              = delete;
+    StageMetrics& operator=(const StageMetrics&)   = delete;
+    StageMetrics(StageMetrics&&)                   = delete;
+    StageMetrics& operator=(StageMetrics&&)        = delete;
+    auto          operator<=>(const StageMetrics&) = delete;
+
+    ~StageMetrics() = default;
+
+    void add(uint64_t items, uint64_t busy_us)
+    {
+        m_items_o.fetch_add(items, std::memory_order_relaxed);
+        m_busy_us_o.fetch_add(busy_us, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t items() const
+    {
+        return m_items_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t busy_us() const
+    {
+        return m_busy_us_o.load(std::memory_order_relaxed);
+    }
+};
+
+// Measures one unit of stage work: construct before, done() after.
+class StageTimer
+{
+private:
+    StageMetrics*                         m_stage;
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+    explicit StageTimer(StageMetrics* stage)
+        : m_stage(stage),
+          m_start(stage != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point {})
+    {
+    }
+
+    void done(uint64_t items = 1)
+    {
+        if (m_stage != nullptr)
+        {
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()
+                                                                                  - m_start);
+            m_stage->add(items, static_cast<uint64_t>(us.count()));
+        }
+    }
+};
+
+struct QueueSample
+{
+    uint64_t size        = 0;
+    uint64_t capacity    = 0;
+    int64_t  bytes       = 0;
+    uint64_t full_waits  = 0; // producer found it full
+    uint64_t empty_waits = 0; // consumer found it empty
+};
+
+// Everything one pipeline reports. Stages get pointers to their members; queues are
+// registered by name and sampled by the reporter. Register before MetricsReporter::run().
+class PipelineMetrics
+{
+public:
+    struct Queue
+    {
+        std::string                  name;
+        std::function<QueueSample()> sample;
+    };
+
+    StageMetrics demux;   // packets read
+    StageMetrics decode;  // video frames out of the decoder
+    StageMetrics present; // frames swapped to the screen
+
+    LatencyHistogram demux_to_decode;  // packet read -> frame out of the decoder
+    LatencyHistogram demux_to_present; // packet read -> frame on screen
+
+    PipelineMetrics() = default;
+
+    PipelineMetrics(const PipelineMetrics&)              = delete;
+    PipelineMetrics& operator=(const PipelineMetrics&)   = delete;
+    PipelineMetrics(PipelineMetrics&&)                   = delete;
+    PipelineMetrics& operator=(PipelineMetrics&&)        = delete;
+    auto             operator<=>(const PipelineMetrics&) = delete;
+
+    ~PipelineMetrics() = default;
+
+    // Any QueueAtomic; the queue must outlive the reporter.
+    template <typename Q>
+    void watch(std::string name, const Q& queue)
+    {
+        m_queues.push_back(Queue {.name   = std::move(name),
+                                  .sample = [&queue]()
+                                  {
+                                      return QueueSample {.size        = queue.size(),
+                                                          .capacity    = queue.capacity(),
+                                                          .bytes       = queue.bytes(),
+                                                          .full_waits  = queue.full_waits(),
+                                                          .empty_waits = queue.empty_waits()};
+                                  }});
+    }
+
+    [[nodiscard]] const std::vector<Queue>& queues() const
+    {
+        return m_queues;
+    }
+
+private:
+    std::vector<Queue> m_queues;
+};
+
+enum class MetricsFormat
+{
+    JsonLines,  // one object per interval, appended
+    Prometheus, // text exposition format, file replaced every interval (node_exporter textfile)
+};
+
+// Samples queue depth every few milliseconds (a single size() read hides the bursts)
+// and writes one report per interval.
+class MetricsReporter
+{
+private:
+    static constexpr auto k_sample_period = std::chrono::milliseconds(10);
+
+    struct Depth
+    {
+        uint64_t sum     = 0;
+        uint64_t max     = 0;
+        uint64_t samples = 0;
+    };
+
+    struct Totals
+    {
+        uint64_t demux_items  = 0;
+        uint64_t decode_items = 0;
+        uint64_t present      = 0;
+        uint64_t demux_busy   = 0;
+        uint64_t decode_busy  = 0;
+        uint64_t present_busy = 0;
+    };
+
+    const PipelineMetrics&    m_metrics;
+    std::string               m_path;
+    MetricsFormat             m_format;
+    std::chrono::milliseconds m_interval;
+    std::jthread              m_thread;
+
+public:
+    MetricsReporter(const PipelineMetrics&    metrics,
+                    std::string               path,
+                    MetricsFormat             format,
+                    std::chrono::milliseconds interval = std::chrono::seconds(1))
+        : m_metrics(metrics), m_path(std::move(path)), m_format(format), m_interval(interval)
+    {
+    }
+
+    MetricsReporter(const MetricsReporter&)              = delete;
+    MetricsReporter& operator=(const MetricsReporter&)   = delete;
+    MetricsReporter(MetricsReporter&&)                   = delete;
+    MetricsReporter& operator=(MetricsReporter&&)        = delete;
+    auto             operator<=>(const MetricsReporter&) = delete;
+
+    ~MetricsReporter()
+    {
+        stop();
+    }
+
+    // ".prom" selects Prometheus text, anything else JSON lines
+    static MetricsFormat format_for(std::string_view path)
+    {
+        return path.ends_with(".prom") ? MetricsFormat::Prometheus : MetricsFormat::JsonLines;
+    }
+
+    void run()
+    {
+        if (m_thread.joinable())
+        {
+            return;
+        }
+        if (m_format == MetricsFormat::JsonLines)
+        {
+            std::ofstream truncate(m_path, std::ios::trunc);
+            if (!truncate.is_open())
+            {
+                std::print(stderr, "[Metrics] could not open {}\n", m_path);
+                return;
+            }
+        }
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                task(st);
+            });
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_thread.join();
+        }
+    }
+
+private:
+    [[nodiscard]] Totals totals() const
+    {
+        return Totals {.demux_items  = m_metrics.demux.items(),
+                       .decode_items = m_metrics.decode.items(),
+                       .present      = m_metrics.present.items(),
+                       .demux_busy   = m_metrics.demux.busy_us(),
+                       .decode_busy  = m_metrics.decode.busy_us(),
+                       .present_busy = m_metrics.present.busy_us()};
+    }
+
+    void task(const std::stop_token& st)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const size_t       nq = m_metrics.queues().size();
+        std::vector<Depth> depth(nq);
+        Totals             last         = totals();
+        auto               window_start = clock::now();
+        auto               next_sample  = window_start;
+
+        // the final report also covers the last partial interval
+        for (bool last_round = false; !last_round;)
+        {
+            last_round = st.stop_requested();
+            if (!last_round)
+            {
+                next_sample += k_sample_period;
+                std::this_thread::sleep_until(next_sample);
+            }
+
+            for (size_t i = 0; i < nq; ++i)
+            {
+                const uint64_t size = m_metrics.queues()[i].sample().size;
+                depth[i].sum += size;
+                depth[i].max = std::max(depth[i].max, size);
+                ++depth[i].samples;
+            }
+
+            const auto now = clock::now();
+            if (!last_round && now - window_start < m_interval)
+            {
+                continue;
+            }
+
+            const double seconds = std::chrono::duration<double>(now - window_start).count();
+            const Totals current = totals();
+            write(report(current, last, depth, seconds));
+
+            last         = current;
+            window_start = now;
+            std::fill(depth.begin(), depth.end(), Depth {});
+        }
+    }
+
+    [[nodiscard]] std::string report(const Totals&             now,
+                                     const Totals&             last,
+                                     const std::vector<Depth>& depth,
+                                     double                    seconds) const
+    {
+        const auto rate = [seconds](uint64_t a, uint64_t b)
+        {
+            return seconds > 0.0 ? static_cast<double>(a - b) / seconds : 0.0;
+        };
+        // share of the window the stage spent working; decode can exceed 1 with several decoders
+        const auto busy = [seconds](uint64_t a, uint64_t b)
+        {
+            return seconds > 0.0 ? static_cast<double>(a - b) / (seconds * 1e6) : 0.0;
+        };
+        const auto avg = [](const Depth& d)
+        {
+            return d.samples > 0 ? static_cast<double>(d.sum) / static_cast<double>(d.samples) : 0.0;
+        };
+
+        const struct
+        {
+            const char* name;
+            uint64_t    items;
+            double      rate;
+            double      busy;
+        } stages[] = {
+            {"demux", now.demux_items, rate(now.demux_items, last.demux_items), busy(now.demux_busy, last.demux_busy)},
+            {"decode",
+             now.decode_items,
+             rate(now.decode_items, last.decode_items),
+             busy(now.decode_busy, last.decode_busy)},
+            {"present", now.present, rate(now.present, last.present), busy(now.present_busy, last.present_busy)},
+        };
+        const std::pair<const char*, const LatencyHistogram*> latencies[]
+            = {{"demux_to_decode", &m_metrics.demux_to_decode}, {"demux_to_present", &m_metrics.demux_to_present}};
+        const auto& queues = m_metrics.queues();
+
+        std::string out;
+        if (m_format == MetricsFormat::JsonLines)
+        {
+            const auto unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch())
+                                     .count();
+            out += std::format("{{\"ts_ms\":{},\"window_s\":{:.3f},\"stages\":{{", unix_ms, seconds);
+            for (size_t i = 0; i < std::size(stages); ++i)
+            {
+                out += std::format("{}\"{}\":{{\"items\":{},\"per_s\":{:.1f},\"busy\":{:.3f}}}",
+                                   i > 0 ? "," : "",
+                                   stages[i].name,
+                                   stages[i].items,
+                                   stages[i].rate,
+                                   stages[i].busy);
+            }
+            out += "},\"latency_us\":{";
+            for (size_t i = 0; i < std::size(latencies); ++i)
+            {
+                const LatencyHistogram& h = *latencies[i].second;
+                out += std::format("{}\"{}\":{{\"count\":{},\"p50\":{},\"p90\":{},\"p99\":{},\"max\":{}}}",
+                                   i > 0 ? "," : "",
+                                   latencies[i].first,
+                                   h.count(),
+                                   h.percentile(0.5),
+                                   h.percentile(0.9),
+                                   h.percentile(0.99),
+                                   h.max());
+            }
+            out += "},\"queues\":{";
+            for (size_t i = 0; i < queues.size(); ++i)
+            {
+                const QueueSample s = queues[i].sample();
+                out += std::format("{}\"{}\":{{\"size\":{},\"capacity\":{},\"bytes\":{},\"depth_avg\":{:.1f},"
+                                   "\"depth_max\":{},\"full_waits\":{},\"empty_waits\":{}}}",
+                                   i > 0 ? "," : "",
+                                   queues[i].name,
+                                   s.size,
+                                   s.capacity,
+                                   s.bytes,
+                                   avg(depth[i]),
+                                   depth[i].max,
+                                   s.full_waits,
+                                   s.empty_waits);
+            }
+            out += "}}\n";
+            return out;
+        }
+
+        out += "# TYPE litep_stage_items_total counter\n";
+        for (const auto& s : stages)
+        {
+            out += std::format("litep_stage_items_total{{stage=\"{}\"}} {}\n", s.name, s.items);
+        }
+        out += "# TYPE litep_stage_items_per_second gauge\n";
+        for (const auto& s : stages)
+        {
+            out += std::format("litep_stage_items_per_second{{stage=\"{}\"}} {:.3f}\n", s.name, s.rate);
+        }
+        out += "# TYPE litep_stage_busy_ratio gauge\n";
+        for (const auto& s : stages)
+        {
+            out += std::format("litep_stage_busy_ratio{{stage=\"{}\"}} {:.4f}\n", s.name, s.busy);
+        }
+        out += "# TYPE litep_latency_microseconds summary\n";
+        for (const auto& [name, h] : latencies)
+        {
+            for (const double q : {0.5, 0.9, 0.99})
+            {
+                out += std::format(
+                    "litep_latency_microseconds{{path=\"{}\",quantile=\"{}\"}} {}\n", name, q, h->percentile(q));
+            }
+            out += std::format("litep_latency_microseconds_sum{{path=\"{}\"}} {}\n", name, h->sum());
+            out += std::format("litep_latency_microseconds_count{{path=\"{}\"}} {}\n", name, h->count());
+        }
+        out += "# TYPE litep_queue_depth gauge\n";
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            out += std::format("litep_queue_depth{{queue=\"{}\",stat=\"avg\"}} {:.2f}\n", queues[i].name, avg(depth[i]));
+            out += std::format("litep_queue_depth{{queue=\"{}\",stat=\"max\"}} {}\n", queues[i].name, depth[i].max);
+        }
+        out += "# TYPE litep_queue_capacity gauge\n";
+        for (const auto& q : queues)
+        {
+            out += std::format("litep_queue_capacity{{queue=\"{}\"}} {}\n", q.name, q.sample().capacity);
+        }
+        out += "# TYPE litep_queue_bytes gauge\n";
+        for (const auto& q : queues)
+        {
+            out += std::format("litep_queue_bytes{{queue=\"{}\"}} {}\n", q.name, q.sample().bytes);
+        }
+        out += "# TYPE litep_queue_full_waits_total counter\n";
+        for (const auto& q : queues)
+        {
+            out += std::format("litep_queue_full_waits_total{{queue=\"{}\"}} {}\n", q.name, q.sample().full_waits);
+        }
+        out += "# TYPE litep_queue_empty_waits_total counter\n";
+        for (const auto& q : queues)
+        {
+            out += std::format("litep_queue_empty_waits_total{{queue=\"{}\"}} {}\n", q.name, q.sample().empty_waits);
+        }
+        return out;
+    }
+
+    void write(const std::string& text) const
+    {
+        if (m_format == MetricsFormat::JsonLines)
+        {
+            std::ofstream out(m_path, std::ios::app);
+            out << text;
+            return;
+        }
+
+        // scrapers must never see a half-written file
+        const std::string tmp = m_path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            out << text;
+            if (!out.good())
+            {
+                std::print(stderr, "[Metrics] could not write {}\n", tmp);
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, m_path, ec);
+        if (ec)
+        {
+            std::print(stderr, "[Metrics] could not replace {}\n", m_path);
+        }
+    }
+};
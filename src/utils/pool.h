@@ -0,0 +1,165 @@
+#pragma once
+
+extern "C"
+{
+#include "libavcodec/packet.h"
+#include "libavutil/frame.h"
+}
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "../engine/queue.h"
+#include "./alias.h"
+
+template <typename T>
+struct av_pool_traits;
+
+template <>
+struct av_pool_traits<AVPacket>
+{
+    using deleter_t = av_packet_deleter;
+
+    static AVPacket* alloc()
+    {
+        return av_packet_alloc();
+    }
+
+    static void reset(AVPacket* p)
+    {
+        av_packet_unref(p);
+    }
+
+    static void release(AVPacket* p)
+    {
+        av_packet_free(&p);
+    }
+};
+
+template <>
+struct av_pool_traits<AVFrame>
+{
+    using deleter_t = av_frame_deleter;
+
+    static AVFrame* alloc()
+    {
+        return av_frame_alloc();
+    }
+
+    static void reset(AVFrame* p)
+    {
+        av_frame_unref(p);
+    }
+
+    static void release(AVFrame* p)
+    {
+        av_frame_free(&p);
+    }
+};
+
+struct PoolStats
+{
+    size_t hits        = 0; // acquire served from the freelist
+    size_t misses      = 0; // acquire had to allocate
+    size_t outstanding = 0; // objects currently handed out
+    size_t high_water  = 0; // max outstanding seen
+};
+
+// Recycles AVPacket/AVFrame shells. Handed-out pointers carry this pool in their deleter,
+// so dropping them unrefs the payload and puts the shell back on a lock-free freelist.
+// The payload buffers themselves stay refcounted by FFmpeg (and pooled by the codec).
+// The pool must outlive every pointer it handed out.
+template <typename T>
+class AVPool final : public av_recycler<T>
+{
+private:
+    using traits_t  = av_pool_traits<T>;
+    using deleter_t = typename traits_t::deleter_t;
+    using ptr_t     = std::unique_ptr<T, deleter_t>;
+
+    // only try_* is used, so the wait strategy never matters
+    QueueAtomic<T*, QueuePolicy::MPMC, SpinYieldWait> m_free;
+
+    alignas(64) std::atomic<size_t> m_hits_o {0};
+    std::atomic<size_t> m_misses_o {0};
+    alignas(64) std::atomic<size_t> m_outstanding_o {0};
+    std::atomic<size_t> m_high_water_o {0};
+
+public:
+    explicit AVPool(size_t capacity = 256) : m_free(capacity)
+    {
+    }
+
+    AVPool(const AVPool&)              = delete;
+    AVPool& operator=(const AVPool&)   = delete;
+    AVPool(AVPool&&)                   = delete;
+    AVPool& operator=(AVPool&&)        = delete;
+    auto    operator<=>(const AVPool&) = delete;
+
+    ~AVPool()
+    {
+        while (auto p = m_free.try_pop())
+        {
+            traits_t::release(*p);
+        }
+    }
+
+    // Process-wide pool; lives until static destruction, after every pipeline in main().
+    static AVPool& shared()
+    {
+        static AVPool pool;
+        return pool;
+    }
+
+    [[nodiscard]] ptr_t acquire()
+    {
+        T* obj = nullptr;
+        if (auto cached = m_free.try_pop())
+        {
+            obj = *cached;
+            m_hits_o.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            obj = traits_t::alloc();
+            if (obj == nullptr)
+            {
+                return ptr_t {nullptr, deleter_t {this}};
+            }
+            m_misses_o.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        const size_t out = m_outstanding_o.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t       hw  = m_high_water_o.load(std::memory_order_relaxed);
+        while (out > hw
+               && !m_high_water_o.compare_exchange_weak(hw, out, std::memory_order_relaxed))
+        {
+        }
+
+        return ptr_t {obj, deleter_t {this}};
+    }
+
+    void recycle(T* p) noexcept override
+    {
+        m_outstanding_o.fetch_sub(1, std::memory_order_relaxed);
+        traits_t::reset(p);
+        if (!m_free.try_push(p))
+        {
+            traits_t::release(p); // freelist full
+        }
+    }
+
+    [[nodiscard]] PoolStats stats() const
+    {
+        return PoolStats {
+            m_hits_o.load(std::memory_order_relaxed),
+            m_misses_o.load(std::memory_order_relaxed),
+            m_outstanding_o.load(std::memory_order_relaxed),
+            m_high_water_o.load(std::memory_order_relaxed),
+        };
+    }
+};
+
+using PacketPool = AVPool<AVPacket>;
+using FramePool  = AVPool<AVFrame>;
@@ -0,0 +1,299 @@
+#pragma once
+
+// Chrome trace-event recorder (chrome://tracing, ui.perfetto.dev) for the pipeline threads.
+//
+//   LITEP_TRACE_SCOPE("name")   - span from here to the end of the enclosing block
+//   LITEP_TRACE_THREAD("name")  - label the calling thread's track
+//
+// Names must be string literals: only the pointer is recorded.
+// Built only with LITEP_TRACE defined (xmake f --trace=y); otherwise the macros expand to
+// nothing, their arguments are never evaluated, and this header pulls in no code.
+
+#if defined(LITEP_TRACE)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TraceEvent
+{
+    const char* name     = nullptr;
+    int64_t     begin_ns = 0;
+    int64_t     end_ns   = 0;
+};
+
+// Per-thread SPSC ring: the owning thread writes, the collector drains.
+// When the collector falls behind, new events are dropped (and counted), never waited for.
+class TraceBuffer
+{
+private:
+    static constexpr size_t k_capacity = 1 << 14;
+
+    std::array<TraceEvent, k_capacity> m_events {};
+    alignas(64) std::atomic<size_t> m_head_o {0}; // next write, owner thread
+    alignas(64) std::atomic<size_t> m_tail_o {0}; // next read, collector
+
+public:
+    const uint32_t        tid;
+    std::string           name; // guarded by the recorder's mutex
+    std::atomic<uint64_t> dropped_o {0};
+
+    explicit TraceBuffer(uint32_t id) : tid(id), name(std::format("thread {}", id))
+    {
+    }
+
+    TraceBuffer(const TraceBuffer&)              = delete;
+    TraceBuffer& operator=(const TraceBuffer&)   = delete;
+    TraceBuffer(TraceBuffer&&)                   = delete;
+    TraceBuffer& operator=(TraceBuffer&&)        = delete;
+    auto         operator<=>(const TraceBuffer&) = delete;
+
+    ~TraceBuffer() = default;
+
+    void push(const TraceEvent& e)
+    {
+        const size_t head = m_head_o.load(std::memory_order_relaxed);
+        if (head - m_tail_o.load(std::memory_order_acquire) >= k_capacity)
+        {
+            dropped_o.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_events[head % k_capacity] = e;
+        m_head_o.store(head + 1, std::memory_order_release);
+    }
+
+    template <typename F>
+    void drain(F&& sink)
+    {
+        const size_t head = m_head_o.load(std::memory_order_acquire);
+        size_t       tail = m_tail_o.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            sink(m_events[tail % k_capacity]);
+        }
+        m_tail_o.store(tail, std::memory_order_release);
+    }
+};
+
+// Owns every thread's ring (they outlive their threads) and a collector thread that moves
+// events into memory every few milliseconds. write() produces the JSON, at exit or any time.
+class TraceRecorder
+{
+private:
+    struct Record
+    {
+        TraceEvent event;
+        uint32_t   tid = 0;
+    };
+
+    static constexpr auto   k_drain_period = std::chrono::milliseconds(20);
+    static constexpr size_t k_max_records  = size_t {4} << 20; // ~100 MB, then events are dropped
+
+    std::mutex                                  m_mutex;
+    std::vector<std::unique_ptr<TraceBuffer>>   m_buffers;
+    std::vector<Record>                         m_records;
+    uint64_t                                    m_overflow = 0;
+    std::atomic_bool                            m_enabled_o {false};
+    std::jthread                                m_thread;
+    const std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+
+    TraceRecorder() = default;
+
+public:
+    TraceRecorder(const TraceRecorder&)              = delete;
+    TraceRecorder& operator=(const TraceRecorder&)   = delete;
+    TraceRecorder(TraceRecorder&&)                   = delete;
+    TraceRecorder& operator=(TraceRecorder&&)        = delete;
+    auto           operator<=>(const TraceRecorder&) = delete;
+
+    ~TraceRecorder()
+    {
+        stop();
+    }
+
+    static TraceRecorder& shared()
+    {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    void start()
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable())
+        {
+            return;
+        }
+        m_enabled_o.store(true, std::memory_order_release);
+        m_thread = std::jthread(
+            [this](const std::stop_token& st)
+            {
+                while (!st.stop_requested())
+                {
+                    std::this_thread::sleep_for(k_drain_period);
+                    std::lock_guard collect_lock(m_mutex);
+                    collect();
+                }
+            });
+    }
+
+    void stop()
+    {
+        m_enabled_o.store(false, std::memory_order_release);
+        if (m_thread.joinable())
+        {
+            m_thread.request_stop();
+            m_thread.join();
+        }
+    }
+
+    [[nodiscard]] bool enabled() const
+    {
+        return m_enabled_o.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch)
+            .count();
+    }
+
+    // the calling thread's ring, created on first use (one recorder per process, see shared())
+    TraceBuffer& local()
+    {
+        thread_local TraceBuffer* buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard lock(m_mutex);
+            m_buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(m_buffers.size() + 1)));
+            buffer = m_buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    void name_thread(const char* name)
+    {
+        TraceBuffer&    buffer = local();
+        std::lock_guard lock(m_mutex);
+        buffer.name = name;
+    }
+
+    // Everything recorded so far; recording continues.
+    bool write(const std::string& path)
+    {
+        std::lock_guard lock(m_mutex);
+        collect();
+
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::print(stderr, "[Trace] could not open {}\n", path);
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool     first   = true;
+        uint64_t dropped = m_overflow;
+        for (const auto& buffer : m_buffers)
+        {
+            out << std::format("{}{{\"ph\":\"M\",\"pid\":1,\"tid\":{},\"name\":\"thread_name\","
+                               "\"args\":{{\"name\":\"{}\"}}}}",
+                               first ? "" : ",\n",
+                               buffer->tid,
+                               buffer->name);
+            first = false;
+            dropped += buffer->dropped_o.load(std::memory_order_relaxed);
+        }
+        for (const Record& r : m_records)
+        {
+            out << std::format(",\n{{\"ph\":\"X\",\"pid\":1,\"tid\":{},\"name\":\"{}\",\"ts\":{:.3f},"
+                               "\"dur\":{:.3f}}}",
+                               r.tid,
+                               r.event.name,
+                               static_cast<double>(r.event.begin_ns) / 1e3,
+                               static_cast<double>(r.event.end_ns - r.event.begin_ns) / 1e3);
+        }
+        out << "\n]}\n";
+
+        if (dropped > 0)
+        {
+            std::print(stderr, "[Trace] {} events dropped\n", dropped);
+        }
+        std::print("[Trace] {} events written to {}\n", m_records.size(), path);
+        return out.good();
+    }
+
+private:
+    // m_mutex held
+    void collect()
+    {
+        for (const auto& buffer : m_buffers)
+        {
+            buffer->drain(
+                [this, tid = buffer->tid](const TraceEvent& e)
+                {
+                    if (m_records.size() < k_max_records)
+                    {
+                        m_records.push_back(Record {.event = e, .tid = tid});
+                    }
+                    else
+                    {
+                        ++m_overflow;
+                    }
+                });
+        }
+    }
+};
+
+class TraceScope
+{
+private:
+    const char* m_name;
+    int64_t     m_begin_ns = -1; // -1: recorder off when the scope opened
+
+public:
+    explicit TraceScope(const char* name) : m_name(name)
+    {
+        if (TraceRecorder::shared().enabled())
+        {
+            m_begin_ns = TraceRecorder::shared().now_ns();
+        }
+    }
+
+    TraceScope(const TraceScope&)              = delete;
+    TraceScope& operator=(const TraceScope&)   = delete;
+    TraceScope(TraceScope&&)                   = delete;
+    TraceScope& operator=(TraceScope&&)        = delete;
+    auto        operator<=>(const TraceScope&) = delete;
+
+    ~TraceScope()
+    {
+        if (m_begin_ns >= 0)
+        {
+            TraceRecorder& recorder = TraceRecorder::shared();
+            recorder.local().push(TraceEvent {.name = m_name, .begin_ns = m_begin_ns, .end_ns = recorder.now_ns()});
+        }
+    }
+};
+
+#define LITEP_TRACE_CONCAT_(a, b) a##b
+#define LITEP_TRACE_CONCAT(a, b)  LITEP_TRACE_CONCAT_(a, b)
+#define LITEP_TRACE_SCOPE(name)   const TraceScope LITEP_TRACE_CONCAT(litep_trace_scope_, __LINE__)(name)
+#define LITEP_TRACE_THREAD(name)  TraceRecorder::shared().name_thread(name)
+
+#else
+
+#define LITEP_TRACE_SCOPE(name)  static_cast<void>(0)
+#define LITEP_TRACE_THREAD(name) static_cast<void>(0)
+
+#endif
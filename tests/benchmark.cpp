@@ -0,0 +1,187 @@
+// Headless benchmark runner: xmake build benchmark && xmake run benchmark [options]
+//
+//   --json <file>    write the JSON report there (default: stdout)
+//   --quick          fewer items / smaller clips, for CI smoke runs
+//   --clip <file>    also run pipeline, demux I/O and seek benchmarks on a real file
+//   --workdir <dir>  where synthetic clips are generated (default: current directory)
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <print>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+int main(int argc, char* argv[])
+{
+    std::string json_path;
+    std::string clip_path;
+    std::string workdir = ".";
+    bool        quick   = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--clip") == 0 && i + 1 < argc)
+        {
+            clip_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--workdir") == 0 && i + 1 < argc)
+        {
+            workdir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else
+        {
+            std::print(stderr, "unknown option {}\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<BENCH::BenchResult> results;
+
+    // queues
+    BENCH::BENCH_queues(results, quick ? 200'000 : 2'000'000);
+
+    // stage wakeups: pooled slices and parked threads
+    {
+        PipelineExecutor executor;
+        results.push_back(BENCH::BENCH_stage_handoff(executor, "pool", quick ? 20'000 : 200'000));
+        results.push_back(BENCH::BENCH_stage_handoff(ThreadHost::shared(), "thread", quick ? 20'000 : 200'000));
+    }
+
+    // pipeline on synthetic clips
+    std::vector<BENCH::ClipSpec> clips = {
+        {.width = 640, .height = 360, .frames = 300, .fps = 30, .gop = 30, .name = "360p_mpeg4"},
+        {.width = 1280, .height = 720, .frames = 300, .fps = 30, .gop = 30, .name = "720p_mpeg4"},
+        {.width = 1920, .height = 1080, .frames = 300, .fps = 30, .gop = 60, .name = "1080p_mpeg4"},
+    };
+    if (quick)
+    {
+        clips.resize(1);
+        clips[0].frames = 90;
+    }
+
+    for (const BENCH::ClipSpec& spec : clips)
+    {
+        const std::string path = (std::filesystem::path(workdir) / (std::string(spec.name) + ".mkv")).string();
+        if (!BENCH::make_synthetic_clip(path, spec))
+        {
+            std::print(stderr, "[Bench] skipping {}\n", spec.name);
+            continue;
+        }
+        if (auto r = BENCH::BENCH_pipeline(path, spec.name))
+        {
+            results.push_back(*r);
+        }
+        // decoded for a small wall tile: lowres / skipped loop filter / downscale
+        if (spec.width >= 2 * 480)
+        {
+            if (auto r = BENCH::BENCH_pipeline(path, spec.name, 480, 270))
+            {
+                results.push_back(*r);
+            }
+        }
+        for (const IoMode io : {IoMode::Buffered, IoMode::Mmap, IoMode::ReadAhead})
+        {
+            if (auto r = BENCH::BENCH_demux_io(path, spec.name, io))
+            {
+                results.push_back(*r);
+            }
+        }
+        for (const bool chunked : {false, true})
+        {
+            if (auto r = BENCH::BENCH_demux_memory(path, spec.name, chunked))
+            {
+                results.push_back(*r);
+            }
+        }
+        if (auto r = BENCH::BENCH_seek_latency(path, spec.name, SeekMode::Keyframe, quick ? 10 : 50))
+        {
+            results.push_back(*r);
+        }
+        if (auto r = BENCH::BENCH_seek_latency(path, spec.name, SeekMode::Accurate, quick ? 10 : 50))
+        {
+            results.push_back(*r);
+        }
+        if (auto r = BENCH::BENCH_thumbnails(path, spec.name, workdir, quick ? 2 : 8))
+        {
+            results.push_back(*r);
+        }
+        std::filesystem::remove(path);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    // live input: MPEG-TS (parameters in-band, as from a network source) fed in real time
+    {
+        const BENCH::ClipSpec spec = clips.front();
+        const std::string     path = (std::filesystem::path(workdir) / (std::string(spec.name) + ".ts")).string();
+        if (BENCH::make_synthetic_clip(path, spec))
+        {
+            for (const LatencyProfile latency : {LatencyProfile::Standard, LatencyProfile::Low})
+            {
+                if (auto r = BENCH::BENCH_live_latency(path, spec.name, latency))
+                {
+                    results.push_back(*r);
+                }
+            }
+            std::filesystem::remove(path);
+        }
+    }
+#endif
+
+    if (!clip_path.empty())
+    {
+        const std::string name = std::filesystem::path(clip_path).filename().string();
+        if (auto r = BENCH::BENCH_pipeline(clip_path, name.c_str()))
+        {
+            results.push_back(*r);
+        }
+        if (auto r = BENCH::BENCH_pipeline(clip_path, name.c_str(), 480, 270))
+        {
+            results.push_back(*r);
+        }
+        for (const IoMode io : {IoMode::Buffered, IoMode::Mmap, IoMode::ReadAhead})
+        {
+            if (auto r = BENCH::BENCH_demux_io(clip_path, name.c_str(), io))
+            {
+                results.push_back(*r);
+            }
+        }
+        if (auto r = BENCH::BENCH_demux_io(clip_path, name.c_str(), IoMode::Buffered, true))
+        {
+            results.push_back(*r);
+        }
+        for (const SeekMode mode : {SeekMode::Keyframe, SeekMode::Accurate})
+        {
+            if (auto r = BENCH::BENCH_seek_latency(clip_path, name.c_str(), mode))
+            {
+                results.push_back(*r);
+            }
+        }
+    }
+
+    const std::string json = BENCH::to_json(results);
+    if (json_path.empty())
+    {
+        std::print("{}", json);
+        return 0;
+    }
+
+    std::ofstream out(json_path);
+    if (!out.is_open())
+    {
+        std::print(stderr, "could not write {}\n", json_path);
+        return 1;
+    }
+    out << json;
+    return 0;
+}
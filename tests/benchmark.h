@@ -0,0 +1,1006 @@
+#pragma once
+// NOTE:   here are the benchmarks; headless (no window, no GL), see tests/benchmark.cpp
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/frame.h"
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../src/engine/decoder.h"
+#include "../src/engine/demuxer.h"
+#include "../src/engine/file_source.h"
+#include "../src/engine/input_source.h"
+#include "../src/engine/queue.h"
+#include "../src/engine/serial.h"
+#include "../src/engine/stage.h"
+#include "../src/logic/executor.h"
+#include "../src/logic/profile.h"
+#include "../src/logic/thumbnail.h"
+#include "../src/renderer/pixel_layout.h"
+#include "../src/utils/alias.h"
+#include "../src/utils/ffmpeg_deleter.h"
+
+namespace BENCH
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    // One line of the report. Params describe the case, metrics are the numbers to track.
+    struct BenchResult
+    {
+        std::string                                      name;
+        std::vector<std::pair<std::string, std::string>> params {}; // values already JSON-encoded
+        std::vector<std::pair<std::string, double>>      metrics {};
+
+        BenchResult& param(std::string key, const std::string& value)
+        {
+            params.emplace_back(std::move(key), "\"" + value + "\"");
+            return *this;
+        }
+
+        BenchResult& param(std::string key, int64_t value)
+        {
+            params.emplace_back(std::move(key), std::to_string(value));
+            return *this;
+        }
+
+        BenchResult& metric(std::string key, double value)
+        {
+            metrics.emplace_back(std::move(key), value);
+            return *this;
+        }
+    };
+
+    inline std::string to_json(const std::vector<BenchResult>& results)
+    {
+        std::string out = "{\n  \"suite\": \"litePlayer\",\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const BenchResult& r = results[i];
+            out += i == 0 ? "\n" : ",\n";
+            out += std::format("    {{\"name\": \"{}\"", r.name);
+            for (const auto& [key, value] : r.params)
+            {
+                out += std::format(", \"{}\": {}", key, value);
+            }
+            out += ", \"metrics\": {";
+            for (size_t m = 0; m < r.metrics.size(); ++m)
+            {
+                out += std::format("{}\"{}\": {:.3f}", m == 0 ? "" : ", ", r.metrics[m].first, r.metrics[m].second);
+            }
+            out += "}}";
+        }
+        out += "\n  ]\n}\n";
+        return out;
+    }
+
+    // nearest-rank percentile, p in [0, 1]; sorts in place
+    inline double percentile(std::vector<double>& samples, double p)
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        std::sort(samples.begin(), samples.end());
+        const auto index = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+        return samples[std::min(index, samples.size() - 1)];
+    }
+
+    inline int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+    }
+
+    // ========== Queue ==========
+
+    using Payload256 = std::array<uint8_t, 256>;
+
+    template <typename T>
+    T make_value(size_t v)
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            return static_cast<T>(v);
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+        {
+            return "payload_value_beyond_sso_" + std::to_string(v); // forces a heap allocation
+        }
+        else
+        {
+            T value {};
+            value[0] = static_cast<uint8_t>(v);
+            return value;
+        }
+    }
+
+    template <typename T>
+    constexpr const char* type_name()
+    {
+        if constexpr (std::is_same_v<T, int64_t>)
+        {
+            return "int64";
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+        {
+            return "string";
+        }
+        else
+        {
+            return "bytes256";
+        }
+    }
+
+    // every k_stamp_every-th item carries its push time; stamping every item would dominate
+    // the cost of the cheapest queues
+    inline constexpr size_t k_stamp_every = 64;
+
+    template <typename T>
+    struct Stamped
+    {
+        int64_t stamp_ns = 0;
+        T       value {};
+    };
+
+    template <typename Q, typename Item>
+    concept has_pop_batch = requires(Q& q, std::vector<Item>& v) { q.pop_batch(v, size_t {}); };
+
+    // 1 producer / 1 consumer: throughput and push->pop latency.
+    // batch > 1 uses push_batch, and pop_batch where the queue has one.
+    template <typename Q, typename T>
+    BenchResult run_queue_case(const char* queue_name, size_t capacity, size_t items, size_t batch)
+    {
+        using Item = Stamped<T>;
+
+        Q                   q(capacity);
+        std::vector<double> latencies;
+        latencies.reserve(items / k_stamp_every + 1);
+        size_t received = 0;
+
+        auto consume = [&](Item& item)
+        {
+            if (item.stamp_ns != 0)
+            {
+                latencies.push_back(static_cast<double>(now_ns() - item.stamp_ns));
+            }
+            ++received;
+        };
+
+        const auto start = bench_clock::now();
+
+        std::thread consumer(
+            [&]
+            {
+                if constexpr (has_pop_batch<Q, Item>)
+                {
+                    if (batch > 1)
+                    {
+                        std::vector<Item> out;
+                        out.reserve(batch);
+                        while (received < items)
+                        {
+                            out.clear();
+                            if (q.pop_batch(out, batch) == 0)
+                            {
+                                std::this_thread::yield();
+                                continue;
+                            }
+                            for (Item& item : out)
+                            {
+                                consume(item);
+                            }
+                        }
+                        return;
+                    }
+                }
+                while (received < items)
+                {
+                    auto item = q.pop();
+                    if (item == std::nullopt)
+                    {
+                        break;
+                    }
+                    consume(*item);
+                }
+            });
+
+        if (batch <= 1)
+        {
+            for (size_t i = 0; i < items; ++i)
+            {
+                const int64_t stamp = i % k_stamp_every == 0 ? now_ns() : 0;
+                q.push(Item {.stamp_ns = stamp, .value = make_value<T>(i)});
+            }
+        }
+        else
+        {
+            std::vector<Item> pending;
+            pending.reserve(batch);
+            for (size_t i = 0; i < items;)
+            {
+                for (; pending.size() < batch && i < items; ++i)
+                {
+                    const int64_t stamp = i % k_stamp_every == 0 ? now_ns() : 0;
+                    pending.push_back(Item {.stamp_ns = stamp, .value = make_value<T>(i)});
+                }
+                const size_t pushed = q.push_batch(pending);
+                pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pushed));
+                if (pushed == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            while (!pending.empty())
+            {
+                const size_t pushed = q.push_batch(pending);
+                pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pushed));
+                if (pushed == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        consumer.join();
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        BenchResult result {.name = "queue"};
+        result.param("queue", queue_name)
+            .param("type", type_name<T>())
+            .param("capacity", static_cast<int64_t>(capacity))
+            .param("batch", static_cast<int64_t>(batch))
+            .param("items", static_cast<int64_t>(items))
+            .metric("ops_per_sec", static_cast<double>(received) / seconds)
+            .metric("latency_p50_ns", percentile(latencies, 0.50))
+            .metric("latency_p99_ns", percentile(latencies, 0.99))
+            .metric("latency_max_ns", percentile(latencies, 1.0));
+        return result;
+    }
+
+    template <typename T>
+    void BENCH_queue_type(std::vector<BenchResult>& results, size_t items)
+    {
+        for (const size_t capacity : {16, 256, 4096})
+        {
+            results.push_back(run_queue_case<QueueMutex<Stamped<T>>, T>("mutex", capacity, items, 1));
+            results.push_back(run_queue_case<QueueAtomic<Stamped<T>>, T>("atomic_spsc", capacity, items, 1));
+            results.push_back(
+                run_queue_case<QueueAtomic<Stamped<T>, QueuePolicy::MPMC>, T>("atomic_mpmc", capacity, items, 1));
+
+            const size_t batch = std::min<size_t>(32, capacity / 2);
+            results.push_back(run_queue_case<QueueMutex<Stamped<T>>, T>("mutex", capacity, items, batch));
+            results.push_back(run_queue_case<QueueAtomic<Stamped<T>>, T>("atomic_spsc", capacity, items, batch));
+        }
+    }
+
+    inline void BENCH_queues(std::vector<BenchResult>& results, size_t items)
+    {
+        BENCH_queue_type<int64_t>(results, items);
+        BENCH_queue_type<std::string>(results, items / 4);
+        BENCH_queue_type<Payload256>(results, items / 4);
+    }
+
+    // ========== Stages ==========
+
+    // A producer and a consumer stage hand items over through a 2-slot queue, so nearly every
+    // step finds it full or empty and each item costs a wake on both sides. Measures that
+    // round trip; a lost wakeup leaves both stages idle and shows up as a stall after 10 s.
+    inline BenchResult BENCH_stage_handoff(StageHost& host, const char* host_name, size_t items)
+    {
+        QueueAtomic<int64_t>  queue(2);
+        size_t                sent     = 0; // producer stage only
+        size_t                received = 0; // consumer stage only
+        std::atomic<int64_t>  end_ns_o {0};
+        std::atomic<uint32_t> done_o {0};
+
+        auto producer = host.create(
+            [&](const std::stop_token& st)
+            {
+                if (st.stop_requested() || sent == items)
+                {
+                    queue.close();
+                    return StepResult::Done;
+                }
+                if (!queue.try_push(static_cast<int64_t>(sent)))
+                {
+                    return StepResult::Idle;
+                }
+                ++sent;
+                return StepResult::Progress;
+            },
+            "producer");
+        auto consumer = host.create(
+            [&](const std::stop_token& st)
+            {
+                if (st.stop_requested())
+                {
+                    return StepResult::Done;
+                }
+                if (queue.try_pop() != std::nullopt)
+                {
+                    ++received;
+                    return StepResult::Progress;
+                }
+                if (queue.running_status())
+                {
+                    return StepResult::Idle;
+                }
+                end_ns_o.store(now_ns(), std::memory_order_relaxed);
+                done_o.store(1, std::memory_order_release);
+                done_o.notify_all();
+                return StepResult::Done;
+            },
+            "consumer");
+        queue.set_producer_waker(producer.get());
+        queue.set_consumer_waker(consumer.get());
+
+        const int64_t start_ns = now_ns();
+        const auto    deadline = bench_clock::now() + std::chrono::seconds(10);
+        producer->start();
+        consumer->start();
+        while (done_o.load(std::memory_order_acquire) == 0 && bench_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const bool stalled = done_o.load(std::memory_order_acquire) == 0;
+
+        consumer->stop();
+        producer->stop();
+        queue.set_consumer_waker(nullptr);
+        queue.set_producer_waker(nullptr);
+
+        const int64_t end_ns  = stalled ? now_ns() : end_ns_o.load(std::memory_order_relaxed);
+        const double  seconds = static_cast<double>(end_ns - start_ns) / 1e9;
+
+        BenchResult result {.name = "stage_handoff"};
+        result.param("host", host_name)
+            .param("items", static_cast<int64_t>(items))
+            .metric("items_per_s", static_cast<double>(received) / seconds)
+            .metric("stalled", stalled ? 1.0 : 0.0);
+        return result;
+    }
+
+    // ========== Pipeline ==========
+
+    struct ClipSpec
+    {
+        int         width  = 1280;
+        int         height = 720;
+        int         frames = 300;
+        int         fps    = 30;
+        int         gop    = 30;
+        AVCodecID   codec  = AV_CODEC_ID_MPEG4; // built into every FFmpeg, unlike libx264
+        const char* name   = "720p_mpeg4";
+    };
+
+    // Encodes a moving gradient with libavcodec/libavformat; the container follows the extension.
+    inline bool make_synthetic_clip(const std::string& path, const ClipSpec& spec)
+    {
+        AVFormatContext* raw_out = nullptr;
+        if (avformat_alloc_output_context2(&raw_out, nullptr, nullptr, path.c_str()) < 0 || raw_out == nullptr)
+        {
+            std::print(stderr, "[Bench] no muxer for {}\n", path);
+            return false;
+        }
+        std::unique_ptr<AVFormatContext, decltype(&avformat_free_context)> out(raw_out, &avformat_free_context);
+
+        const AVCodec* codec = avcodec_find_encoder(spec.codec);
+        if (codec == nullptr)
+        {
+            std::print(stderr, "[Bench] encoder not available\n");
+            return false;
+        }
+
+        ptr_codec_ctx_t enc {avcodec_alloc_context3(codec)};
+        enc->width     = spec.width;
+        enc->height    = spec.height;
+        enc->pix_fmt   = AV_PIX_FMT_YUV420P;
+        enc->time_base = AVRational {1, spec.fps};
+        enc->framerate = AVRational {spec.fps, 1};
+        enc->gop_size  = spec.gop;
+        enc->bit_rate  = static_cast<int64_t>(spec.width) * spec.height * spec.fps / 10;
+        if ((out->oformat->flags & AVFMT_GLOBALHEADER) != 0)
+        {
+            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (avcodec_open2(enc.get(), codec, nullptr) < 0)
+        {
+            std::print(stderr, "[Bench] could not open encoder\n");
+            return false;
+        }
+
+        AVStream* stream = avformat_new_stream(out.get(), nullptr);
+        if (stream == nullptr || avcodec_parameters_from_context(stream->codecpar, enc.get()) < 0)
+        {
+            return false;
+        }
+        stream->time_base = enc->time_base;
+
+        if ((out->oformat->flags & AVFMT_NOFILE) == 0 && avio_open(&out->pb, path.c_str(), AVIO_FLAG_WRITE) < 0)
+        {
+            std::print(stderr, "[Bench] could not create {}\n", path);
+            return false;
+        }
+        if (avformat_write_header(out.get(), nullptr) < 0)
+        {
+            avio_closep(&out->pb);
+            return false;
+        }
+
+        ptr_frame_t  frame {av_frame_alloc()};
+        ptr_packet_t pkt {av_packet_alloc()};
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width  = spec.width;
+        frame->height = spec.height;
+        av_frame_get_buffer(frame.get(), 0);
+
+        auto drain = [&]() -> bool
+        {
+            while (avcodec_receive_packet(enc.get(), pkt.get()) >= 0)
+            {
+                av_packet_rescale_ts(pkt.get(), enc->time_base, stream->time_base);
+                pkt->stream_index = stream->index;
+                if (av_interleaved_write_frame(out.get(), pkt.get()) < 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        bool ok = true;
+        for (int i = 0; i < spec.frames && ok; ++i)
+        {
+            av_frame_make_writable(frame.get());
+            for (int y = 0; y < spec.height; ++y)
+            {
+                uint8_t* row = frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0];
+                for (int x = 0; x < spec.width; ++x)
+                {
+                    row[x] = static_cast<uint8_t>(x + y + i * 3);
+                }
+            }
+            for (int p = 1; p < 3; ++p)
+            {
+                for (int y = 0; y < spec.height / 2; ++y)
+                {
+                    std::fill_n(frame->data[p] + static_cast<ptrdiff_t>(y) * frame->linesize[p],
+                                spec.width / 2,
+                                static_cast<uint8_t>(128 + (p == 1 ? i : -i)));
+                }
+            }
+            frame->pts = i;
+            ok         = avcodec_send_frame(enc.get(), frame.get()) >= 0 && drain();
+        }
+        avcodec_send_frame(enc.get(), nullptr);
+        ok = ok && drain();
+
+        av_write_trailer(out.get());
+        if ((out->oformat->flags & AVFMT_NOFILE) == 0)
+        {
+            avio_closep(&out->pb);
+        }
+        return ok;
+    }
+
+    // Demuxer output for the file benchmarks: deep enough that only the consumer sets the pace.
+    struct PacketQueues
+    {
+        QueueAtomic<ptr_packet_t> video {1024, QueueBudget {.max_bytes = 32 << 20}};
+        QueueAtomic<ptr_packet_t> audio {1024, QueueBudget {.max_bytes = 4 << 20}};
+
+        // For benchmarks without an audio consumer: pops and drops until audio is closed.
+        std::jthread discard_audio()
+        {
+            return std::jthread(
+                [this]
+                {
+                    while (audio.pop() != std::nullopt)
+                    {
+                    }
+                });
+        }
+    };
+
+    // Demuxer + Decoder on one file until end of stream, frames consumed and dropped immediately.
+    // target_w/h: decode for that display size (Decoder::target_size), as a wall tile does;
+    // bytes_per_frame is then what would be uploaded per frame.
+    inline std::optional<BenchResult> BENCH_pipeline(const std::string& path,
+                                                     const char*        clip_name,
+                                                     int                target_w = 0,
+                                                     int                target_h = 0)
+    {
+        PacketQueues             queues;
+        QueueAtomic<ptr_frame_t> video_frame_queue(32);
+
+        const auto open_start = bench_clock::now();
+        Demuxer    demux(queues.video, queues.audio, path.c_str());
+        if (demux.video_codecpar() == nullptr)
+        {
+            return std::nullopt;
+        }
+        Decoder decode(queues.video, video_frame_queue, demux.video_codecpar());
+        decode.target_size(target_w, target_h);
+        const double open_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - open_start).count();
+
+        std::jthread audio_drain = queues.discard_audio();
+
+        const auto start = bench_clock::now();
+        demux.run();
+        decode.run();
+
+        int64_t frames = 0;
+        int64_t bytes  = 0;
+        while (auto frame = video_frame_queue.pop_until(bench_clock::now() + std::chrono::seconds(10)))
+        {
+            const AVFrame* f = frame->get();
+            if (is_eof(f))
+            {
+                break;
+            }
+            if (!is_control(f))
+            {
+                ++frames;
+                bytes += static_cast<int64_t>(plane_layout(f->format, f->width, f->height).total_bytes);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        demux.stop();
+        decode.stop();
+        queues.audio.close();
+
+        BenchResult result {.name = "pipeline"};
+        result.param("clip", clip_name)
+            .param("frames", frames)
+            .param("target", target_w > 0 ? std::format("{}x{}", target_w, target_h) : std::string("full"))
+            .metric("fps", static_cast<double>(frames) / seconds)
+            .metric("open_ms", open_ms)
+            .metric("bytes_per_frame", frames > 0 ? static_cast<double>(bytes) / static_cast<double>(frames) : 0.0);
+        return result;
+    }
+
+    // Drains a demuxer built by the caller as fast as it produces; total bytes over wall time.
+    inline std::optional<BenchResult> demux_throughput(Demuxer&      demux,
+                                                       PacketQueues& queues,
+                                                       const char*   clip_name,
+                                                       const char*   io_name)
+    {
+        if (demux.video_codecpar() == nullptr)
+        {
+            return std::nullopt;
+        }
+
+        int64_t      audio_bytes = 0;
+        std::jthread audio_drain(
+            [&queues, &audio_bytes]
+            {
+                while (auto pkt = queues.audio.pop())
+                {
+                    audio_bytes += is_control(pkt->get()) ? 0 : (*pkt)->size;
+                }
+            });
+
+        const auto start = bench_clock::now();
+        demux.run();
+
+        int64_t packets = 0;
+        int64_t bytes   = 0;
+        while (auto pkt = queues.video.pop_until(bench_clock::now() + std::chrono::seconds(10)))
+        {
+            if (is_eof(pkt->get()))
+            {
+                break;
+            }
+            if (!is_control(pkt->get()))
+            {
+                ++packets;
+                bytes += (*pkt)->size;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        demux.stop();
+        queues.audio.close();
+        audio_drain.join();
+        bytes += audio_bytes;
+
+        BenchResult result {.name = "demux_io"};
+        result.param("clip", clip_name)
+            .param("io", io_name)
+            .param("packets", packets)
+            .metric("mb_per_s", static_cast<double>(bytes) / (1 << 20) / seconds)
+            .metric("packets_per_s", static_cast<double>(packets) / seconds);
+        return result;
+    }
+
+    // Demux only, once per I/O backend: the read side that high-bitrate intermediates are bound by.
+    // Synthetic clips sit in the page cache; for disk numbers drop caches between runs.
+    // video_only: every audio track discarded in the container (compare packets_per_s on
+    // captures with many tracks).
+    inline std::optional<BenchResult> BENCH_demux_io(const std::string& path,
+                                                     const char*        clip_name,
+                                                     IoMode             io,
+                                                     bool               video_only = false)
+    {
+        PacketQueues        queues;
+        const DemuxerConfig config {.io = io, .streams = {.video_only = video_only}};
+        Demuxer             demux(queues.video, queues.audio, path.c_str(), config);
+        auto                result = demux_throughput(demux, queues, clip_name, io_mode_name(io));
+        if (result)
+        {
+            result->param("streams", video_only ? "video" : "video+audio");
+        }
+        return result;
+    }
+
+    // The same clip from memory: once as a whole buffer (seekable), once pushed in 64 KiB chunks
+    // by a producer thread through a 4 MiB bounded ChunkSource (a network download, say).
+    // Loading the file is not timed.
+    inline std::optional<BenchResult> BENCH_demux_memory(const std::string& path, const char* clip_name, bool chunked)
+    {
+        std::ifstream        file(path, std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.empty())
+        {
+            std::print(stderr, "[Bench] could not read {}\n", path);
+            return std::nullopt;
+        }
+
+        PacketQueues queues;
+        if (!chunked)
+        {
+            Demuxer demux(queues.video, queues.audio, std::make_unique<MemorySource>(std::move(bytes)));
+            return demux_throughput(demux, queues, clip_name, "memory");
+        }
+
+        auto         source = std::make_unique<ChunkSource>(4 << 20);
+        ChunkSource& chunks = *source;
+        std::jthread producer(
+            [&chunks, &bytes]
+            {
+                constexpr size_t k_chunk = 64 << 10;
+                for (size_t offset = 0; offset < bytes.size(); offset += k_chunk)
+                {
+                    const size_t end   = std::min(offset + k_chunk, bytes.size());
+                    const auto   first = bytes.begin() + static_cast<std::ptrdiff_t>(offset);
+                    const auto   last  = bytes.begin() + static_cast<std::ptrdiff_t>(end);
+                    if (!chunks.push(std::vector<uint8_t>(first, last)))
+                    {
+                        return; // demuxer stopped
+                    }
+                }
+                chunks.close();
+            });
+
+        // probing happens in the constructor, which reads the first chunks
+        Demuxer demux(queues.video, queues.audio, std::move(source));
+        auto    result = demux_throughput(demux, queues, clip_name, "chunks");
+        chunks.interrupt(); // unblocks the producer if the demuxer never got going
+        producer.join();    // before demux, which owns the source, goes away
+        return result;
+    }
+
+    // ========== Seek ==========
+
+    // Seek-to-first-frame latency: demux + video decode only, no rendering, audio packets discarded.
+    // Targets are uniformly random over the file, so keyframe distance dominates accurate seeks.
+    inline std::optional<BenchResult> BENCH_seek_latency(const std::string& path,
+                                                         const char*        clip_name,
+                                                         SeekMode           mode,
+                                                         int                seeks = 50,
+                                                         uint32_t           seed  = 1)
+    {
+        using namespace std::chrono;
+
+        PacketQueues             queues;
+        QueueAtomic<ptr_frame_t> video_frame_queue(16);
+
+        Demuxer demux(queues.video, queues.audio, path.c_str());
+        if (demux.video_codecpar() == nullptr || demux.duration_us() <= 0)
+        {
+            std::print(stderr, "[Bench] {} is not a seekable video\n", path);
+            return std::nullopt;
+        }
+
+        Decoder decode(queues.video, video_frame_queue, demux.video_codecpar());
+        decode.follow(demux.serial());
+
+        std::jthread audio_drain = queues.discard_audio();
+
+        demux.run();
+        decode.run();
+
+        // false on timeout / end of pipeline
+        auto wait_first_frame = [&](int64_t serial) -> bool
+        {
+            const auto deadline = steady_clock::now() + seconds(5);
+            while (steady_clock::now() < deadline)
+            {
+                auto frame = video_frame_queue.pop_until(deadline);
+                if (frame == std::nullopt)
+                {
+                    return false;
+                }
+                if (!is_control(frame->get()) && serial_of(frame->get()) == serial)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        wait_first_frame(demux.serial().current()); // warm up: codec open, first GOP
+
+        std::mt19937_64                        rng(seed);
+        std::uniform_int_distribution<int64_t> target(0, demux.duration_us() - 1);
+        std::vector<double>                    samples_ms;
+        int64_t                                timeouts = 0;
+
+        for (int i = 0; i < seeks; ++i)
+        {
+            const auto start = steady_clock::now();
+            demux.seek(SeekRequest {.target_us = target(rng), .mode = mode});
+            if (!wait_first_frame(demux.serial().current()))
+            {
+                ++timeouts;
+                continue;
+            }
+            samples_ms.push_back(duration<double, std::milli>(steady_clock::now() - start).count());
+        }
+
+        demux.stop();
+        decode.stop();
+        queues.audio.close();
+
+        BenchResult result {.name = "seek"};
+        result.param("clip", clip_name)
+            .param("mode", mode == SeekMode::Accurate ? "accurate" : "keyframe")
+            .param("seeks", static_cast<int64_t>(seeks))
+            .metric("p50_ms", percentile(samples_ms, 0.50))
+            .metric("p95_ms", percentile(samples_ms, 0.95))
+            .metric("max_ms", percentile(samples_ms, 1.0))
+            .metric("timeouts", static_cast<double>(timeouts));
+        return result;
+    }
+
+    // Contact sheets for `files` copies of one clip (the same path listed again): keyframe-only
+    // decode and a seek per tile, several files in flight on one executor. The sheets are
+    // written to a directory under workdir, removed again afterwards.
+    inline std::optional<BenchResult> BENCH_thumbnails(const std::string& path,
+                                                       const char*        clip_name,
+                                                       const std::string& workdir,
+                                                       int                files = 8)
+    {
+        const std::vector<const char*> paths(static_cast<size_t>(std::max(files, 1)), path.c_str());
+        const ThumbnailConfig          config {};
+        const std::filesystem::path    out_dir = std::filesystem::path(workdir) / "thumbnails";
+        std::error_code                ec;
+        std::filesystem::create_directories(out_dir, ec);
+
+        const auto           start = bench_clock::now();
+        ThumbnailBatch       batch(config);
+        const ThumbnailStats stats   = batch.run(paths, out_dir.string(), ".ppm");
+        const double         seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        std::filesystem::remove_all(out_dir, ec);
+        if (stats.written == 0)
+        {
+            return std::nullopt;
+        }
+
+        BenchResult result {.name = "thumbnails"};
+        result.param("clip", clip_name)
+            .param("files", static_cast<int64_t>(stats.files))
+            .param("tiles_per_file", static_cast<int64_t>(config.count))
+            .metric("files_per_s", static_cast<double>(stats.written) / seconds)
+            .metric("ms_per_file", seconds * 1e3 / static_cast<double>(stats.written))
+            .metric("tiles", static_cast<double>(stats.tiles))
+            .metric("failed", static_cast<double>(stats.failed));
+        return result;
+    }
+
+    // ========== Live ==========
+
+#if defined(__unix__) || defined(__APPLE__)
+    // Live-input stand-in: the clip is written into a FIFO at its own average bitrate, the way a
+    // network source delivers it, and the player reads the FIFO like any other input.
+    // A frame's latency is when it came out of the decoder minus when its pts was due on the
+    // feed's timeline (t0 = the reader connected), so probing and queue depth both show up.
+    inline std::optional<BenchResult> BENCH_live_latency(const std::string& path,
+                                                         const char*        clip_name,
+                                                         LatencyProfile     latency)
+    {
+        using namespace std::chrono;
+
+        int64_t duration_us = 0;
+        {
+            AVFormatContext* raw = nullptr;
+            if (avformat_open_input(&raw, path.c_str(), nullptr, nullptr) < 0)
+            {
+                return std::nullopt;
+            }
+            ptr_format_ctx_t probe(raw);
+            if (avformat_find_stream_info(probe.get(), nullptr) >= 0)
+            {
+                duration_us = probe->duration;
+            }
+        }
+        std::error_code ec;
+        const auto      file_size = static_cast<int64_t>(std::filesystem::file_size(path, ec));
+        if (ec || duration_us <= 0 || file_size <= 0)
+        {
+            std::print(stderr, "[Bench] {} has no usable duration / size\n", path);
+            return std::nullopt;
+        }
+
+        const std::string fifo = path + ".fifo";
+        std::filesystem::remove(fifo, ec);
+        if (mkfifo(fifo.c_str(), 0600) != 0)
+        {
+            std::print(stderr, "[Bench] mkfifo {} failed\n", fifo);
+            return std::nullopt;
+        }
+        std::signal(SIGPIPE, SIG_IGN); // the reader may go away mid-write
+
+        std::atomic<int64_t> feed_start_ns {0};
+        std::jthread         feeder(
+            [&](const std::stop_token& st)
+            {
+                // non-blocking open fails until the reader has opened its end
+                int fd = -1;
+                while (!st.stop_requested() && (fd = ::open(fifo.c_str(), O_WRONLY | O_NONBLOCK)) < 0)
+                {
+                    std::this_thread::sleep_for(milliseconds(1));
+                }
+                if (fd < 0)
+                {
+                    return;
+                }
+                const int64_t start = now_ns();
+                feed_start_ns.store(start, std::memory_order_release);
+
+                std::ifstream          in(path, std::ios::binary);
+                std::array<char, 4096> buf {};
+                int64_t                sent = 0;
+                while (!st.stop_requested() && in)
+                {
+                    in.read(buf.data(), buf.size());
+                    const auto n = static_cast<size_t>(in.gcount());
+                    // byte `sent` is due at sent / size of the way through the clip
+                    const double  share  = static_cast<double>(sent) / static_cast<double>(file_size);
+                    const int64_t due_ns = start + static_cast<int64_t>(share * static_cast<double>(duration_us) * 1e3);
+                    std::this_thread::sleep_for(nanoseconds(std::max<int64_t>(due_ns - now_ns(), 0)));
+
+                    size_t off = 0;
+                    while (off < n && !st.stop_requested())
+                    {
+                        const ssize_t w = ::write(fd, buf.data() + off, n - off);
+                        if (w > 0)
+                        {
+                            off += static_cast<size_t>(w);
+                            continue;
+                        }
+                        if (w < 0 && errno != EAGAIN)
+                        {
+                            break; // reader closed
+                        }
+                        pollfd pfd {.fd = fd, .events = POLLOUT, .revents = 0};
+                        ::poll(&pfd, 1, 50);
+                    }
+                    if (off < n)
+                    {
+                        break;
+                    }
+                    sent += static_cast<int64_t>(n);
+                }
+                ::close(fd);
+            });
+
+        const PipelineProfile     profile = pipeline_profile(latency);
+        QueueAtomic<ptr_packet_t> video_packet_queue(profile.video_packet_slots, profile.video_packet_budget);
+        QueueAtomic<ptr_packet_t> audio_packet_queue(profile.audio_packet_slots, profile.audio_packet_budget);
+        QueueAtomic<ptr_frame_t>  video_frame_queue(profile.video_frame_slots, profile.video_frame_budget);
+
+        const auto open_start = bench_clock::now();
+        Demuxer    demux(video_packet_queue, audio_packet_queue, fifo.c_str(), profile.demux);
+        if (demux.video_codecpar() == nullptr)
+        {
+            feeder.request_stop();
+            feeder.join();
+            std::filesystem::remove(fifo, ec);
+            return std::nullopt;
+        }
+        Decoder      decode(video_packet_queue, video_frame_queue, demux.video_codecpar(), profile.video_decoder);
+        const double open_ms = duration<double, std::milli>(bench_clock::now() - open_start).count();
+
+        std::jthread audio_drain(
+            [&audio_packet_queue](const std::stop_token& st)
+            {
+                while (!st.stop_requested() && audio_packet_queue.pop() != std::nullopt)
+                {
+                }
+            });
+
+        demux.run();
+        decode.run();
+
+        std::vector<double> samples_ms;
+        double              first_frame_ms = 0.0;
+        double              first_pts      = std::numeric_limits<double>::quiet_NaN();
+        while (auto frame = video_frame_queue.pop_until(bench_clock::now() + seconds(10)))
+        {
+            const AVFrame* f = frame->get();
+            if (is_eof(f))
+            {
+                break;
+            }
+            const int64_t pts = f->best_effort_timestamp != AV_NOPTS_VALUE ? f->best_effort_timestamp : f->pts;
+            if (is_control(f) || pts == AV_NOPTS_VALUE || f->time_base.den <= 0)
+            {
+                continue;
+            }
+
+            const double  pts_sec = static_cast<double>(pts) * av_q2d(f->time_base);
+            const int64_t now     = now_ns();
+            const int64_t start   = feed_start_ns.load(std::memory_order_acquire);
+            if (std::isnan(first_pts))
+            {
+                first_pts      = pts_sec;
+                first_frame_ms = static_cast<double>(now - start) / 1e6;
+            }
+            const double due_ns = static_cast<double>(start) + (pts_sec - first_pts) * 1e9;
+            samples_ms.push_back((static_cast<double>(now) - due_ns) / 1e6);
+        }
+
+        demux.stop();
+        decode.stop();
+        audio_drain.request_stop();
+        audio_packet_queue.close();
+        feeder.request_stop();
+        feeder.join();
+        std::filesystem::remove(fifo, ec);
+
+        const auto frames = static_cast<int64_t>(samples_ms.size());
+        BenchResult result {.name = "live"};
+        result.param("clip", clip_name)
+            .param("profile", latency == LatencyProfile::Low ? "low" : "standard")
+            .param("frames", frames)
+            .metric("open_ms", open_ms)
+            .metric("first_frame_ms", first_frame_ms)
+            .metric("p50_ms", percentile(samples_ms, 0.50))
+            .metric("p95_ms", percentile(samples_ms, 0.95));
+        return result;
+    }
+#endif
+
+} // namespace BENCH
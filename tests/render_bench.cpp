@@ -0,0 +1,139 @@
+// Offscreen render benchmark and color check: xmake build render_bench && xmake run render_bench [options]
+// Needs EGL (Mesa llvmpipe is enough), no window or display server.
+//
+//   --json <file>     write the JSON report there (default: stdout)
+//   --quick           fewer frames, no 4K, for CI smoke runs
+//   --shaders <dir>   where vertex.shader / fragment.shader are (default: shader)
+//   --dump <dir>      write a PPM of every color check case there
+//
+// Exits with 1 when a color check fails.
+
+#include <cstring>
+#include <fstream>
+#include <print>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "render_bench.h"
+
+static std::string read_text(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::print(stderr, "could not open {}\n", path);
+        return "";
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string json_path;
+    std::string shader_dir = "shader";
+    std::string dump_dir;
+    bool        quick = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--shaders") == 0 && i + 1 < argc)
+        {
+            shader_dir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+        {
+            dump_dir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else
+        {
+            std::print(stderr, "unknown option {}\n", argv[i]);
+            return 1;
+        }
+    }
+
+    const BENCH::RenderShaders shaders {.vertex   = read_text(shader_dir + "/vertex.shader"),
+                                        .fragment = read_text(shader_dir + "/fragment.shader")};
+    if (shaders.vertex.empty() || shaders.fragment.empty())
+    {
+        return 1;
+    }
+
+    OffscreenContext context;
+    if (!context.ok())
+    {
+        return 1;
+    }
+    std::print(stderr, "[Render] {}\n", OffscreenContext::renderer_name());
+
+    // every layout the renderer has a shader path for: planar, semi-planar, swapped, 10-bit both ways
+    const int formats[] = {AV_PIX_FMT_YUV420P,
+                           AV_PIX_FMT_YUV444P,
+                           AV_PIX_FMT_NV12,
+                           AV_PIX_FMT_NV21,
+                           AV_PIX_FMT_YUV420P10LE,
+                           AV_PIX_FMT_P010LE};
+
+    int failures = 0;
+    for (const int format : formats)
+    {
+        failures += BENCH::CHECK_colors(shaders, format, dump_dir);
+    }
+
+    struct Size
+    {
+        int w, h;
+    };
+    std::vector<Size> sizes = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    if (quick)
+    {
+        sizes.resize(1);
+    }
+
+    std::vector<BENCH::BenchResult> results;
+    for (const int format : formats)
+    {
+        for (const Size size : sizes)
+        {
+            for (const bool readback : {false, true})
+            {
+                if (auto r = BENCH::BENCH_render(shaders, format, size.w, size.h, quick ? 30 : 120, readback))
+                {
+                    results.push_back(*r);
+                }
+            }
+        }
+    }
+
+    if (failures > 0)
+    {
+        std::print(stderr, "[Render] {} color check(s) failed\n", failures);
+    }
+    const int status = failures > 0 ? 1 : 0;
+
+    const std::string json = BENCH::to_json(results);
+    if (json_path.empty())
+    {
+        std::print("{}", json);
+        return status;
+    }
+
+    std::ofstream out(json_path);
+    if (!out.is_open())
+    {
+        std::print(stderr, "could not write {}\n", json_path);
+        return 1;
+    }
+    out << json;
+    return status;
+}
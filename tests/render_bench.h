@@ -0,0 +1,284 @@
+#pragma once
+// NOTE:   offscreen render benchmarks and the color check; EGL, no window, see tests/render_bench.cpp
+
+#include "../src/renderer/offscreen.h"
+#include "../src/renderer/video.h"
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libavutil/pixdesc.h"
+}
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+#include "../src/utils/alias.h"
+#include "../src/utils/ffmpeg_deleter.h"
+#include "./benchmark.h"
+
+namespace BENCH
+{
+    struct RenderShaders
+    {
+        std::string vertex;
+        std::string fragment;
+    };
+
+    inline ptr_frame_t make_test_frame(int format, int w, int h)
+    {
+        ptr_frame_t frame(av_frame_alloc());
+        if (frame == nullptr)
+        {
+            return nullptr;
+        }
+        frame->format = format;
+        frame->width  = w;
+        frame->height = h;
+        if (av_frame_get_buffer(frame.get(), 0) < 0)
+        {
+            std::print(stderr, "[Render] could not allocate a {}x{} frame\n", w, h);
+            return nullptr;
+        }
+        return frame;
+    }
+
+    // Writes normalized [0, 1] samples as the format stores them (bit depth, MSB alignment).
+    // sample(component, x, y) is called per sample, component 0/1/2 = Y/U/V, x/y in that plane.
+    template <typename F>
+    void fill_frame(AVFrame* frame, F&& sample)
+    {
+        const PlaneLayout         layout = plane_layout(frame->format, frame->width, frame->height);
+        const AVPixFmtDescriptor* desc   = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        const int                 depth  = desc->comp[0].depth;
+        const int                 shift  = desc->comp[0].shift;
+        const double              max    = static_cast<double>((1 << depth) - 1);
+
+        for (int p = 0; p < layout.plane_count; ++p)
+        {
+            const PlaneUpload& plane = layout.planes[p];
+            for (int y = 0; y < plane.height; ++y)
+            {
+                uint8_t* row = frame->data[p] + static_cast<ptrdiff_t>(y) * frame->linesize[p];
+                for (int x = 0; x < plane.width; ++x)
+                {
+                    for (int c = 0; c < plane.channels; ++c)
+                    {
+                        // component order inside an interleaved plane: U V, or V U when swapped
+                        const int component
+                            = p == 0 ? 0 : plane.channels == 1 ? p : (c ^ (layout.swap_uv ? 1 : 0)) + 1;
+                        const double value = std::clamp(sample(component, x, y), 0.0, 1.0);
+                        const auto   code  = static_cast<uint32_t>(std::lround(value * max)) << shift;
+                        const size_t at    = static_cast<size_t>(x * plane.channels + c);
+                        if (plane.bytes_per_sample == 2)
+                        {
+                            reinterpret_cast<uint16_t*>(row)[at] = static_cast<uint16_t>(code);
+                        }
+                        else
+                        {
+                            row[at] = static_cast<uint8_t>(code);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // BT.601 full range, the inverse of the fragment shader's matrix
+    inline std::array<double, 3> rgb_to_yuv(double r, double g, double b)
+    {
+        const double y = 0.299 * r + 0.587 * g + 0.114 * b;
+        return {y, (b - y) / 1.772 + 0.5, (r - y) / 1.402 + 0.5};
+    }
+
+    // Upload + draw per frame into an offscreen target, optionally with an asynchronous readback
+    // of every frame. A few differently filled frames take turns, so every upload is real and
+    // the timed loop is GL work only; gpu_ms is a GL_TIME_ELAPSED query around that loop.
+    inline std::optional<BenchResult> BENCH_render(const RenderShaders& shaders,
+                                                   int                  format,
+                                                   int                  w,
+                                                   int                  h,
+                                                   int                  frames,
+                                                   bool                 readback)
+    {
+        std::array<ptr_frame_t, 4> sources;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            sources[i] = make_test_frame(format, w, h);
+            if (sources[i] == nullptr)
+            {
+                return std::nullopt;
+            }
+            fill_frame(sources[i].get(),
+                       [i, w](int component, int x, int)
+                       {
+                           return component == 0 ? static_cast<double>((x + i * 7) % w) / w : 0.25 + 0.125 * i;
+                       });
+        }
+        Renderer      renderer(w, h, shaders.vertex.c_str(), shaders.fragment.c_str());
+        RenderTarget  target(w, h);
+        FrameReadback reader(w, h);
+        if (!renderer.ok() || !target.ok())
+        {
+            return std::nullopt;
+        }
+        target.bind();
+
+        uint64_t checksum = 0;
+        auto     on_frame = [&checksum](const ReadbackFrame& f)
+        {
+            checksum = readback_checksum(f);
+        };
+        auto draw = [&](int index)
+        {
+            renderer.renderFrame(sources[index % sources.size()].get());
+            if (readback)
+            {
+                while (!reader.request(index))
+                {
+                    reader.collect(on_frame);
+                }
+                reader.collect(on_frame);
+            }
+        };
+
+        for (int i = 0; i < static_cast<int>(sources.size()); ++i)
+        {
+            draw(i); // shader compile, texture allocation
+        }
+        reader.collect(on_frame, true);
+        glFinish();
+
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        const auto start = bench_clock::now();
+        for (int i = 0; i < frames; ++i)
+        {
+            draw(i);
+        }
+        reader.collect(on_frame, true);
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        GLuint64     gpu_ns  = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpu_ns);
+        glDeleteQueries(1, &query);
+
+        reader.shutdown();
+        target.shutdown();
+        renderer.shutdown();
+
+        BenchResult result {.name = "render"};
+        result.param("format", av_get_pix_fmt_name(static_cast<AVPixelFormat>(format)))
+            .param("size", std::format("{}x{}", w, h))
+            .param("readback", static_cast<int64_t>(readback ? 1 : 0))
+            .metric("fps", frames / seconds)
+            .metric("ms_per_frame", seconds * 1e3 / frames)
+            .metric("gpu_ms_per_frame", static_cast<double>(gpu_ns) / 1e6 / frames)
+            .metric("mpixels_per_s", static_cast<double>(w) * h * frames / seconds / 1e6);
+        if (readback)
+        {
+            result.param("checksum", std::format("{:016x}", checksum)); // last frame, same driver = same value
+        }
+        return result;
+    }
+
+    struct ColorCase
+    {
+        const char* name;
+        double      r, g, b;
+    };
+
+    // Solid frames of known colors through upload + shader, read back and compared per channel.
+    // Returns the number of mismatches; every case is printed. dump_dir: PPMs of each case.
+    inline int CHECK_colors(const RenderShaders& shaders, int format, const std::string& dump_dir)
+    {
+        static constexpr ColorCase cases[] = {
+            {"black", 0.0, 0.0, 0.0},
+            {"white", 1.0, 1.0, 1.0},
+            {"gray", 0.5, 0.5, 0.5},
+            {"red", 1.0, 0.0, 0.0},
+            {"green", 0.0, 1.0, 0.0},
+            {"blue", 0.0, 0.0, 1.0},
+            {"orange", 1.0, 0.5, 0.0},
+        };
+        constexpr int w         = 64;
+        constexpr int h         = 64;
+        constexpr int tolerance = 3; // 8-bit chroma rounding through the matrix
+
+        const char* format_name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(format));
+        ptr_frame_t frame       = make_test_frame(format, w, h);
+        if (frame == nullptr)
+        {
+            return 1;
+        }
+        Renderer      renderer(w, h, shaders.vertex.c_str(), shaders.fragment.c_str());
+        RenderTarget  target(w, h);
+        FrameReadback reader(w, h, 1);
+        if (!renderer.ok() || !target.ok())
+        {
+            std::print(stderr, "[Render] no renderer for {}\n", format_name);
+            return 1;
+        }
+        target.bind();
+
+        int failures = 0;
+        for (const ColorCase& color : cases)
+        {
+            const auto yuv = rgb_to_yuv(color.r, color.g, color.b);
+            fill_frame(frame.get(),
+                       [&yuv](int component, int, int)
+                       {
+                           return yuv[component];
+                       });
+            renderer.renderFrame(frame.get());
+            reader.request(0);
+            reader.collect(
+                [&](const ReadbackFrame& f)
+                {
+                    const uint8_t* px       = f.pixel(w / 2, h / 2);
+                    const int      expect[] = {static_cast<int>(std::lround(color.r * 255)),
+                                               static_cast<int>(std::lround(color.g * 255)),
+                                               static_cast<int>(std::lround(color.b * 255))};
+                    int            error    = 0;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        error = std::max(error, std::abs(px[c] - expect[c]));
+                    }
+                    const bool ok = error <= tolerance;
+                    failures += ok ? 0 : 1;
+                    std::print("[Render] {:<12} {:<7} got {:3} {:3} {:3} want {:3} {:3} {:3} {}\n",
+                               format_name,
+                               color.name,
+                               px[0],
+                               px[1],
+                               px[2],
+                               expect[0],
+                               expect[1],
+                               expect[2],
+                               ok ? "ok" : "FAIL");
+                    if (!dump_dir.empty())
+                    {
+                        const auto file = std::format("{}_{}.ppm", format_name, color.name);
+                        write_ppm((std::filesystem::path(dump_dir) / file).string().c_str(), f);
+                    }
+                },
+                true);
+        }
+
+        reader.shutdown();
+        target.shutdown();
+        renderer.shutdown();
+        return failures;
+    }
+} // namespace BENCH
@@ -10,9 +10,17 @@ add_requires(
     "imgui", {configs = {glfw_opengl3 = true}}
 )
 
+-- pipeline timeline for chrome://tracing / Perfetto: xmake f --trace=y
+option("trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Record a Chrome trace of the pipeline threads (LITEP_TRACE)")
+    add_defines("LITEP_TRACE")
+
 target("litePlayer")
     set_kind("binary")
     add_files("main.cpp")
+    add_options("trace")
 
     add_packages("glfw", "glad", "ffmpeg", "stdexec", "imgui")
 
@@ -48,4 +56,29 @@ target("litePlayer")
 --     add_options("queue_test")
 --     if has_config("queue_test") then
 --         add_files("tests/EXCEPT.cpp")
---     end
\ No newline at end of file
+--     end
+
+-- headless benchmarks: xmake build benchmark && xmake run benchmark --json bench.json
+target("benchmark")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/benchmark.cpp")
+
+    add_packages("ffmpeg", "stdexec")
+
+    if is_plat("linux") then
+        add_syslinks("pthread", "dl")
+    end
+
+-- offscreen render benchmark + color check over EGL (Mesa llvmpipe is enough, no display):
+-- xmake build render_bench && xmake run render_bench --shaders shader --json render.json
+target("render_bench")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/render_bench.cpp")
+
+    add_packages("glad", "ffmpeg", "stdexec")
+
+    if is_plat("linux") then
+        add_syslinks("pthread", "dl", "EGL", "GL")
+    end